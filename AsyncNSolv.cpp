@@ -0,0 +1,561 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "AsyncNSolv.h"
+#include "SolverManager.h"
+#include "EventEngine.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+NSolvFuture::NSolvFuture(AsyncNSolv* _owner, unsigned long _id, const char* _query, size_t length, NSolvCallback* _callback) :
+owner(_owner), id(_id), references(2), query(_query,length), hasDeadline(false), callback(_callback),
+finished(false), result(NSolv::ERROR), output(), winner()
+{
+	pthread_mutex_init(&lock,NULL);
+	pthread_cond_init(&finishedCondition,NULL);
+}
+
+NSolvFuture::~NSolvFuture()
+{
+	pthread_cond_destroy(&finishedCondition);
+	pthread_mutex_destroy(&lock);
+}
+
+void NSolvFuture::wait()
+{
+	pthread_mutex_lock(&lock);
+	while(!finished)
+		pthread_cond_wait(&finishedCondition,&lock);
+	pthread_mutex_unlock(&lock);
+}
+
+bool NSolvFuture::isFinished()
+{
+	pthread_mutex_lock(&lock);
+	bool f=finished;
+	pthread_mutex_unlock(&lock);
+	return f;
+}
+
+//Nothing changes once we are finished so these don't need the lock after wait().
+NSolv::Result NSolvFuture::getResult()
+{
+	wait();
+	return result;
+}
+
+const std::string& NSolvFuture::getOutput()
+{
+	wait();
+	return output;
+}
+
+const std::string& NSolvFuture::getWinner()
+{
+	wait();
+	return winner;
+}
+
+void NSolvFuture::cancel()
+{
+	//Holding our lock stops the race from finishing (and "owner" going) in the meantime.
+	pthread_mutex_lock(&lock);
+	if(!finished && owner != NULL)
+		owner->requestCancel(id);
+	pthread_mutex_unlock(&lock);
+}
+
+void NSolvFuture::release()
+{
+	pthread_mutex_lock(&lock);
+	bool last= --references == 0;
+	pthread_mutex_unlock(&lock);
+
+	if(last)
+		delete this;
+}
+
+AsyncNSolv::AsyncNSolv() :
+solvers(), timeout(0.0), tierDelay(1.0), killGrace(1.0), loggingPath(), fastSpawn(true), verbose(false), maxProcesses(1), maxPending(0),
+valid(false), threadStarted(false), submitted(), cancelRequests(), cancelEverything(false), shuttingDown(false), nextId(0), pending(0),
+events(new EventEngine()), queue(), running(), liveProcesses(0)
+{
+	long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	if(cpus > 0)
+		maxProcesses=cpus;
+
+	pthread_mutex_init(&lock,NULL);
+	pthread_cond_init(&spaceCondition,NULL);
+
+	//Non-blocking so that wake() never blocks and the thread can empty it.
+	if(pipe2(wakeup,O_CLOEXEC | O_NONBLOCK) == -1)
+	{
+		perror("AsyncNSolv: Couldn't create the wakeup pipe:");
+		wakeup[0]=wakeup[1]=-1;
+		return;
+	}
+
+	if(!events->isValid() || !events->watchReadable(wakeup[0],NULL))
+	{
+		cerr << "AsyncNSolv: Failed to set up the event engine" << endl;
+		return;
+	}
+
+	int error=pthread_create(&thread,NULL,threadEntry,this);
+	if(error != 0)
+	{
+		cerr << "AsyncNSolv: Couldn't start the thread: " << strerror(error) << endl;
+		return;
+	}
+
+	threadStarted=true;
+	valid=true;
+}
+
+AsyncNSolv::~AsyncNSolv()
+{
+	if(threadStarted)
+	{
+		pthread_mutex_lock(&lock);
+		shuttingDown=true;
+		pthread_cond_broadcast(&spaceCondition);
+		pthread_mutex_unlock(&lock);
+
+		wake();
+		pthread_join(thread,NULL);
+	}
+
+	//Submitted while we were shutting down
+	for(vector<NSolvFuture*>::iterator f=submitted.begin(); f != submitted.end(); ++f)
+		finish(*f,NSolv::CANCELLED);
+
+	delete events;
+	if(wakeup[0] != -1)
+	{
+		close(wakeup[0]);
+		close(wakeup[1]);
+	}
+	pthread_cond_destroy(&spaceCondition);
+	pthread_mutex_destroy(&lock);
+}
+
+bool AsyncNSolv::isValid() const
+{
+	return threadStarted;
+}
+
+void AsyncNSolv::addSolver(const std::string& name, const std::string& options, bool inputOnStdin, unsigned int tier)
+{
+	SolverEntry s;
+	s.name=name;
+	s.options=options;
+	s.inputOnStdin=inputOnStdin;
+	s.tier=tier;
+	solvers.push_back(s);
+}
+
+void AsyncNSolv::setTimeout(double seconds)
+{
+	timeout=seconds;
+}
+
+void AsyncNSolv::setTierDelay(double seconds)
+{
+	tierDelay=seconds;
+}
+
+void AsyncNSolv::setKillGrace(double seconds)
+{
+	killGrace=seconds;
+}
+
+void AsyncNSolv::setLoggingPath(const std::string& path)
+{
+	loggingPath=path;
+}
+
+void AsyncNSolv::setFastSpawn(bool fast)
+{
+	fastSpawn=fast;
+}
+
+void AsyncNSolv::setVerbose(bool _verbose)
+{
+	verbose=_verbose;
+}
+
+void AsyncNSolv::setMaxProcesses(unsigned int n)
+{
+	maxProcesses=n;
+}
+
+void AsyncNSolv::setMaxPending(unsigned int n)
+{
+	maxPending=n;
+}
+
+NSolvFuture* AsyncNSolv::submit(const std::string& query, double timeout, NSolvCallback* callback)
+{
+	return submit(query.data(),query.size(),timeout,callback);
+}
+
+NSolvFuture* AsyncNSolv::submit(const char* query, size_t length, double _timeout, NSolvCallback* callback)
+{
+	double seconds= _timeout > 0? _timeout : timeout;
+	timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC,&deadline);
+	deadline=add(deadline,fromDouble(seconds));
+
+	//Our own thread (i.e. a callback) would wait for itself.
+	bool mayWait= !threadStarted || !pthread_equal(pthread_self(),thread);
+
+	pthread_mutex_lock(&lock);
+	while(mayWait && valid && !shuttingDown && maxPending > 0 && pending >= maxPending)
+		pthread_cond_wait(&spaceCondition,&lock);
+
+	NSolvFuture* f=new NSolvFuture(this,nextId++,query,length,callback);
+	f->hasDeadline= seconds > 0;
+	f->deadline=deadline;
+
+	bool accepted=valid;
+	if(accepted)
+	{
+		submitted.push_back(f);
+		pending++;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if(!accepted)
+	{
+		//There is no thread to hand it to.
+		f->references=1;
+		f->owner=NULL;
+		f->finished=true;
+		if(callback != NULL)
+			callback->finished(f);
+		return f;
+	}
+
+	wake();
+	return f;
+}
+
+void AsyncNSolv::cancelAll()
+{
+	pthread_mutex_lock(&lock);
+	cancelEverything=true;
+	pthread_mutex_unlock(&lock);
+	wake();
+}
+
+void AsyncNSolv::requestCancel(unsigned long id)
+{
+	pthread_mutex_lock(&lock);
+	cancelRequests.push_back(id);
+	pthread_mutex_unlock(&lock);
+	wake();
+}
+
+void AsyncNSolv::wake()
+{
+	//If the pipe is full the thread has plenty to wake it up already.
+	int error=errno;
+	ssize_t ignored=write(wakeup[1],"w",1);
+	(void) ignored;
+	errno=error;
+}
+
+void* AsyncNSolv::threadEntry(void* arg)
+{
+	static_cast<AsyncNSolv*>(arg)->run();
+	return NULL;
+}
+
+void AsyncNSolv::run()
+{
+	vector<EventEngine::Event> ready;
+	while(true)
+	{
+		/* Empty the pipe before looking at what we were woken up for. Anything handed
+		 * over after this writes to it again so it can't be missed.
+		 */
+		char discard[64];
+		while(read(wakeup[0],discard,sizeof(discard)) > 0);
+
+		vector<NSolvFuture*> arrived;
+		vector<unsigned long> cancels;
+		pthread_mutex_lock(&lock);
+		arrived.swap(submitted);
+		cancels.swap(cancelRequests);
+		bool stopping=shuttingDown;
+		bool everything= cancelEverything || shuttingDown;
+		cancelEverything=false;
+		pthread_mutex_unlock(&lock);
+
+		queue.insert(queue.end(),arrived.begin(),arrived.end());
+
+		if(everything)
+		{
+			cancels.clear();
+			for(list<NSolvFuture*>::const_iterator q=queue.begin(); q != queue.end(); ++q)
+				cancels.push_back((*q)->id);
+			for(map<unsigned long,Race*>::const_iterator r=running.begin(); r != running.end(); ++r)
+				cancels.push_back(r->first);
+		}
+
+		for(vector<unsigned long>::const_iterator id=cancels.begin(); id != cancels.end(); ++id)
+			cancel(*id);
+
+		//The cancelled races carry on until their solvers have been reaped.
+		if(stopping && running.empty())
+			return;
+
+		startQueued();
+
+		//Queries run out of time while they are queued too.
+		bool haveDeadline=false;
+		timespec deadline;
+		for(list<NSolvFuture*>::const_iterator q=queue.begin(); q != queue.end(); ++q)
+		{
+			if((*q)->hasDeadline && (!haveDeadline || deadline > (*q)->deadline))
+			{
+				deadline=(*q)->deadline;
+				haveDeadline=true;
+			}
+		}
+
+		if(haveDeadline)
+			events->setDeadline(deadline);
+		else
+			events->clearDeadline();
+
+		//Each race's SolverManager has an epoll of its own which is readable when it has something to do.
+		ready.clear();
+		if(events->wait(ready) == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			perror("AsyncNSolv: Something went wrong waiting for races via epoll_wait()");
+			abandon();
+			return;
+		}
+
+		for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+		{
+			if(e->type == EventEngine::READABLE && e->data != NULL)
+				advance(static_cast<Race*>(e->data));
+		}
+	}
+}
+
+void AsyncNSolv::startQueued()
+{
+	timespec current;
+	clock_gettime(CLOCK_MONOTONIC,&current);
+
+	for(list<NSolvFuture*>::iterator q=queue.begin(); q != queue.end();)
+	{
+		NSolvFuture* f=*q;
+		if(!f->hasDeadline || !(current >= f->deadline))
+		{
+			++q;
+			continue;
+		}
+
+		if(verbose) cerr << "AsyncNSolv: Query " << f->id << " ran out of time before it could start" << endl;
+		q=queue.erase(q);
+		freePending();
+		finish(f,NSolv::TIMEOUT);
+	}
+
+	//In order of submission so that nothing waits forever
+	while(!queue.empty() && (liveProcesses == 0 || liveProcesses + solvers.size() <= maxProcesses))
+	{
+		NSolvFuture* f=queue.front();
+		queue.pop_front();
+		freePending();
+		start(f);
+	}
+}
+
+void AsyncNSolv::start(NSolvFuture* f)
+{
+	double remaining=0.0;
+	if(f->hasDeadline)
+	{
+		timespec current;
+		clock_gettime(CLOCK_MONOTONIC,&current);
+		if(current >= f->deadline)
+		{
+			finish(f,NSolv::TIMEOUT);
+			return;
+		}
+
+		//0 would mean no timeout at all
+		remaining=max(toDouble(subtract(f->deadline,current)),1E-6);
+	}
+
+	SolverManager* sm=new SolverManager(f->query.data(),f->query.size(),"(memory)",remaining,loggingPath,verbose);
+
+	//The solvers read the copy SolverManager made.
+	string().swap(f->query);
+
+	bool added=sm->isValid();
+	vector<int> noCpus;
+	for(vector<SolverEntry>::const_iterator s=solvers.begin(); added && s != solvers.end(); ++s)
+		added=sm->addSolver(s->name,s->options,s->inputOnStdin,noCpus,s->tier,ResourceLimits());
+
+	Race* r=new Race();
+	r->id=f->id;
+	r->future=f;
+	r->manager=sm;
+	r->delivered=false;
+
+	if(!added || !events->watchReadable(sm->getFileDescriptor(),r))
+	{
+		delete sm;
+		delete r;
+		finish(f,NSolv::ERROR);
+		return;
+	}
+
+	sm->setTierDelay(tierDelay);
+	sm->setKillGrace(killGrace);
+	sm->setFastSpawn(fastSpawn);
+
+	if(verbose) cerr << "AsyncNSolv: Starting query " << f->id << " (" << running.size() << " other race(s) running)" << endl;
+	running[r->id]=r;
+	liveProcesses+=sm->getNumberOfSolvers();
+	sm->startRace(r->output);
+	advance(r);
+}
+
+void AsyncNSolv::cancel(unsigned long id)
+{
+	map<unsigned long,Race*>::iterator r=running.find(id);
+	if(r != running.end())
+	{
+		r->second->manager->cancelRace();
+		advance(r->second);
+		return;
+	}
+
+	for(list<NSolvFuture*>::iterator q=queue.begin(); q != queue.end(); ++q)
+	{
+		if((*q)->id == id)
+		{
+			NSolvFuture* f=*q;
+			queue.erase(q);
+			freePending();
+			finish(f,NSolv::CANCELLED);
+			return;
+		}
+	}
+
+	//Otherwise it has already finished.
+}
+
+void AsyncNSolv::advance(Race* r)
+{
+	SolverManager* sm=r->manager;
+	sm->continueRace();
+
+	//The result doesn't wait for the losers to be stopped.
+	if(!r->delivered && sm->isDecided())
+	{
+		r->delivered=true;
+		NSolvFuture* f=r->future;
+		if(sm->hasWinner())
+		{
+			f->output.swap(r->output);
+			f->winner=sm->getWinner();
+		}
+		finish(f,NSolv::resultOf(*sm));
+	}
+
+	if(sm->isFinished())
+	{
+		events->unwatchReadable(sm->getFileDescriptor());
+		liveProcesses-=sm->getNumberOfSolvers();
+		running.erase(r->id);
+		delete sm;
+		delete r;
+	}
+}
+
+void AsyncNSolv::finish(NSolvFuture* f, NSolv::Result result)
+{
+	//"output" and "winner" were set before "finished" so waiters see them under the lock.
+	pthread_mutex_lock(&f->lock);
+	f->result=result;
+	f->finished=true;
+	f->owner=NULL;
+	pthread_cond_broadcast(&f->finishedCondition);
+	pthread_mutex_unlock(&f->lock);
+
+	if(f->callback != NULL)
+		f->callback->finished(f);
+
+	f->release();
+}
+
+void AsyncNSolv::freePending()
+{
+	pthread_mutex_lock(&lock);
+	pending--;
+	pthread_cond_broadcast(&spaceCondition);
+	pthread_mutex_unlock(&lock);
+}
+
+void AsyncNSolv::abandon()
+{
+	pthread_mutex_lock(&lock);
+	valid=false;
+	queue.insert(queue.end(),submitted.begin(),submitted.end());
+	submitted.clear();
+	pthread_cond_broadcast(&spaceCondition);
+	pthread_mutex_unlock(&lock);
+
+	while(!queue.empty())
+	{
+		NSolvFuture* f=queue.front();
+		queue.pop_front();
+		freePending();
+		finish(f,NSolv::ERROR);
+	}
+
+	//Deleting a SolverManager stops its solvers (one race at a time).
+	while(!running.empty())
+	{
+		Race* r=running.begin()->second;
+		r->manager->cancelRace();
+		if(!r->delivered)
+			finish(r->future,NSolv::ERROR);
+		running.erase(running.begin());
+		delete r->manager;
+		delete r;
+	}
+}
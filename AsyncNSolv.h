@@ -0,0 +1,255 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef ASYNCNSOLV_H_
+#define ASYNCNSOLV_H_
+
+#include "NSolv.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <cstddef>
+#include <pthread.h>
+#include <time.h>
+
+class AsyncNSolv;
+class NSolvFuture;
+class SolverManager;
+class EventEngine;
+
+//Told when a query submitted to AsyncNSolv has its result.
+class NSolvCallback
+{
+	public:
+		virtual ~NSolvCallback() {}
+
+		/* Called on AsyncNSolv's thread as soon as "future" is finished. Every other
+		 * race waits until this returns so it must not block. It may submit() and
+		 * cancel() and release() the future.
+		 */
+		virtual void finished(NSolvFuture* future)=0;
+};
+
+/* The result of a query submitted to AsyncNSolv. It belongs to the caller and
+ * AsyncNSolv until both are done with it, so call release() instead of
+ * deleting it. It stays usable after the AsyncNSolv is gone.
+ */
+class NSolvFuture
+{
+	public:
+		//Wait until the result is known.
+		void wait();
+
+		//True once the result is known. Never blocks.
+		bool isFinished();
+
+		//These wait() first.
+		NSolv::Result getResult();
+
+		//The winner's output (starting with its answer) if the result is SAT or UNSAT.
+		const std::string& getOutput();
+
+		//The solver that won. Empty if there wasn't a winner.
+		const std::string& getWinner();
+
+		//Finish with CANCELLED as soon as we can (if it isn't already finished).
+		void cancel();
+
+		//Done with it. Nothing may be called afterwards.
+		void release();
+
+	private:
+		friend class AsyncNSolv;
+
+		NSolvFuture(AsyncNSolv* _owner, unsigned long _id, const char* _query, size_t length, NSolvCallback* _callback);
+		~NSolvFuture();
+
+		pthread_mutex_t lock;
+		pthread_cond_t finishedCondition;
+
+		//Cleared once finished so cancel() no longer reaches it.
+		AsyncNSolv* owner;
+		const unsigned long id;
+		unsigned int references;
+
+		//Only touched by AsyncNSolv's thread until the race starts
+		std::string query;
+		bool hasDeadline;
+		timespec deadline;
+		NSolvCallback* callback;
+
+		bool finished;
+		NSolv::Result result;
+		std::string output;
+		std::string winner;
+
+		//Not copyable because of the mutex
+		NSolvFuture(const NSolvFuture&);
+		NSolvFuture& operator=(const NSolvFuture&);
+};
+
+/* Runs many NSolv races at once on a single thread of its own, so one program
+ * can keep every core busy without a thread (or process) per query.
+ *
+ *	AsyncNSolv portfolio;
+ *	portfolio.addSolver("z3","-smt2 -in",true);
+ *	portfolio.addSolver("stp","--SMTLIB2");
+ *
+ *	NSolvFuture* f=portfolio.submit(query.data(),query.size(),10);
+ *	...
+ *	if(f->getResult() == NSolv::SAT)
+ *		...
+ *	f->release();
+ *
+ * The thread waits for the solvers of every race (and for submit() and
+ * cancel()) with one epoll. Each race is a SolverManager (see
+ * SolverManager::startRace()) so it behaves like NSolv::solve().
+ *
+ * A race only starts if its solvers fit in setMaxProcesses() with those of
+ * the races already running. The others wait in order of submission and
+ * submit() itself waits while setMaxPending() are waiting.
+ *
+ * Configure it (addSolver() and the setters) before the first submit().
+ */
+class AsyncNSolv
+{
+	public:
+		AsyncNSolv();
+
+		//Cancels everything that hasn't finished and waits for the solvers to be reaped.
+		~AsyncNSolv();
+
+		//False if the thread couldn't be started. Every query is then an ERROR.
+		bool isValid() const;
+
+		//As NSolv
+		void addSolver(const std::string& name, const std::string& options="", bool inputOnStdin=false, unsigned int tier=0);
+		void setTimeout(double seconds);
+		void setTierDelay(double seconds); //1 second by default, as NSolv
+		void setKillGrace(double seconds);
+		void setLoggingPath(const std::string& path);
+		void setFastSpawn(bool fast);
+		void setVerbose(bool _verbose);
+
+		/* How many solver processes may run at once (the number of CPUs by default).
+		 * A race counts all of its solvers until they have been reaped. A race that
+		 * doesn't fit on its own still runs once nothing else is running.
+		 */
+		void setMaxProcesses(unsigned int n);
+
+		//How many queries may wait to start before submit() waits too. 0 (the default) means any number.
+		void setMaxPending(unsigned int n);
+
+		/* Race the solvers on a copy of the "length" bytes of SMT-LIBv2 at "query".
+		 * The result is TIMEOUT if it isn't known "timeout" seconds from now (0 for
+		 * setTimeout()), however long it waited to start. "callback" (may be NULL)
+		 * is told once it is finished.
+		 *
+		 * "timeout" has no default here so that submit("...",10) can't mean a length of 10.
+		 */
+		NSolvFuture* submit(const char* query, size_t length, double timeout, NSolvCallback* callback=NULL);
+		NSolvFuture* submit(const std::string& query, double timeout=0, NSolvCallback* callback=NULL);
+
+		//Cancel every query that hasn't finished.
+		void cancelAll();
+
+	private:
+		friend class NSolvFuture;
+
+		struct SolverEntry
+		{
+			std::string name;
+			std::string options;
+			bool inputOnStdin;
+			unsigned int tier;
+		};
+
+		//A query whose solvers have been started
+		struct Race
+		{
+			unsigned long id;
+			NSolvFuture* future;
+			SolverManager* manager;
+			std::string output;
+			bool delivered;
+		};
+
+		std::vector<SolverEntry> solvers;
+		double timeout;
+		double tierDelay;
+		double killGrace;
+		std::string loggingPath;
+		bool fastSpawn;
+		bool verbose;
+		unsigned int maxProcesses;
+		unsigned int maxPending;
+
+		bool valid; //Guarded by "lock" once the thread is running
+		bool threadStarted;
+		pthread_t thread;
+
+		//Guards what other threads hand over to the thread below
+		pthread_mutex_t lock;
+		pthread_cond_t spaceCondition; //Signalled when a query leaves "pending"
+		std::vector<NSolvFuture*> submitted;
+		std::vector<unsigned long> cancelRequests;
+		bool cancelEverything;
+		bool shuttingDown;
+		unsigned long nextId;
+		unsigned int pending; //Submitted but not started
+
+		//Writing to [1] wakes the thread up
+		int wakeup[2];
+
+		//Only used by the thread
+		EventEngine* events;
+		std::list<NSolvFuture*> queue;
+		std::map<unsigned long,Race*> running;
+		unsigned int liveProcesses;
+
+		static void* threadEntry(void* arg);
+		void run();
+		void wake();
+
+		//Called by NSolvFuture::cancel()
+		void requestCancel(unsigned long id);
+
+		//Start as many queued queries as fit and finish those that ran out of time.
+		void startQueued();
+		void start(NSolvFuture* f);
+		void cancel(unsigned long id);
+
+		//Carry on with "r" and deliver its result once it is decided. Forgets it once finished.
+		void advance(Race* r);
+
+		//Hand the result to the caller and the callback and drop our reference.
+		void finish(NSolvFuture* f, NSolv::Result result);
+
+		//A query has left "queue" (or "submitted") so submit() may carry on.
+		void freePending();
+
+		//epoll failed so nothing can be waited for. Finish everything with ERROR.
+		void abandon();
+
+		//Not copyable because we own the thread
+		AsyncNSolv(const AsyncNSolv&);
+		AsyncNSolv& operator=(const AsyncNSolv&);
+};
+
+#endif /* ASYNCNSOLV_H_ */
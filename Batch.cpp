@@ -0,0 +1,410 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Batch.h"
+#include "Protocol.h"
+#include "SolverManager.h"
+#include "global.h"
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+//Exit codes of a race process
+static const int RACE_ANSWERED=0;
+static const int RACE_FAILED=1;
+static const int RACE_TIMEOUT=2;
+
+//Set by the signal handler when we have been asked to stop.
+static volatile sig_atomic_t stopRequested=0;
+
+//The signal handlers that were in place before the batch started. Restored in the races.
+static struct sigaction previousTerm, previousQuit, previousInt;
+
+static void handleStop(int /*signum*/)
+{
+	stopRequested=1;
+}
+
+Batch::Batch(const Portfolio& _portfolio, unsigned int _jobs, bool _ordered) :
+portfolio(_portfolio), jobs(_jobs > 0? _jobs : 1), ordered(_ordered), queries(), running(),
+events(), slotInUse(), results(), finished(), nextToPrint(0), summary()
+{
+
+}
+
+unsigned int Batch::defaultJobs(const Portfolio& portfolio)
+{
+	long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	size_t solvers=portfolio.getNumberOfRacingSolvers();
+
+	//Every race runs all the solvers at once.
+	if(cpus <= 0 || solvers == 0 || static_cast<size_t>(cpus) <= solvers)
+		return 1;
+
+	return cpus / solvers;
+}
+
+bool Batch::run(const std::string& corpus)
+{
+	if(portfolio.getNumberOfSolvers() == 0)
+	{
+		cerr << "Batch: There are no solvers to invoke." << endl;
+		return false;
+	}
+
+	if(!events.isValid())
+		return false;
+
+	if(!collectQueries(corpus))
+		return false;
+
+	if(verbose) cerr << "Batch: Solving " << queries.size() << " queries with " << jobs << " race(s) at a time." << endl;
+
+	results.assign(queries.size(),"");
+	finished.assign(queries.size(),false);
+	nextToPrint=0;
+	slotInUse.assign(jobs,false);
+
+	installSignalHandlers();
+
+	size_t nextQuery=0;
+	bool success=true;
+
+	while(!stopRequested && (nextQuery < queries.size() || !running.empty()))
+	{
+		//Keep "jobs" races in flight
+		while(running.size() < jobs && nextQuery < queries.size())
+		{
+			if(!startRace(nextQuery))
+			{
+				success=false;
+				stopRequested=1;
+				break;
+			}
+			nextQuery++;
+		}
+
+		if(running.empty())
+			break;
+
+		vector<EventEngine::Event> ready;
+		if(events.wait(ready) == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			perror("Batch: Something went wrong waiting for races via epoll_wait()");
+			success=false;
+			break;
+		}
+
+		for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+		{
+			map<int,Race>::iterator r=running.find(e->fd);
+			if(e->type != EventEngine::READABLE || r == running.end())
+				continue;
+
+			finishRace(r->second);
+			running.erase(r);
+		}
+	}
+
+	if(stopRequested)
+	{
+		cerr << "Batch: Stopping with " << running.size() << " race(s) running and " <<
+				(queries.size() - nextQuery) << " queries not started." << endl;
+		stopRaces();
+		success=false;
+	}
+
+	restoreSignalHandlers();
+
+	cerr << "Batch: " << nextToPrint << " of " << queries.size() << " queries finished:";
+	for(map<string,size_t>::const_iterator i=summary.begin(); i != summary.end(); ++i)
+		cerr << " " << i->first << "=" << i->second;
+	cerr << endl;
+
+	return success;
+}
+
+bool Batch::collectQueries(const std::string& corpus)
+{
+	namespace fs = boost::filesystem;
+
+	try
+	{
+		fs::path root(corpus);
+		if(fs::is_directory(root))
+		{
+			for(fs::recursive_directory_iterator i(root), end; i != end; ++i)
+			{
+				if(fs::is_regular_file(i->status()) && i->path().extension() == ".smt2")
+					queries.push_back(i->path().string());
+			}
+
+			//Directory order is arbitrary so sort to make runs repeatable.
+			sort(queries.begin(),queries.end());
+		}
+		else if(fs::is_regular_file(root))
+		{
+			if(!readManifest(corpus))
+				return false;
+		}
+		else
+		{
+			cerr << "Batch: " << corpus << " is not a directory or a manifest." << endl;
+			return false;
+		}
+	}
+	catch(fs::filesystem_error& e)
+	{
+		cerr << "Batch: " << e.what() << endl;
+		return false;
+	}
+
+	if(queries.empty())
+	{
+		cerr << "Batch: No queries found in " << corpus << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool Batch::readManifest(const std::string& manifest)
+{
+	ifstream m(manifest.c_str());
+	if(!m.good())
+	{
+		cerr << "Batch: Couldn't open manifest " << manifest << endl;
+		return false;
+	}
+
+	//Relative paths are relative to the manifest
+	boost::filesystem::path base=boost::filesystem::path(manifest).parent_path();
+
+	string line;
+	while(getline(m,line))
+	{
+		//Trim whitespace
+		size_t first=line.find_first_not_of(" \t\r");
+		if(first == string::npos)
+			continue;
+		size_t last=line.find_last_not_of(" \t\r");
+		line=line.substr(first,last - first +1);
+
+		if(line[0] == '#')
+			continue;
+
+		boost::filesystem::path query(line);
+		if(query.is_relative())
+			query=base / query;
+
+		queries.push_back(query.string());
+	}
+
+	return true;
+}
+
+bool Batch::startRace(size_t query)
+{
+	int fd[2];
+	if(pipe2(fd,O_CLOEXEC) != 0)
+	{
+		perror("Batch: Failed to create pipe");
+		return false;
+	}
+
+	Race r;
+	r.query=query;
+	r.fd=fd[0];
+	r.slot=find(slotInUse.begin(),slotInUse.end(),false) - slotInUse.begin();
+	clock_gettime(CLOCK_MONOTONIC,&(r.startTime));
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid=fork();
+
+	if(pid < 0)
+	{
+		perror("Batch: Failed to fork");
+		close(fd[0]);
+		close(fd[1]);
+		return false;
+	}
+
+	if(pid == 0)
+	{
+		//In child
+		close(fd[0]);
+		runRace(queries[query],r.slot,fd[1]);
+	}
+
+	//parent code
+	close(fd[1]);
+	r.pid=pid;
+	slotInUse[r.slot]=true;
+	running.insert(make_pair(r.fd,r));
+	events.watchReadable(r.fd,NULL);
+
+	if(verbose) cerr << "Batch: Started race for " << queries[query] << " with PID:" << pid << endl;
+	return true;
+}
+
+void Batch::runRace(const std::string& inputFile, unsigned int slot, int outputFd)
+{
+	//We are now a stand alone NSolv process.
+	nsolvProcess=getpid();
+	restoreSignalHandlers();
+
+	for(map<int,Race>::const_iterator r=running.begin(); r != running.end(); ++r)
+		close(r->first);
+
+	int status=RACE_FAILED;
+	string answer;
+
+	struct stat info;
+	if(stat(inputFile.c_str(),&info) != 0 || !S_ISREG(info.st_mode))
+		cerr << "Error: Input SMTLIBv2 file (" << inputFile << ") does not exist or is not a regular file." << endl;
+	else
+	{
+		//Only the answer is reported. The output is collected so that it doesn't go to stdout.
+		string output;
+		sm=portfolio.createSolverManager(inputFile,slot);
+		if(sm->invokeSolvers(output))
+		{
+			status=RACE_ANSWERED;
+			answer=Solver::resultToString(sm->getResult());
+		}
+		else if(sm->hasTimedOut())
+			status=RACE_TIMEOUT;
+
+		delete sm;
+		sm=NULL;
+	}
+
+	//The result the race decided on rather than the winner's output, which may not start with it.
+	Protocol::writeFrame(outputFd, status == RACE_ANSWERED? Protocol::RESPONSE_ANSWER : Protocol::RESPONSE_NO_ANSWER,answer);
+	close(outputFd);
+	exit(status);
+}
+
+void Batch::finishRace(Race& r)
+{
+	/* The race writes its frame in one go once it has finished so this
+	 * won't block for long.
+	 */
+	uint32_t type=0;
+	string decided;
+	bool gotFrame=Protocol::readFrame(r.fd,type,decided);
+	events.unwatchReadable(r.fd);
+	close(r.fd);
+
+	int status=0;
+	while(waitpid(r.pid,&status,0) == -1 && errno == EINTR);
+	slotInUse[r.slot]=false;
+
+	timespec current;
+	clock_gettime(CLOCK_MONOTONIC,&current);
+	double elapsed=toDouble(subtract(current,r.startTime));
+
+	string answer="error";
+	if(gotFrame && type == Protocol::RESPONSE_ANSWER && !decided.empty())
+		answer=decided;
+	else if(WIFEXITED(status) && WEXITSTATUS(status) == RACE_TIMEOUT)
+		answer="timeout";
+
+	summary[answer]++;
+
+	stringstream line;
+	line.setf(ios::fixed,ios::floatfield);
+	line.precision(3);
+	line << answer << " " << elapsed << " " << queries[r.query];
+	report(r.query,line.str());
+}
+
+void Batch::report(size_t query, const std::string& line)
+{
+	if(!ordered)
+	{
+		cout << line << endl;
+		nextToPrint++;
+		return;
+	}
+
+	results[query]=line;
+	finished[query]=true;
+
+	//Print everything that is now in order
+	while(nextToPrint < queries.size() && finished[nextToPrint])
+	{
+		cout << results[nextToPrint] << endl;
+		results[nextToPrint].clear();
+		nextToPrint++;
+	}
+}
+
+void Batch::installSignalHandlers()
+{
+	struct sigaction act;
+	memset(&act,0,sizeof(act));
+
+	//We deliberately don't use SA_RESTART so that epoll_wait() is interrupted.
+	act.sa_handler=handleStop;
+	if(sigaction(SIGTERM,&act,&previousTerm) == -1) cerr << "Couldn't setup handler for SIGTERM" << endl;
+	if(sigaction(SIGQUIT,&act,&previousQuit) == -1) cerr << "Couldn't setup handler for SIGQUIT" << endl;
+	if(sigaction(SIGINT,&act,&previousInt) == -1) cerr << "Couldn't setup handler for SIGINT" << endl;
+}
+
+void Batch::restoreSignalHandlers()
+{
+	sigaction(SIGTERM,&previousTerm,NULL);
+	sigaction(SIGQUIT,&previousQuit,NULL);
+	sigaction(SIGINT,&previousInt,NULL);
+}
+
+void Batch::stopRaces()
+{
+	//Each race kills its own solvers when it gets SIGTERM (see handleExit()).
+	for(map<int,Race>::const_iterator r=running.begin(); r != running.end(); ++r)
+	{
+		if(verbose) cerr << "Batch: Stopping race with PID:" << r->second.pid << endl;
+		kill(r->second.pid,SIGTERM);
+	}
+
+	for(map<int,Race>::const_iterator r=running.begin(); r != running.end(); ++r)
+	{
+		waitpid(r->second.pid,NULL,0);
+		events.unwatchReadable(r->first);
+		close(r->first);
+	}
+
+	running.clear();
+}
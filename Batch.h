@@ -0,0 +1,111 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unistd.h>
+#include <time.h>
+#include "Portfolio.h"
+#include "EventEngine.h"
+
+/* Solves a corpus of queries (every .smt2 file under a directory or the
+ * files listed in a manifest) with a bounded number of races in flight.
+ *
+ * Each race runs in its own forked process (like the daemon's handlers)
+ * with a SolverManager created from the already parsed Portfolio. The
+ * winning solver's output comes back on a pipe as a single frame (see
+ * Protocol). One line is printed on standard output for each query as it
+ * finishes
+ *
+ * <answer> <seconds> <query>
+ *
+ * where <answer> is sat, unsat, timeout or error. Results are printed in
+ * the order the races finish or, if requested, in the order of the corpus.
+ */
+class Batch
+{
+	public:
+		//"_jobs" is the number of races in flight. "_ordered" prints results in corpus order.
+		Batch(const Portfolio& _portfolio, unsigned int _jobs, bool _ordered);
+
+		//Solve every query in "corpus" (a directory or a manifest). Returns false on failure.
+		bool run(const std::string& corpus);
+
+		/* The number of races that keeps the number of running solver processes close
+		 * to the number of CPUs.
+		 */
+		static unsigned int defaultJobs(const Portfolio& portfolio);
+
+	private:
+		struct Race
+		{
+			size_t query;
+			pid_t pid;
+			int fd; //read end of the pipe carrying the answer the race decided on
+			unsigned int slot; //see Portfolio::createSolverManager()
+			timespec startTime;
+		};
+
+		const Portfolio& portfolio;
+		unsigned int jobs;
+		bool ordered;
+
+		std::vector<std::string> queries;
+
+		//fd -> race
+		std::map<int,Race> running;
+
+		//Waits for the pipes in "running"
+		EventEngine events;
+
+		//Slots (0 to jobs -1) used by running races so concurrent races are pinned to different CPUs.
+		std::vector<bool> slotInUse;
+
+		//Corpus order only. Lines of finished queries waiting for earlier ones.
+		std::vector<std::string> results;
+		std::vector<bool> finished;
+		size_t nextToPrint;
+
+		//answer -> number of queries
+		std::map<std::string,size_t> summary;
+
+		//Fill "queries" from a directory or manifest. Returns false on failure.
+		bool collectQueries(const std::string& corpus);
+		bool readManifest(const std::string& manifest);
+
+		bool startRace(size_t query);
+
+		//Collect the result of a race whose pipe is readable.
+		void finishRace(Race& r);
+
+		//Runs in the forked child. Never returns.
+		void runRace(const std::string& inputFile, unsigned int slot, int outputFd);
+
+		void report(size_t query, const std::string& line);
+
+		void installSignalHandlers();
+		void restoreSignalHandlers();
+
+		void stopRaces();
+};
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,279 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "CpuTopology.h"
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <sched.h>
+
+using namespace std;
+
+//Take one element from each list in turn until they are all empty.
+template<typename T> static void interleave(const vector< vector<T> >& lists, vector<T>& out)
+{
+	for(size_t index=0; ; ++index)
+	{
+		bool added=false;
+		for(typename vector< vector<T> >::const_iterator l=lists.begin(); l != lists.end(); ++l)
+		{
+			if(index < l->size())
+			{
+				out.push_back((*l)[index]);
+				added=true;
+			}
+		}
+
+		if(!added)
+			return;
+	}
+}
+
+CpuTopology::CpuTopology(const std::string& sysfsRoot, bool _verbose) :
+root(sysfsRoot), cpus(), verbose(_verbose)
+{
+	if(!load())
+	{
+		if(verbose) cerr << "CpuTopology: Couldn't read the CPU topology from " << root << endl;
+		cpus.clear();
+	}
+}
+
+bool CpuTopology::isValid() const
+{
+	return !cpus.empty();
+}
+
+const std::vector<CpuTopology::Cpu>& CpuTopology::getCpus() const
+{
+	return cpus;
+}
+
+int CpuTopology::getNode(int cpu) const
+{
+	for(vector<Cpu>::const_iterator c=cpus.begin(); c != cpus.end(); ++c)
+	{
+		if(c->id == cpu)
+			return c->node;
+	}
+
+	return -1;
+}
+
+bool CpuTopology::load()
+{
+	ifstream f((root + "/online").c_str());
+	string online;
+	if(!getline(f,online))
+		return false;
+
+	vector<int> ids;
+	if(!parseCpuList(online,ids))
+		return false;
+
+	//Respect taskset, cgroups, etc.
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool haveMask= sched_getaffinity(0,sizeof(allowed),&allowed) == 0;
+
+	for(vector<int>::const_iterator i=ids.begin(); i != ids.end(); ++i)
+	{
+		if(haveMask && *i < CPU_SETSIZE && !CPU_ISSET(*i,&allowed))
+			continue;
+
+		stringstream topology;
+		topology << root << "/cpu" << *i << "/topology/";
+
+		Cpu c;
+		c.id=*i;
+		if(!readInt(topology.str() + "physical_package_id",c.package) ||
+		   !readInt(topology.str() + "core_id",c.core))
+			return false;
+
+		c.l2=readCacheDomain(*i,2);
+		c.l3=readCacheDomain(*i,3);
+		c.node=readNode(*i);
+		cpus.push_back(c);
+	}
+
+	return !cpus.empty();
+}
+
+bool CpuTopology::readInt(const std::string& path, int& value) const
+{
+	ifstream f(path.c_str());
+	f >> value;
+	return !f.fail();
+}
+
+int CpuTopology::readCacheDomain(int cpu, int level) const
+{
+	for(int index=0; ; ++index)
+	{
+		stringstream cache;
+		cache << root << "/cpu" << cpu << "/cache/index" << index << "/";
+
+		int l=0;
+		if(!readInt(cache.str() + "level",l))
+			return -1;
+
+		if(l != level)
+			continue;
+
+		//Skip the instruction cache
+		ifstream type((cache.str() + "type").c_str());
+		string t;
+		if((type >> t) && t == "Instruction")
+			continue;
+
+		ifstream shared((cache.str() + "shared_cpu_list").c_str());
+		string list;
+		vector<int> sharing;
+		if(!getline(shared,list) || !parseCpuList(list,sharing) || sharing.empty())
+			return -1;
+
+		return *min_element(sharing.begin(),sharing.end());
+	}
+}
+
+int CpuTopology::readNode(int cpu) const
+{
+	namespace fs = boost::filesystem;
+
+	//The CPU's directory has a "node<N>" link to its node
+	stringstream dir;
+	dir << root << "/cpu" << cpu;
+
+	try
+	{
+		for(fs::directory_iterator i(dir.str()), end; i != end; ++i)
+		{
+			string name=i->path().filename().string();
+			if(name.compare(0,4,"node") == 0 && name.size() > 4 && name.find_first_not_of("0123456789",4) == string::npos)
+				return atoi(name.c_str() +4);
+		}
+	}
+	catch(fs::filesystem_error& e)
+	{
+		if(verbose) cerr << "CpuTopology: " << e.what() << endl;
+	}
+
+	return -1;
+}
+
+void CpuTopology::getPlacementOrder(std::vector<int>& order) const
+{
+	order.clear();
+
+	//(package, core) -> SMT threads of that core
+	map< pair<int,int>, vector<int> > threads;
+
+	//L3 domain -> L2 domain -> cores (as the key of "threads")
+	map< int, map< int, vector< pair<int,int> > > > domains;
+
+	for(vector<Cpu>::const_iterator c=cpus.begin(); c != cpus.end(); ++c)
+	{
+		pair<int,int> core(c->package,c->core);
+		vector<int>& t=threads[core];
+		if(t.empty())
+		{
+			//Without an L3 the package is the next best thing to spread over.
+			int l3= c->l3 != -1? c->l3 : -2 - c->package;
+			domains[l3][c->l2].push_back(core);
+		}
+		t.push_back(c->id);
+	}
+
+	//Spread the cores over L2 domains within each L3 domain and then over the L3 domains.
+	vector< vector< pair<int,int> > > perL3;
+	for(map< int, map< int, vector< pair<int,int> > > >::const_iterator l3=domains.begin(); l3 != domains.end(); ++l3)
+	{
+		vector< vector< pair<int,int> > > perL2;
+		for(map< int, vector< pair<int,int> > >::const_iterator l2=l3->second.begin(); l2 != l3->second.end(); ++l2)
+			perL2.push_back(l2->second);
+
+		perL3.push_back(vector< pair<int,int> >());
+		interleave(perL2,perL3.back());
+	}
+
+	vector< pair<int,int> > cores;
+	interleave(perL3,cores);
+
+	//First thread of every core, then the second, ...
+	vector< vector<int> > perCore;
+	for(vector< pair<int,int> >::const_iterator core=cores.begin(); core != cores.end(); ++core)
+	{
+		vector<int> t=threads[*core];
+		sort(t.begin(),t.end());
+		perCore.push_back(t);
+	}
+
+	interleave(perCore,order);
+}
+
+bool CpuTopology::parseCpuList(const std::string& list, std::vector<int>& cpus)
+{
+	stringstream s(list);
+	string range;
+	while(getline(s,range,','))
+	{
+		//Allow spaces around the ranges
+		size_t first=range.find_first_not_of(" \t\n");
+		if(first == string::npos)
+			continue;
+		range=range.substr(first,range.find_last_not_of(" \t\n") - first +1);
+
+		char* end=NULL;
+		long low=strtol(range.c_str(),&end,10);
+		long high=low;
+		if(end == range.c_str() || low < 0)
+			return false;
+
+		if(*end == '-')
+		{
+			const char* start=end +1;
+			high=strtol(start,&end,10);
+			if(end == start || high < low)
+				return false;
+		}
+
+		if(*end != '\0')
+			return false;
+
+		for(long cpu=low; cpu <= high; ++cpu)
+			cpus.push_back(cpu);
+	}
+
+	return true;
+}
+
+std::string CpuTopology::toString(const std::vector<int>& cpus)
+{
+	stringstream s;
+	for(vector<int>::const_iterator c=cpus.begin(); c != cpus.end(); ++c)
+	{
+		if(c != cpus.begin()) s << ",";
+		s << *c;
+	}
+
+	return s.str();
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef CPUTOPOLOGY_H_
+#define CPUTOPOLOGY_H_
+
+#include <string>
+#include <vector>
+
+/* The CPUs we are allowed to run on and how they are laid out (SMT
+ * siblings, shared caches, sockets and NUMA nodes) as described by
+ * sysfs (/sys/devices/system/cpu).
+ *
+ * This is used to place solvers so that two of them never share a
+ * physical core (or a cache) when that can be avoided.
+ */
+class CpuTopology
+{
+	public:
+		struct Cpu
+		{
+			int id;
+			int package;
+			int core; //core_id is only unique within a package
+			int l2; //Lowest CPU sharing our L2 cache (-1 if unknown)
+			int l3; //Lowest CPU sharing our L3 cache (-1 if unknown)
+			int node; //NUMA node (-1 if unknown)
+		};
+
+		//Reads the topology of the CPUs in our affinity mask from "sysfsRoot". "_verbose" reports problems on stderr.
+		CpuTopology(const std::string& sysfsRoot="/sys/devices/system/cpu", bool _verbose=false);
+
+		//False if the topology couldn't be read. getCpus() is empty then.
+		bool isValid() const;
+
+		const std::vector<Cpu>& getCpus() const;
+
+		//Returns -1 if "cpu" is unknown.
+		int getNode(int cpu) const;
+
+		/* The order in which CPUs should be handed out to solvers. The first
+		 * thread of every physical core comes first, spread across L3 (and then L2)
+		 * domains so consecutive CPUs don't share a cache. SMT siblings come last.
+		 */
+		void getPlacementOrder(std::vector<int>& order) const;
+
+		//Parse a Linux CPU list (e.g. "0-3,8,10-11"). Returns false if it is malformed.
+		static bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+
+		//The inverse of parseCpuList() (without ranges).
+		static std::string toString(const std::vector<int>& cpus);
+
+	private:
+		std::string root;
+		std::vector<Cpu> cpus;
+		bool verbose;
+
+		bool load();
+		bool readInt(const std::string& path, int& value) const;
+
+		//Lowest CPU in the shared_cpu_list of the cache at "level" of "cpu" or -1.
+		int readCacheDomain(int cpu, int level) const;
+
+		int readNode(int cpu) const;
+};
+
+#endif /* CPUTOPOLOGY_H_ */
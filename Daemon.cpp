@@ -0,0 +1,356 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Daemon.h"
+#include "Protocol.h"
+#include "SolverManager.h"
+#include "global.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+//Set by the signal handler when the daemon has been asked to stop.
+static volatile sig_atomic_t stopRequested=0;
+
+//The signal handlers that were in place before the daemon started. Restored in the handlers.
+static struct sigaction previousTerm, previousQuit, previousInt, previousChld;
+
+static void handleStop(int /*signum*/)
+{
+	stopRequested=1;
+}
+
+static void handleChild(int /*signum*/)
+{
+	//Nothing to do. This is only here to interrupt accept() so that we reap handlers.
+}
+
+Daemon::Daemon(const std::string& _socketPath, const Portfolio& _portfolio) :
+socketPath(_socketPath), portfolio(_portfolio), listenFd(-1), handlers()
+{
+
+}
+
+Daemon::~Daemon()
+{
+	if(listenFd != -1)
+	{
+		close(listenFd);
+
+		if(unlink(socketPath.c_str()) != 0)
+			perror("Daemon: Failed to remove socket");
+		else
+			if(verbose) cerr << "Daemon: Removed socket " << socketPath << endl;
+	}
+}
+
+bool Daemon::run()
+{
+	if(portfolio.getNumberOfSolvers() == 0)
+	{
+		cerr << "Daemon: There are no solvers to invoke." << endl;
+		return false;
+	}
+
+	if(!setupSocket())
+		return false;
+
+	installSignalHandlers();
+
+	if(verbose) cerr << "Daemon: Listening on " << socketPath << endl;
+
+	if(portfolio.isPoolMode())
+		superviseWorkers();
+	else
+		acceptClients();
+
+	if(verbose) cerr << "Daemon: Stopping..." << endl;
+
+	stopHandlers();
+	return true;
+}
+
+void Daemon::acceptClients()
+{
+	while(!stopRequested)
+	{
+		int clientFd= accept4(listenFd,NULL,NULL,SOCK_CLOEXEC);
+
+		if(clientFd == -1)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+			{
+				reapHandlers();
+				continue;
+			}
+
+			perror("Daemon: accept failed");
+			break;
+		}
+
+		reapHandlers();
+
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid=fork();
+
+		if(pid < 0)
+		{
+			perror("Daemon: Failed to fork");
+			close(clientFd);
+			continue;
+		}
+
+		if(pid == 0)
+		{
+			//In child
+			becomeHandler();
+			close(listenFd);
+			listenFd=-1;
+
+			serveConnection(clientFd,NULL);
+			exit(0);
+		}
+
+		//parent code
+		handlers.insert(pid);
+		close(clientFd);
+
+		if(verbose) cerr << "Daemon: Serving client with PID:" << pid << " (" << handlers.size() << " active)" << endl;
+	}
+}
+
+void Daemon::superviseWorkers()
+{
+	while(!stopRequested)
+	{
+		//Start workers until we have enough. This also replaces workers that died.
+		while(handlers.size() < portfolio.getPoolWorkers())
+		{
+			fflush(stdout);
+			fflush(stderr);
+			pid_t pid=fork();
+
+			if(pid < 0)
+			{
+				perror("Daemon: Failed to fork");
+				return;
+			}
+
+			if(pid == 0)
+				runWorker();
+
+			handlers.insert(pid);
+			if(verbose) cerr << "Daemon: Started worker with PID:" << pid << endl;
+		}
+
+		//Wait for a worker to die or a signal asking us to stop.
+		pid_t pid=waitpid(-1,NULL,0);
+		if(pid > 0)
+		{
+			handlers.erase(pid);
+			if(!stopRequested) cerr << "Daemon: Worker with PID:" << pid << " died. Replacing it." << endl;
+		}
+	}
+}
+
+void Daemon::becomeHandler()
+{
+	//We are now a stand alone NSolv process.
+	nsolvProcess=getpid();
+	handlers.clear();
+
+	sigaction(SIGTERM,&previousTerm,NULL);
+	sigaction(SIGQUIT,&previousQuit,NULL);
+	sigaction(SIGINT,&previousInt,NULL);
+	sigaction(SIGCHLD,&previousChld,NULL);
+}
+
+void Daemon::runWorker()
+{
+	becomeHandler();
+
+	SolverPool pool(portfolio);
+
+	while(true)
+	{
+		int clientFd= accept4(listenFd,NULL,NULL,SOCK_CLOEXEC);
+
+		if(clientFd == -1)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			perror("Daemon: accept failed");
+			exit(1);
+		}
+
+		serveConnection(clientFd,&pool);
+	}
+}
+
+bool Daemon::setupSocket()
+{
+	struct sockaddr_un address;
+	memset(&address,0,sizeof(address));
+	address.sun_family=AF_UNIX;
+
+	if(socketPath.length() >= sizeof(address.sun_path))
+	{
+		cerr << "Daemon: Socket path " << socketPath << " is too long." << endl;
+		return false;
+	}
+
+	strncpy(address.sun_path,socketPath.c_str(),sizeof(address.sun_path) -1);
+
+	//Remove a stale socket left behind by a previous daemon. We refuse to remove anything else.
+	struct stat info;
+	if(lstat(socketPath.c_str(),&info) == 0)
+	{
+		if(!S_ISSOCK(info.st_mode))
+		{
+			cerr << "Daemon: " << socketPath << " exists and is not a socket." << endl;
+			return false;
+		}
+
+		unlink(socketPath.c_str());
+	}
+
+	int fd=socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd == -1)
+	{
+		perror("Daemon: Failed to create socket");
+		return false;
+	}
+
+	if(bind(fd,reinterpret_cast<struct sockaddr*>(&address),sizeof(address)) != 0)
+	{
+		perror("Daemon: Failed to bind socket");
+		close(fd);
+		return false;
+	}
+
+	if(listen(fd,SOMAXCONN) != 0)
+	{
+		perror("Daemon: Failed to listen on socket");
+		close(fd);
+		unlink(socketPath.c_str());
+		return false;
+	}
+
+	listenFd=fd;
+	return true;
+}
+
+void Daemon::installSignalHandlers()
+{
+	struct sigaction act;
+	memset(&act,0,sizeof(act));
+
+	//We deliberately don't use SA_RESTART so that accept() is interrupted.
+	act.sa_handler=handleStop;
+	if(sigaction(SIGTERM,&act,&previousTerm) == -1) cerr << "Couldn't setup handler for SIGTERM" << endl;
+	if(sigaction(SIGQUIT,&act,&previousQuit) == -1) cerr << "Couldn't setup handler for SIGQUIT" << endl;
+	if(sigaction(SIGINT,&act,&previousInt) == -1) cerr << "Couldn't setup handler for SIGINT" << endl;
+
+	act.sa_handler=handleChild;
+	if(sigaction(SIGCHLD,&act,&previousChld) == -1) cerr << "Couldn't setup handler for SIGCHLD" << endl;
+}
+
+void Daemon::serveConnection(int clientFd, SolverPool* pool)
+{
+	uint32_t type=0;
+	string payload;
+
+	//Anything but a path is a bad frame (which mustn't make us allocate up to MAX_PAYLOAD_SIZE).
+	while(Protocol::readFrame(clientFd,type,payload,Protocol::MAX_REQUEST_SIZE))
+	{
+		if(type != Protocol::REQUEST_SOLVE)
+		{
+			cerr << "Daemon: Received unknown request type " << type << endl;
+			break;
+		}
+
+		if(!serveRequest(clientFd,payload,pool))
+			break;
+	}
+
+	if(verbose) cerr << "Daemon: Client of (" << getpid() << ") disconnected." << endl;
+
+	close(clientFd);
+}
+
+bool Daemon::serveRequest(int clientFd, const std::string& inputFile, SolverPool* pool)
+{
+	struct stat info;
+	if(stat(inputFile.c_str(),&info) != 0 || !S_ISREG(info.st_mode))
+	{
+		cerr << "Error: Input SMTLIBv2 file (" << inputFile << ") does not exist or is not a regular file." << endl;
+		return Protocol::writeFrame(clientFd,Protocol::RESPONSE_NO_ANSWER,"");
+	}
+
+	if(verbose) cerr << "Daemon: Solving " << inputFile << endl;
+
+	string output;
+	bool answered=false;
+
+	if(pool != NULL)
+		answered=pool->invokeSolvers(inputFile,output);
+	else
+	{
+		sm=portfolio.createSolverManager(inputFile);
+		answered=sm->invokeSolvers(output);
+		delete sm;
+		sm=NULL;
+	}
+
+	if(answered)
+		return Protocol::writeFrame(clientFd,Protocol::RESPONSE_ANSWER,output);
+	else
+		return Protocol::writeFrame(clientFd,Protocol::RESPONSE_NO_ANSWER,"");
+}
+
+void Daemon::reapHandlers()
+{
+	pid_t pid=0;
+	while((pid = waitpid(-1,NULL,WNOHANG)) > 0)
+		handlers.erase(pid);
+}
+
+void Daemon::stopHandlers()
+{
+	for(set<pid_t>::const_iterator i=handlers.begin(); i != handlers.end(); ++i)
+	{
+		if(verbose) cerr << "Daemon: Stopping handler with PID:" << *i << endl;
+		kill(*i,SIGTERM);
+	}
+
+	for(set<pid_t>::const_iterator i=handlers.begin(); i != handlers.end(); ++i)
+		waitpid(*i,NULL,0);
+
+	handlers.clear();
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include <string>
+#include <set>
+#include <unistd.h>
+#include "Portfolio.h"
+#include "SolverPool.h"
+
+/* Serves queries over a Unix domain socket (see Protocol.h) so that
+ * the cost of starting NSolv and parsing its configuration is only paid once.
+ *
+ * Each client connection is served by its own forked process so many
+ * clients can be served at once. That process runs a race (like
+ * SolverManager::invokeSolvers()) for every request sent on the connection.
+ *
+ * In pool mode (see SolverPool) a fixed number of worker processes are
+ * started instead. Each worker owns a warm SolverPool and serves one
+ * connection at a time so its solvers are reused across connections.
+ */
+class Daemon
+{
+	public:
+		Daemon(const std::string& _socketPath, const Portfolio& _portfolio);
+		~Daemon();
+
+		//Serve clients until SIGTERM, SIGQUIT or SIGINT is received. Returns false on failure.
+		bool run();
+
+	private:
+		std::string socketPath;
+		const Portfolio& portfolio;
+		int listenFd;
+
+		//PIDs of the processes serving client connections
+		std::set<pid_t> handlers;
+
+		bool setupSocket();
+
+		void installSignalHandlers();
+
+		//Fork a process serving each connection
+		void acceptClients();
+
+		//Keep getPoolWorkers() worker processes running
+		void superviseWorkers();
+
+		//Only called in a newly forked child
+		void becomeHandler();
+
+		//Only called in a worker process. Never returns.
+		void runWorker();
+
+		//Serve requests on a connection until the client hangs up. "pool" may be NULL.
+		void serveConnection(int clientFd, SolverPool* pool);
+
+		//Handle a single request. Returns false if the connection should be closed.
+		bool serveRequest(int clientFd, const std::string& inputFile, SolverPool* pool);
+
+		//Reap handlers that have finished without blocking.
+		void reapHandlers();
+
+		//Ask all handlers to stop and wait for them.
+		void stopHandlers();
+};
+
+#endif /* DAEMON_H_ */
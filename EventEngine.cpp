@@ -0,0 +1,246 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "EventEngine.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+//Maximum number of events collected by one epoll_wait()
+static const int MAX_EVENTS=64;
+
+static int openPidFd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open,pid,0);
+#else
+	errno=ENOSYS;
+	return -1;
+#endif
+}
+
+EventEngine::EventEngine() :
+epollFd(-1), timerFd(-1), watches(), pidToFd()
+{
+	epollFd=epoll_create1(EPOLL_CLOEXEC);
+	if(epollFd == -1)
+	{
+		perror("EventEngine: epoll_create1");
+		return;
+	}
+
+	timerFd=timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC | TFD_NONBLOCK);
+	if(timerFd == -1)
+	{
+		perror("EventEngine: timerfd_create");
+		return;
+	}
+
+	if(!add(timerFd,TIMER,NULL,0))
+	{
+		close(timerFd);
+		timerFd=-1;
+	}
+}
+
+EventEngine::~EventEngine()
+{
+	for(map<int,Watch*>::iterator w=watches.begin(); w != watches.end(); ++w)
+	{
+		//Process and timer descriptors are ours, readable and writable ones belong to the caller.
+		if(w->second->type != READABLE && w->second->type != WRITABLE)
+			close(w->first);
+		delete w->second;
+	}
+
+	if(epollFd != -1)
+		close(epollFd);
+}
+
+bool EventEngine::isValid() const
+{
+	return epollFd != -1 && timerFd != -1;
+}
+
+bool EventEngine::add(int fd, EventType type, void* data, pid_t pid)
+{
+	Watch* w=new Watch;
+	w->type=type;
+	w->data=data;
+	w->fd=fd;
+	w->pid=pid;
+
+	struct epoll_event e;
+	memset(&e,0,sizeof(e));
+	e.events= type == WRITABLE? EPOLLOUT : EPOLLIN;
+	e.data.ptr=w;
+
+	if(epoll_ctl(epollFd,EPOLL_CTL_ADD,fd,&e) == -1)
+	{
+		perror("EventEngine: epoll_ctl");
+		delete w;
+		return false;
+	}
+
+	watches[fd]=w;
+	return true;
+}
+
+void EventEngine::remove(int fd)
+{
+	map<int,Watch*>::iterator w=watches.find(fd);
+	if(w == watches.end())
+		return;
+
+	epoll_ctl(epollFd,EPOLL_CTL_DEL,fd,NULL);
+	delete w->second;
+	watches.erase(w);
+}
+
+bool EventEngine::watchReadable(int fd, void* data)
+{
+	return add(fd,READABLE,data,0);
+}
+
+bool EventEngine::watchWritable(int fd, void* data)
+{
+	return add(fd,WRITABLE,data,0);
+}
+
+bool EventEngine::watchProcess(pid_t pid, void* data)
+{
+	//pidfds are always close on exec so solvers don't inherit them.
+	int fd=openPidFd(pid);
+	if(fd == -1)
+		return false;
+
+	if(!add(fd,EXITED,data,pid))
+	{
+		close(fd);
+		return false;
+	}
+
+	pidToFd[pid]=fd;
+	return true;
+}
+
+void EventEngine::unwatchReadable(int fd)
+{
+	remove(fd);
+}
+
+void EventEngine::unwatchWritable(int fd)
+{
+	remove(fd);
+}
+
+void EventEngine::unwatchProcess(pid_t pid)
+{
+	map<pid_t,int>::iterator p=pidToFd.find(pid);
+	if(p == pidToFd.end())
+		return;
+
+	remove(p->second);
+	close(p->second);
+	pidToFd.erase(p);
+}
+
+bool EventEngine::setDeadline(const timespec& when)
+{
+	struct itimerspec t;
+	memset(&t,0,sizeof(t));
+	t.it_value=when;
+
+	//A zero it_value disarms the timer so make sure a deadline of "now" still fires.
+	if(t.it_value.tv_sec == 0 && t.it_value.tv_nsec == 0)
+		t.it_value.tv_nsec=1;
+
+	if(timerfd_settime(timerFd,TFD_TIMER_ABSTIME,&t,NULL) == -1)
+	{
+		perror("EventEngine: timerfd_settime");
+		return false;
+	}
+
+	return true;
+}
+
+void EventEngine::clearDeadline()
+{
+	struct itimerspec t;
+	memset(&t,0,sizeof(t));
+	timerfd_settime(timerFd,0,&t,NULL);
+
+	//Throw away an expiry that hasn't been collected yet.
+	uint64_t expirations;
+	while(read(timerFd,&expirations,sizeof(expirations)) > 0);
+}
+
+int EventEngine::wait(std::vector<Event>& events, int timeout)
+{
+	struct epoll_event ready[MAX_EVENTS];
+	int n=epoll_wait(epollFd,ready,MAX_EVENTS,timeout);
+	if(n == -1)
+		return -1;
+
+	size_t before=events.size();
+	for(int i=0; i < n; ++i)
+	{
+		Watch* w=static_cast<Watch*>(ready[i].data.ptr);
+
+		Event e;
+		e.type=w->type;
+		e.data=w->data;
+		e.fd=w->fd;
+		e.pid=w->pid;
+
+		if(w->type == TIMER)
+		{
+			//Acknowledge the expiry so the timer stops being readable.
+			uint64_t expirations;
+			if(read(timerFd,&expirations,sizeof(expirations)) != sizeof(expirations))
+				continue;
+		}
+
+		events.push_back(e);
+	}
+
+	return events.size() - before;
+}
+
+int EventEngine::getFileDescriptor() const
+{
+	return epollFd;
+}
+
+bool EventEngine::supportsProcesses()
+{
+	//Our own PID is always valid
+	int fd=openPidFd(getpid());
+	if(fd == -1)
+		return false;
+
+	close(fd);
+	return true;
+}
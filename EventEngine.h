@@ -0,0 +1,123 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef EVENTENGINE_H_
+#define EVENTENGINE_H_
+
+#include <vector>
+#include <map>
+#include <unistd.h>
+#include <time.h>
+
+/* Waits for many file descriptors, child processes and a deadline at once
+ * using epoll.
+ *
+ * - File descriptors are watched for being readable (which includes end of file)
+ *   or writable (which includes the reader having gone).
+ * - Child processes are watched with a pidfd so their exit is seen directly
+ *   (and can be reaped straight away) rather than through their pipes. On
+ *   kernels without pidfd_open() (before 5.3) process events are not
+ *   delivered and callers must rely on end of file instead.
+ * - A single timer (timerfd on CLOCK_MONOTONIC) fires at an absolute time.
+ *
+ * Unlike select() there is no limit on the value of file descriptors and
+ * waiting costs O(ready events) rather than O(watched descriptors).
+ */
+class EventEngine
+{
+	public:
+		enum EventType
+		{
+			READABLE,
+			WRITABLE,
+			EXITED,
+			TIMER
+		};
+
+		struct Event
+		{
+			EventType type;
+			void* data; //As given to watchReadable()/watchWritable()/watchProcess(). NULL for TIMER.
+			int fd; //READABLE and WRITABLE only
+			pid_t pid; //EXITED only
+		};
+
+		EventEngine();
+		~EventEngine();
+
+		//False if epoll or the timer couldn't be set up.
+		bool isValid() const;
+
+		//Report READABLE when "fd" can be read (or is at end of file).
+		bool watchReadable(int fd, void* data);
+
+		//Report WRITABLE when "fd" can be written to (or its reader has gone).
+		bool watchWritable(int fd, void* data);
+
+		//Report EXITED once when "pid" (a child of ours) exits. Returns false if unsupported.
+		bool watchProcess(pid_t pid, void* data);
+
+		//Stop watching. Safe to call for things that aren't watched.
+		void unwatchReadable(int fd);
+		void unwatchWritable(int fd);
+		void unwatchProcess(pid_t pid);
+
+		//Report TIMER at the absolute CLOCK_MONOTONIC time "when" (replaces an earlier deadline).
+		bool setDeadline(const timespec& when);
+		void clearDeadline();
+
+		/* Wait for at least one event and append them to "events". Returns the
+		 * number of events, or -1 on error (errno is set, EINTR if a signal
+		 * handler ran). With a "timeout" (in milliseconds, 0 to only collect what
+		 * is already pending) it returns 0 if nothing happened in time.
+		 */
+		int wait(std::vector<Event>& events, int timeout=-1);
+
+		/* The epoll descriptor. It is readable while an event is pending so one
+		 * EventEngine can watch many others (see AsyncNSolv).
+		 */
+		int getFileDescriptor() const;
+
+		//True if watchProcess() works on this kernel.
+		static bool supportsProcesses();
+
+	private:
+		struct Watch
+		{
+			EventType type;
+			void* data;
+			int fd;
+			pid_t pid;
+		};
+
+		int epollFd;
+		int timerFd;
+
+		//Keyed by the fd registered with epoll (the pidfd for processes).
+		std::map<int,Watch*> watches;
+		std::map<pid_t,int> pidToFd;
+
+		bool add(int fd, EventType type, void* data, pid_t pid);
+		void remove(int fd);
+
+		//Not copyable because we own file descriptors
+		EventEngine(const EventEngine&);
+		EventEngine& operator=(const EventEngine&);
+};
+
+#endif /* EVENTENGINE_H_ */
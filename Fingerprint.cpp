@@ -0,0 +1,504 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Fingerprint.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const unsigned int Fingerprinter::UNNUMBERED=~0u;
+
+//Bump this if the canonical form changes so old fingerprints don't match new ones.
+static const char FINGERPRINT_VERSION[] = "nsolv-fingerprint-1\n";
+
+//The canonical text is hashed in chunks of this size.
+static const size_t BODY_CHUNK_SIZE=65536;
+
+//Initial number of slots in the table of declared symbols (must be a power of 2).
+static const size_t INITIAL_DECLARED_SLOTS=1024;
+
+Fingerprinter::Fingerprinter(bool _vectorised) :
+vectorised(_vectorised), declared(INITIAL_DECLARED_SLOTS), numberOfDeclared(0), nextNumber(0), declarations(), body(BODY_CHUNK_SIZE), bodyLength(0),
+bodyHash(), lastWasAtom(false)
+{
+	memset(declaredFilter,0,sizeof(declaredFilter));
+}
+
+void Fingerprinter::reset()
+{
+	declared.assign(INITIAL_DECLARED_SLOTS,Symbol());
+	numberOfDeclared=0;
+	memset(declaredFilter,0,sizeof(declaredFilter));
+	nextNumber=0;
+	declarations.clear();
+	bodyLength=0;
+	bodyHash=Hasher();
+	lastWasAtom=false;
+}
+
+std::string Fingerprinter::compute(const char* data, size_t length)
+{
+	reset();
+
+	SmtLexer lexer(data,length,vectorised);
+	SmtLexer::Token t;
+
+	unsigned int depth=0;
+
+	//We've seen the '(' of a command and are waiting for its name.
+	bool commandStart=false;
+
+	//The declaration being read (if any)
+	Declaration* current=NULL;
+	bool expectName=false;
+
+	while(lexer.next(t))
+	{
+		if(commandStart)
+		{
+			commandStart=false;
+			if(t.type == SmtLexer::ATOM && isDeclarationCommand(t.text,t.length))
+			{
+				declarations.push_back(Declaration());
+				current=&declarations.back();
+				current->tokens.push_back("(");
+				current->tokens.push_back(string(t.text,t.length));
+				expectName=true;
+				continue;
+			}
+
+			//Not a declaration so output the '(' we held back.
+			emitParen('(');
+		}
+
+		if(t.type == SmtLexer::LEFT_PAREN)
+		{
+			if(depth++ == 0)
+			{
+				commandStart=true;
+				continue;
+			}
+		}
+		else if(t.type == SmtLexer::RIGHT_PAREN && depth > 0)
+			depth--;
+
+		if(current == NULL)
+		{
+			emitToken(t);
+			continue;
+		}
+
+		//Inside a declaration
+		switch(t.type)
+		{
+			case SmtLexer::LEFT_PAREN:
+				current->tokens.push_back("(");
+				expectName=false;
+				break;
+
+			case SmtLexer::RIGHT_PAREN:
+				current->tokens.push_back(")");
+				expectName=false;
+				break;
+
+			case SmtLexer::QUOTED_SYMBOL:
+				current->tokens.push_back("|" + string(t.text,t.length) + "|");
+				break;
+
+			default:
+				current->tokens.push_back(string(t.text,t.length));
+		}
+
+		if(expectName)
+		{
+			current->name.assign(t.text,t.length);
+
+			declare(current->name);
+			expectName=false;
+		}
+
+		if(depth == 0)
+			current=NULL;
+	}
+
+	if(commandStart)
+		emitParen('(');
+
+	flushBody();
+	numberUnusedDeclarations();
+
+	vector<string> rendered;
+	rendered.reserve(declarations.size());
+	for(vector<Declaration>::const_iterator d=declarations.begin(); d != declarations.end(); ++d)
+		rendered.push_back(renderDeclaration(*d));
+
+	sort(rendered.begin(),rendered.end());
+
+	Hasher h;
+	h.update(FINGERPRINT_VERSION);
+	for(vector<string>::const_iterator r=rendered.begin(); r != rendered.end(); ++r)
+	{
+		//Prefix each with its length so declarations can't run into each other.
+		string prefix;
+		appendNumber(prefix,r->size());
+		prefix+=':';
+		h.update(prefix);
+		h.update(*r);
+	}
+	h.update(bodyHash.hexDigest());
+
+	return h.hexDigest();
+}
+
+bool Fingerprinter::computeFile(const std::string& path, std::string& fingerprint)
+{
+	int fd=::open(path.c_str(),O_RDONLY);
+	if(fd == -1)
+	{
+		cerr << "Fingerprinter: Couldn't open " << path << endl;
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(fd,&info) != 0)
+	{
+		perror("Fingerprinter: fstat:");
+		close(fd);
+		return false;
+	}
+
+	if(info.st_size == 0)
+	{
+		close(fd);
+		fingerprint=compute("",0);
+		return true;
+	}
+
+	void* data=mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	if(data == MAP_FAILED)
+	{
+		//Not something we can map (e.g. a pipe) so read it instead.
+		string contents;
+		char chunk[65536];
+		ssize_t bytes=0;
+		while((bytes=::read(fd,chunk,sizeof(chunk))) != 0)
+		{
+			if(bytes == -1 && errno == EINTR)
+				continue;
+
+			if(bytes == -1)
+			{
+				perror("Fingerprinter: read:");
+				close(fd);
+				return false;
+			}
+
+			contents.append(chunk,bytes);
+		}
+		close(fd);
+
+		fingerprint=compute(contents.data(),contents.size());
+		return true;
+	}
+
+	//We read the query once from start to finish
+	madvise(data,info.st_size,MADV_SEQUENTIAL);
+
+	fingerprint=compute(static_cast<const char*>(data),info.st_size);
+
+	munmap(data,info.st_size);
+	close(fd);
+	return true;
+}
+
+void Fingerprinter::emitParen(char p)
+{
+	if(bodyLength == BODY_CHUNK_SIZE)
+		flushBody();
+
+	body[bodyLength++]=p;
+	lastWasAtom=false;
+}
+
+void Fingerprinter::emitAtom(const char* text, size_t length)
+{
+	if(bodyLength + length + 1 > BODY_CHUNK_SIZE)
+	{
+		flushBody();
+
+		//Too big for the buffer (e.g. a huge string literal) so hash it directly.
+		if(length + 1 > BODY_CHUNK_SIZE)
+		{
+			if(lastWasAtom)
+				bodyHash.update(" ",1);
+
+			bodyHash.update(text,length);
+			lastWasAtom=true;
+			return;
+		}
+	}
+
+	//Atoms next to each other need separating, atoms next to parentheses don't.
+	if(lastWasAtom)
+		body[bodyLength++]=' ';
+
+	memcpy(&body[bodyLength],text,length);
+	bodyLength+=length;
+	lastWasAtom=true;
+}
+
+void Fingerprinter::emitToken(const SmtLexer::Token& t)
+{
+	unsigned int* number=NULL;
+
+	switch(t.type)
+	{
+		case SmtLexer::LEFT_PAREN:
+		case SmtLexer::RIGHT_PAREN:
+			emitParen(t.text[0]);
+			return;
+
+		case SmtLexer::STRING:
+			emitAtom(t.text,t.length);
+			return;
+
+		case SmtLexer::ATOM:
+		case SmtLexer::QUOTED_SYMBOL:
+			if(lookupDeclared(t.text,t.length,number))
+			{
+				//First use decides the canonical name.
+				if(*number == UNNUMBERED)
+					*number=nextNumber++;
+
+				scratch="$";
+				appendNumber(scratch,*number);
+				emitAtom(scratch.data(),scratch.size());
+			}
+			else if(t.type == SmtLexer::QUOTED_SYMBOL)
+			{
+				scratch="|";
+				scratch.append(t.text,t.length);
+				scratch+='|';
+				emitAtom(scratch.data(),scratch.size());
+			}
+			else
+				emitAtom(t.text,t.length);
+			return;
+	}
+}
+
+void Fingerprinter::flushBody()
+{
+	bodyHash.update(&body[0],bodyLength);
+	bodyLength=0;
+}
+
+void Fingerprinter::declare(const std::string& name)
+{
+	//Redeclaring a symbol (e.g. after a (pop)) keeps its number.
+	unsigned int* number=NULL;
+	if(name.empty() || lookupDeclared(name.data(),name.size(),number))
+		return;
+
+	//Keep the table at most half full
+	if(2*(numberOfDeclared + 1) > declared.size())
+		growDeclared();
+
+	size_t mask=declared.size() -1;
+	size_t slot=hashSymbol(name.data(),name.size()) & mask;
+	while(!declared[slot].name.empty())
+		slot=(slot +1) & mask;
+
+	declared[slot].name=name;
+	declared[slot].number=UNNUMBERED;
+	numberOfDeclared++;
+
+	size_t bit=filterIndex(name.data(),name.size());
+	declaredFilter[bit/8]|=1 << (bit % 8);
+}
+
+void Fingerprinter::growDeclared()
+{
+	vector<Symbol> old(declared.size() * 2);
+	old.swap(declared);
+
+	size_t mask=declared.size() -1;
+	for(vector<Symbol>::iterator s=old.begin(); s != old.end(); ++s)
+	{
+		if(s->name.empty())
+			continue;
+
+		size_t slot=hashSymbol(s->name.data(),s->name.size()) & mask;
+		while(!declared[slot].name.empty())
+			slot=(slot +1) & mask;
+
+		declared[slot].name.swap(s->name);
+		declared[slot].number=s->number;
+	}
+}
+
+size_t Fingerprinter::hashSymbol(const char* text, size_t length)
+{
+	//FNV-1a. Symbols are short so this is quicker than anything fancier.
+	uint64_t h=14695981039346656037ULL;
+	for(size_t i=0; i < length; ++i)
+	{
+		h^=static_cast<unsigned char>(text[i]);
+		h*=1099511628211ULL;
+	}
+
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+size_t Fingerprinter::filterIndex(const char* text, size_t length)
+{
+	unsigned char first=text[0];
+	unsigned char last=text[length -1];
+	return (length * 131 + first * 31 + last) % FILTER_BITS;
+}
+
+bool Fingerprinter::lookupDeclared(const char* text, size_t length, unsigned int*& number)
+{
+	if(length == 0)
+		return false;
+
+	size_t bit=filterIndex(text,length);
+	if((declaredFilter[bit/8] & (1 << (bit % 8))) == 0)
+		return false;
+
+	size_t mask=declared.size() -1;
+	for(size_t slot=hashSymbol(text,length) & mask; !declared[slot].name.empty(); slot=(slot +1) & mask)
+	{
+		Symbol& s=declared[slot];
+		if(s.name.size() == length && memcmp(s.name.data(),text,length) == 0)
+		{
+			number=&s.number;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Fingerprinter::numberUnusedDeclarations()
+{
+	//Sort the declarations of unused symbols by what they look like without their names.
+	vector< pair<string,size_t> > unused;
+	for(size_t i=0; i < declarations.size(); ++i)
+	{
+		const Declaration& d=declarations[i];
+		if(d.name.empty())
+			continue;
+
+		unsigned int* number=NULL;
+		if(lookupDeclared(d.name.data(),d.name.size(),number) && *number == UNNUMBERED)
+			unused.push_back(make_pair(renderDeclaration(d),i));
+	}
+
+	stable_sort(unused.begin(),unused.end());
+
+	for(vector< pair<string,size_t> >::const_iterator u=unused.begin(); u != unused.end(); ++u)
+	{
+		const Declaration& d=declarations[u->second];
+		unsigned int* number=NULL;
+
+		//A symbol declared more than once is only numbered once.
+		if(lookupDeclared(d.name.data(),d.name.size(),number) && *number == UNNUMBERED)
+			*number=nextNumber++;
+	}
+}
+
+std::string Fingerprinter::renderDeclaration(const Declaration& d)
+{
+	string r;
+	bool lastAtom=false;
+	for(vector<string>::const_iterator t=d.tokens.begin(); t != d.tokens.end(); ++t)
+	{
+		if(*t == "(" || *t == ")")
+		{
+			r+=*t;
+			lastAtom=false;
+			continue;
+		}
+
+		if(lastAtom)
+			r+=' ';
+		lastAtom=true;
+
+		//Quoted symbols are stored with their |bars|
+		const char* text=t->data();
+		size_t length=t->size();
+		if(length >= 2 && text[0] == '|')
+		{
+			text++;
+			length-=2;
+		}
+
+		unsigned int* number=NULL;
+		if(lookupDeclared(text,length,number))
+		{
+			if(*number == UNNUMBERED)
+				r+="$?";
+			else
+			{
+				r+='$';
+				appendNumber(r,*number);
+			}
+		}
+		else
+			r+=*t;
+	}
+
+	return r;
+}
+
+bool Fingerprinter::isDeclarationCommand(const char* text, size_t length)
+{
+	static const char* const commands[] = {"declare-fun", "declare-const", "define-fun", "define-fun-rec",
+											"declare-sort", "define-sort"};
+
+	for(size_t i=0; i < sizeof(commands)/sizeof(commands[0]); ++i)
+	{
+		if(strlen(commands[i]) == length && memcmp(commands[i],text,length) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+void Fingerprinter::appendNumber(std::string& s, unsigned int n)
+{
+	//This is called for every use of a declared symbol so avoid snprintf()
+	char digits[16];
+	char* p=digits + sizeof(digits);
+	do
+	{
+		*--p='0' + n % 10;
+		n/=10;
+	} while(n != 0);
+
+	s.append(p,digits + sizeof(digits) - p);
+}
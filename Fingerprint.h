@@ -0,0 +1,128 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef FINGERPRINT_H_
+#define FINGERPRINT_H_
+
+#include <string>
+#include <vector>
+#include "Hash.h"
+#include "SmtLexer.h"
+
+/* Computes a canonical fingerprint of a SMTLIBv2 query. Two queries have
+ * the same fingerprint if they only differ by
+ *
+ * - whitespace and comments
+ * - the names of the symbols and sorts they declare (declare-fun,
+ *   declare-const, define-fun, declare-sort, define-sort)
+ * - the order of their declarations
+ *
+ * Declared symbols are renamed by the order of their first use outside of a
+ * declaration (e.g. the first declared array used by an (assert) becomes $0).
+ * Declarations are then renamed in the same way and hashed in sorted order.
+ * Declared symbols that are never used are numbered by the sorted order of
+ * their (anonymous) declarations.
+ *
+ * Everything else (including the names of let and quantifier bindings) must
+ * match exactly.
+ */
+class Fingerprinter
+{
+	public:
+		//If "vectorised" is false the lexer's scalar code is used (see SmtLexer).
+		Fingerprinter(bool _vectorised=true);
+
+		//Returns the fingerprint as 32 hex digits.
+		std::string compute(const char* data, size_t length);
+
+		//Fingerprint the query in "path". Returns false on failure.
+		bool computeFile(const std::string& path, std::string& fingerprint);
+
+	private:
+		struct Declaration
+		{
+			//The declared symbol (empty if the command is malformed).
+			std::string name;
+
+			//The command with the tokens that refer to declared symbols left as they are.
+			std::vector<std::string> tokens;
+		};
+
+		struct Symbol
+		{
+			std::string name; //empty if the slot is free
+			unsigned int number;
+		};
+
+		static const unsigned int UNNUMBERED;
+
+		bool vectorised;
+
+		/* Declared symbols and their canonical numbers (or UNNUMBERED). This is
+		 * an open addressing hash table so that symbols can be looked up straight
+		 * from the query without copying them.
+		 */
+		std::vector<Symbol> declared;
+		size_t numberOfDeclared;
+
+		/* A bit is set for the (length, first and last character) of every declared symbol.
+		 * Most atoms don't match any of them so we don't need to look them up in "declared".
+		 */
+		static const size_t FILTER_BITS=4096;
+		unsigned char declaredFilter[FILTER_BITS/8];
+		unsigned int nextNumber;
+
+		std::vector<Declaration> declarations;
+
+		//Canonical text of everything except the declarations, hashed a chunk at a time.
+		std::vector<char> body;
+		size_t bodyLength;
+		Hasher bodyHash;
+		bool lastWasAtom;
+
+		//Reused to avoid allocating a string for every declared symbol we output.
+		std::string scratch;
+
+		void reset();
+
+		void declare(const std::string& name);
+		void growDeclared();
+		static size_t filterIndex(const char* text, size_t length);
+		static size_t hashSymbol(const char* text, size_t length);
+
+		void emitParen(char p);
+		void emitAtom(const char* text, size_t length);
+		void emitToken(const SmtLexer::Token& t);
+		void flushBody();
+
+		/* If "text" is a declared symbol "number" is set to point at its canonical
+		 * number and true is returned.
+		 */
+		bool lookupDeclared(const char* text, size_t length, unsigned int*& number);
+
+		//Number declared symbols that were never used.
+		void numberUnusedDeclarations();
+
+		//Render a declaration with canonical names. Symbols that aren't numbered yet are written as $?
+		std::string renderDeclaration(const Declaration& d);
+
+		static bool isDeclarationCommand(const char* text, size_t length);
+		static void appendNumber(std::string& s, unsigned int n);
+};
+
+#endif /* FINGERPRINT_H_ */
@@ -0,0 +1,149 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Hash.h"
+#include <cstring>
+#include <cstdio>
+
+static const uint64_t C1=0x87c37b91114253d5ULL;
+static const uint64_t C2=0x4cf5ad432745937fULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static inline uint64_t load64(const unsigned char* p)
+{
+	uint64_t value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+Hasher::Hasher() :
+h1(0), h2(0), tailLength(0), totalLength(0)
+{
+
+}
+
+void Hasher::processBlock(const unsigned char* block)
+{
+	uint64_t k1=load64(block);
+	uint64_t k2=load64(block + 8);
+
+	k1 *= C1; k1 = rotl64(k1,31); k1 *= C2; h1 ^= k1;
+	h1 = rotl64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+
+	k2 *= C2; k2 = rotl64(k2,33); k2 *= C1; h2 ^= k2;
+	h2 = rotl64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+}
+
+void Hasher::update(const void* data, size_t length)
+{
+	const unsigned char* p=static_cast<const unsigned char*>(data);
+	totalLength+=length;
+
+	//Complete a partially filled block first.
+	if(tailLength > 0)
+	{
+		size_t needed=sizeof(tail) - tailLength;
+		size_t used= length < needed? length : needed;
+		memcpy(tail + tailLength,p,used);
+		tailLength+=used;
+		p+=used;
+		length-=used;
+
+		if(tailLength < sizeof(tail))
+			return;
+
+		processBlock(tail);
+		tailLength=0;
+	}
+
+	while(length >= 16)
+	{
+		processBlock(p);
+		p+=16;
+		length-=16;
+	}
+
+	memcpy(tail,p,length);
+	tailLength=length;
+}
+
+void Hasher::update(const std::string& data)
+{
+	update(data.data(),data.size());
+}
+
+std::string Hasher::hexDigest() const
+{
+	uint64_t a=h1;
+	uint64_t b=h2;
+
+	uint64_t k1=0;
+	uint64_t k2=0;
+
+	switch(tailLength)
+	{
+		case 15: k2 ^= ((uint64_t)tail[14]) << 48; //fall through
+		case 14: k2 ^= ((uint64_t)tail[13]) << 40; //fall through
+		case 13: k2 ^= ((uint64_t)tail[12]) << 32; //fall through
+		case 12: k2 ^= ((uint64_t)tail[11]) << 24; //fall through
+		case 11: k2 ^= ((uint64_t)tail[10]) << 16; //fall through
+		case 10: k2 ^= ((uint64_t)tail[ 9]) << 8; //fall through
+		case  9: k2 ^= ((uint64_t)tail[ 8]) << 0;
+			k2 *= C2; k2 = rotl64(k2,33); k2 *= C1; b ^= k2;
+			//fall through
+
+		case  8: k1 ^= ((uint64_t)tail[ 7]) << 56; //fall through
+		case  7: k1 ^= ((uint64_t)tail[ 6]) << 48; //fall through
+		case  6: k1 ^= ((uint64_t)tail[ 5]) << 40; //fall through
+		case  5: k1 ^= ((uint64_t)tail[ 4]) << 32; //fall through
+		case  4: k1 ^= ((uint64_t)tail[ 3]) << 24; //fall through
+		case  3: k1 ^= ((uint64_t)tail[ 2]) << 16; //fall through
+		case  2: k1 ^= ((uint64_t)tail[ 1]) << 8; //fall through
+		case  1: k1 ^= ((uint64_t)tail[ 0]) << 0;
+			k1 *= C1; k1 = rotl64(k1,31); k1 *= C2; a ^= k1;
+	}
+
+	a ^= totalLength; b ^= totalLength;
+
+	a += b;
+	b += a;
+
+	a = fmix64(a);
+	b = fmix64(b);
+
+	a += b;
+	b += a;
+
+	char hex[33];
+	snprintf(hex,sizeof(hex),"%016llx%016llx",(unsigned long long) a,(unsigned long long) b);
+	return std::string(hex);
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Incremental 128-bit hash (MurmurHash3 x64_128 by Austin Appleby).
+ * It is not a cryptographic hash but it is fast and has a very low
+ * chance of collision, which is what we need to identify queries.
+ */
+class Hasher
+{
+	public:
+		Hasher();
+
+		void update(const void* data, size_t length);
+		void update(const std::string& data);
+
+		//Returns the hash of everything given to update() as 32 hex digits.
+		std::string hexDigest() const;
+
+	private:
+		uint64_t h1;
+		uint64_t h2;
+
+		//Bytes waiting to make up a 16 byte block
+		unsigned char tail[16];
+		size_t tailLength;
+
+		uint64_t totalLength;
+
+		void processBlock(const unsigned char* block);
+};
+
+#endif /* HASH_H_ */
@@ -0,0 +1,285 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "InteractiveSolver.h"
+#include "Solver.h"
+#include "global.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+using namespace std;
+
+InteractiveSolver::InteractiveSolver(const std::string& _name, const std::string& _cmdOptions) :
+name(_name), cmdOptions(), pid(0), toSolver(-1), fromSolver(-1), pendingInput(), pendingOffset(0), output()
+{
+	//push the argv[0] argument which is the program name.
+	cmdOptions.push_back(name);
+	Solver::tokenizeOptions(_cmdOptions,cmdOptions);
+}
+
+InteractiveSolver::~InteractiveSolver()
+{
+	stop();
+}
+
+bool InteractiveSolver::start()
+{
+	if(isRunning())
+		return true;
+
+	int input[2];
+	int out[2];
+
+	//O_CLOEXEC so that other solvers we start don't inherit our ends of the pipes.
+	if(pipe2(input,O_CLOEXEC) == -1)
+	{
+		perror("InteractiveSolver: Problem setting up pipe:");
+		return false;
+	}
+
+	if(pipe2(out,O_CLOEXEC) == -1)
+	{
+		perror("InteractiveSolver: Problem setting up pipe:");
+		close(input[0]); close(input[1]);
+		return false;
+	}
+
+	/* Build the argv array before forking. The strings are owned by
+	 * cmdOptions which the child doesn't modify.
+	 */
+	vector<const char*> argv;
+	for(vector<string>::const_iterator i=cmdOptions.begin(); i != cmdOptions.end(); ++i)
+		argv.push_back(i->c_str());
+	argv.push_back(NULL);
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t p=fork();
+
+	if(p < 0)
+	{
+		perror("InteractiveSolver: Failed to fork");
+		close(input[0]); close(input[1]);
+		close(out[0]); close(out[1]);
+		return false;
+	}
+
+	if(p == 0)
+	{
+		//In child. dup2() clears O_CLOEXEC on the new descriptors.
+		if(dup2(input[0],fileno(stdin)) == -1 || dup2(out[1],fileno(stdout)) == -1)
+		{
+			perror("Problem redirecting standard input/output of solver:");
+			_exit(1);
+		}
+
+		//NSolv ignores SIGPIPE when talking to solvers but the solver shouldn't.
+		signal(SIGPIPE,SIG_DFL);
+
+		//Don't outlive the NSolv process that owns us.
+		prctl(PR_SET_PDEATHSIG,SIGKILL);
+
+		execvp(name.c_str(), (char * const*) &argv[0]);
+
+		cerr << "Failed to execute solver:" << name << "!" << endl;
+		perror("execvp:");
+		_exit(1);
+	}
+
+	//parent code
+	close(input[0]);
+	close(out[1]);
+
+	pid=p;
+	toSolver=input[1];
+	fromSolver=out[0];
+
+	fcntl(toSolver,F_SETFL,fcntl(toSolver,F_GETFL) | O_NONBLOCK);
+	fcntl(fromSolver,F_SETFL,fcntl(fromSolver,F_GETFL) | O_NONBLOCK);
+
+	pendingInput.clear();
+	pendingOffset=0;
+	output.clear();
+
+	if(verbose) cerr << "InteractiveSolver: Started solver " << name << " with PID:" << pid << endl;
+	return true;
+}
+
+void InteractiveSolver::stop()
+{
+	closePipes();
+
+	if(pid == 0)
+		return;
+
+	if(verbose) cerr << "InteractiveSolver: Stopping solver " << name << " with PID:" << pid << endl;
+
+	//Closing its standard input is usually enough but we don't want to wait for it.
+	if(::kill(pid,SIGKILL) == -1 && errno != ESRCH)
+		cerr << "Killing process with PID:" << pid << " failed!" << endl;
+
+	waitpid(pid,NULL,0);
+	pid=0;
+}
+
+bool InteractiveSolver::restart()
+{
+	stop();
+	return start();
+}
+
+bool InteractiveSolver::isRunning() const
+{
+	return pid != 0;
+}
+
+void InteractiveSolver::send(const std::string& data)
+{
+	//Drop what has already been written so the queue doesn't grow forever.
+	if(pendingOffset == pendingInput.size())
+	{
+		pendingInput.clear();
+		pendingOffset=0;
+	}
+
+	pendingInput+=data;
+}
+
+bool InteractiveSolver::hasPendingInput() const
+{
+	return pendingOffset < pendingInput.size();
+}
+
+bool InteractiveSolver::flushInput()
+{
+	while(hasPendingInput())
+	{
+		ssize_t result=::write(toSolver,pendingInput.data() + pendingOffset, pendingInput.size() - pendingOffset);
+
+		if(result == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return true; //pipe is full, try again later.
+
+			if(verbose) perror("InteractiveSolver: Failed to write to solver");
+			return false;
+		}
+
+		pendingOffset+=result;
+	}
+
+	return true;
+}
+
+bool InteractiveSolver::readOutput()
+{
+	char chunk[4096];
+
+	while(true)
+	{
+		ssize_t result=::read(fromSolver,chunk,sizeof(chunk));
+
+		if(result == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return true; //Nothing more for now.
+
+			if(verbose) perror("InteractiveSolver: Failed to read from solver");
+			return false;
+		}
+
+		if(result == 0)
+			return false; //EOF. The solver has exited.
+
+		output.append(chunk,result);
+	}
+}
+
+std::string& InteractiveSolver::getOutput()
+{
+	return output;
+}
+
+void InteractiveSolver::clearOutput()
+{
+	output.clear();
+}
+
+size_t InteractiveSolver::findMarker(const std::string& marker) const
+{
+	size_t position=output.find(marker);
+	if(position == string::npos)
+		return string::npos;
+
+	//Some solvers print the quotes around the string, some don't.
+	size_t lineStart=output.rfind('\n',position);
+	return lineStart == string::npos? 0 : lineStart +1;
+}
+
+bool InteractiveSolver::consumeThroughMarker(const std::string& marker, std::string* response)
+{
+	size_t lineStart=findMarker(marker);
+	if(lineStart == string::npos)
+		return false;
+
+	if(response != NULL)
+		response->assign(output,0,lineStart);
+
+	size_t lineEnd=output.find('\n',output.find(marker,lineStart));
+	output.erase(0,lineEnd == string::npos? output.size() : lineEnd +1);
+	return true;
+}
+
+int InteractiveSolver::getReadFileDescriptor() const
+{
+	return fromSolver;
+}
+
+int InteractiveSolver::getWriteFileDescriptor() const
+{
+	return toSolver;
+}
+
+pid_t InteractiveSolver::getPID() const
+{
+	return pid;
+}
+
+const std::string& InteractiveSolver::toString() const
+{
+	return name;
+}
+
+void InteractiveSolver::closePipes()
+{
+	if(toSolver != -1) close(toSolver);
+	if(fromSolver != -1) close(fromSolver);
+	toSolver=fromSolver=-1;
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef INTERACTIVESOLVER_H_
+#define INTERACTIVESOLVER_H_
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/* A solver process that is kept alive between queries. Unlike Solver
+ * (which is given a single input file) SMTLIBv2 commands are written to
+ * its standard input and its answers are read from its standard output,
+ * so there is a pipe in each direction.
+ *
+ * Both ends used by NSolv are non-blocking. Data to be sent is queued by
+ * send() and written by flushInput() when the pipe is writable. Output is
+ * accumulated by readOutput() when the pipe is readable.
+ */
+class InteractiveSolver
+{
+	public:
+		//_cmdOptions must make the solver read SMTLIBv2 from standard input.
+		InteractiveSolver(const std::string& _name, const std::string& _cmdOptions);
+
+		//Triggering destructor will stop the solver
+		~InteractiveSolver();
+
+		//Start the solver process. Returns false on failure.
+		bool start();
+
+		//Kill and reap the solver process (if running).
+		void stop();
+
+		//Stop the solver and start a fresh one. Returns false on failure.
+		bool restart();
+
+		bool isRunning() const;
+
+		//Queue "data" to be written to the solver's standard input.
+		void send(const std::string& data);
+
+		bool hasPendingInput() const;
+
+		//Write as much pending input as possible without blocking. Returns false on failure.
+		bool flushInput();
+
+		//Read everything that is available without blocking. Returns false on EOF or failure.
+		bool readOutput();
+
+		std::string& getOutput();
+		void clearOutput();
+
+		/* Returns the offset in the output of the line containing "marker" or std::string::npos.
+		 * This is used to find the response to (echo "<marker>").
+		 */
+		size_t findMarker(const std::string& marker) const;
+
+		/* If the line containing "marker" has been read, remove everything up to and including
+		 * that line from the output, store what came before it in "response" (if not NULL) and return true.
+		 */
+		bool consumeThroughMarker(const std::string& marker, std::string* response);
+
+		int getReadFileDescriptor() const;
+		int getWriteFileDescriptor() const;
+
+		pid_t getPID() const;
+
+		const std::string& toString() const;
+
+	private:
+		std::string name;
+		std::vector< std::string > cmdOptions;
+
+		pid_t pid;
+
+		//Parent's ends of the pipes. toSolver is the solver's stdin, fromSolver its stdout.
+		int toSolver;
+		int fromSolver;
+
+		std::string pendingInput;
+		size_t pendingOffset;
+
+		std::string output;
+
+		void closePipes();
+};
+
+#endif /* INTERACTIVESOLVER_H_ */
@@ -0,0 +1,170 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "NSolv.h"
+#include "SolverManager.h"
+#include <iostream>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+NSolv::NSolv() :
+solvers(), timeout(0.0), tierDelay(1.0), killGrace(1.0), loggingPath(), fastSpawn(true), verbose(false), winner()
+{
+	//Non-blocking so that cancel() never blocks and solve() can empty it.
+	if(pipe2(cancelPipe,O_CLOEXEC | O_NONBLOCK) == -1)
+	{
+		perror("NSolv: Couldn't create the pipe for cancel():");
+		cancelPipe[0]=cancelPipe[1]=-1;
+	}
+}
+
+NSolv::~NSolv()
+{
+	if(cancelPipe[0] != -1)
+	{
+		close(cancelPipe[0]);
+		close(cancelPipe[1]);
+	}
+}
+
+void NSolv::addSolver(const std::string& name, const std::string& options, bool inputOnStdin, unsigned int tier)
+{
+	SolverEntry s;
+	s.name=name;
+	s.options=options;
+	s.inputOnStdin=inputOnStdin;
+	s.tier=tier;
+	solvers.push_back(s);
+}
+
+void NSolv::setTimeout(double seconds)
+{
+	timeout=seconds;
+}
+
+void NSolv::setTierDelay(double seconds)
+{
+	tierDelay=seconds;
+}
+
+void NSolv::setKillGrace(double seconds)
+{
+	killGrace=seconds;
+}
+
+void NSolv::setLoggingPath(const std::string& path)
+{
+	loggingPath=path;
+}
+
+void NSolv::setFastSpawn(bool fast)
+{
+	fastSpawn=fast;
+}
+
+void NSolv::setVerbose(bool _verbose)
+{
+	verbose=_verbose;
+}
+
+NSolv::Result NSolv::solve(const std::string& query, std::string& output)
+{
+	return solve(query.data(),query.size(),output);
+}
+
+NSolv::Result NSolv::solve(const char* query, size_t length, std::string& output)
+{
+	winner.clear();
+
+	if(cancelPipe[0] == -1)
+		return ERROR;
+
+	//Forget about cancel()s from before we started.
+	char discard[64];
+	while(read(cancelPipe[0],discard,sizeof(discard)) > 0);
+
+	SolverManager sm(query,length,"(memory)",timeout,loggingPath,verbose);
+	if(!sm.isValid())
+		return ERROR;
+
+	vector<int> noCpus;
+	for(vector<SolverEntry>::const_iterator s=solvers.begin(); s != solvers.end(); ++s)
+	{
+		if(!sm.addSolver(s->name,s->options,s->inputOnStdin,noCpus,s->tier,ResourceLimits()))
+			return ERROR;
+	}
+
+	sm.setTierDelay(tierDelay);
+	sm.setKillGrace(killGrace);
+	sm.setFastSpawn(fastSpawn);
+	sm.setCancelFd(cancelPipe[0]);
+
+	if(sm.invokeSolvers(output))
+		winner=sm.getWinner();
+
+	return resultOf(sm);
+}
+
+NSolv::Result NSolv::resultOf(const SolverManager& sm)
+{
+	if(sm.hasWinner())
+		return sm.getResult() == Solver::SAT? SAT : UNSAT;
+
+	if(sm.wasCancelled())
+		return CANCELLED;
+
+	if(sm.hasTimedOut())
+		return TIMEOUT;
+
+	return sm.getResult() == Solver::UNKNOWN? UNKNOWN : ERROR;
+}
+
+void NSolv::cancel()
+{
+	//write() is async-signal-safe. If the pipe is full a cancellation is already pending.
+	if(cancelPipe[1] != -1)
+	{
+		int error=errno;
+		ssize_t ignored=write(cancelPipe[1],"c",1);
+		(void) ignored;
+		errno=error;
+	}
+}
+
+const std::string& NSolv::getWinner() const
+{
+	return winner;
+}
+
+const char* NSolv::resultToString(Result r)
+{
+	switch(r)
+	{
+		case SAT: return "sat";
+		case UNSAT: return "unsat";
+		case UNKNOWN: return "unknown";
+		case TIMEOUT: return "timeout";
+		case CANCELLED: return "cancelled";
+		case ERROR: return "error";
+		default: return "invalid";
+	}
+}
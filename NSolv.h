@@ -0,0 +1,143 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef NSOLV_H_
+#define NSOLV_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+class SolverManager;
+
+/* Races a portfolio of SMT-LIBv2 solvers from inside another program. This is
+ * the interface of libnsolv.
+ *
+ * It does what "nsolv <input>" does, but the query comes from memory and the
+ * answer and the winner's output are handed back rather than printed, so no
+ * temporary file or nsolv process is needed. libnsolv has no global state and
+ * never calls exit(), so a long running program (e.g. KLEE) can keep an NSolv
+ * for as long as it likes.
+ *
+ *	NSolv portfolio;
+ *	portfolio.addSolver("z3","-smt2 -in",true);
+ *	portfolio.addSolver("stp","--SMTLIB2");
+ *	portfolio.setTimeout(10);
+ *
+ *	std::string output;
+ *	if(portfolio.solve(query,output) == NSolv::SAT)
+ *		...
+ *
+ * Each solve() starts the solvers (found on PATH like the executable finds
+ * them) and has killed and reaped all of them before it returns. Problems are
+ * reported on stderr. Only cancel() may be called while another thread is in
+ * solve().
+ */
+class NSolv
+{
+	public:
+		enum Result
+		{
+			SAT,
+			UNSAT,
+			UNKNOWN, //No solver answered sat or unsat but at least one answered unknown
+			TIMEOUT,
+			CANCELLED, //See cancel()
+			ERROR //The solvers failed or couldn't be started
+		};
+
+		NSolv();
+		~NSolv();
+
+		/* Add a solver. "options" are its command line options separated by spaces
+		 * (like "<solver>.opts" in a configuration file). The query is given as its
+		 * last argument or on its stdin if "inputOnStdin" is true. Solvers of a later
+		 * "tier" only start if nothing has answered setTierDelay() seconds after the
+		 * tier before.
+		 */
+		void addSolver(const std::string& name, const std::string& options="", bool inputOnStdin=false, unsigned int tier=0);
+
+		//Give up after "seconds" (0, the default, means never).
+		void setTimeout(double seconds);
+
+		//Seconds between the start of one tier and the next (1 second by default, like "--tier-delay").
+		void setTierDelay(double seconds);
+
+		//How long solvers get to exit after SIGTERM before they get SIGKILL (1 second by default).
+		void setKillGrace(double seconds);
+
+		//Wait for every solver and log all their answers to "path" (see "--logging-path"). Empty (the default) to stop.
+		void setLoggingPath(const std::string& path);
+
+		//Start solvers with fork() rather than clone(CLONE_VM | CLONE_VFORK) (e.g. under valgrind).
+		void setFastSpawn(bool fast);
+
+		//Report what is happening on stderr
+		void setVerbose(bool _verbose);
+
+		/* Race the solvers on the "length" bytes of SMT-LIBv2 at "query". The winner's
+		 * output (starting with its answer) is appended to "output" if the result is
+		 * SAT or UNSAT.
+		 */
+		Result solve(const char* query, size_t length, std::string& output);
+		Result solve(const std::string& query, std::string& output);
+
+		/* Make the solve() in progress return CANCELLED as soon as it can. Safe to call
+		 * from another thread or from a signal handler. A cancel() before solve() has
+		 * started is forgotten.
+		 */
+		void cancel();
+
+		//The solver that won the last solve(). Empty if there wasn't a winner.
+		const std::string& getWinner() const;
+
+		static const char* resultToString(Result r);
+
+	private:
+		friend class AsyncNSolv;
+
+		//What a race that "sm" has finished resulted in
+		static Result resultOf(const SolverManager& sm);
+
+		struct SolverEntry
+		{
+			std::string name;
+			std::string options;
+			bool inputOnStdin;
+			unsigned int tier;
+		};
+
+		std::vector<SolverEntry> solvers;
+		double timeout;
+		double tierDelay;
+		double killGrace;
+		std::string loggingPath;
+		bool fastSpawn;
+		bool verbose;
+
+		//cancel() writes to [1], solve() waits on [0].
+		int cancelPipe[2];
+
+		std::string winner;
+
+		//Not copyable because we own the pipe
+		NSolv(const NSolv&);
+		NSolv& operator=(const NSolv&);
+};
+
+#endif /* NSOLV_H_ */
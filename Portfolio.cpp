@@ -0,0 +1,321 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Portfolio.h"
+#include "SolverManager.h"
+#include "ResultCache.h"
+#include "CpuTopology.h"
+#include "PortfolioSelector.h"
+#include "global.h"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+using namespace std;
+
+SolverDescription::SolverDescription(const std::string& _name, const std::string& _cmdOptions, bool _inputOnStdin) :
+name(_name), cmdOptions(_cmdOptions), inputOnStdin(_inputOnStdin), cpus(), tier(0), limits()
+{
+
+}
+
+Portfolio::Portfolio(double _timeout, bool _loggingMode) :
+solvers(), timeout(_timeout), loggingMode(_loggingMode), tierDelay(0.0), killGrace(1.0), logFormat(RaceLog::TEXT), shareInput(true), fastSpawn(true), poolMode(false), poolWorkers(1), resultCache(NULL), placement(), selector(NULL), selectTop(0), adaptivePercentile(0.0), adaptiveSlack(1.0)
+{
+
+}
+
+Portfolio::~Portfolio()
+{
+	delete resultCache;
+	delete selector;
+}
+
+void Portfolio::addSolver(const SolverDescription& s)
+{
+	solvers.push_back(s);
+}
+
+SolverManager* Portfolio::createSolverManager(const std::string& inputFile, unsigned int slot) const
+{
+	SolverManager* sm=NULL;
+
+	try {sm = new SolverManager(inputFile,timeout,loggingMode? loggingPath : string(),shareInput,verbose,tracer);}
+	catch(std::bad_alloc& e)
+	{
+		cerr << "Failed to allocate memory of SolverManager:" << e.what() << endl;
+		exit(1);
+	}
+
+	//It has already said what went wrong.
+	if(!sm->isValid())
+	{
+		delete sm;
+		exit(1);
+	}
+
+	//The SolverManager has read stdin ("-") so use its copy.
+	vector<size_t> chosen;
+	vector<ResourceLimits> limits;
+	chooseSolvers(sm->getInputFile(),chosen,limits);
+
+	//Solvers with their own CPUs don't use up any of the automatic ones.
+	size_t automatic=0;
+	for(vector<size_t>::const_iterator i=chosen.begin(); i != chosen.end(); ++i)
+	{
+		if(solvers[*i].cpus.empty())
+			automatic++;
+	}
+
+	size_t position=0;
+	for(size_t i=0; i < chosen.size(); ++i)
+	{
+		const SolverDescription& s=solvers[chosen[i]];
+		vector<int> cpus(s.cpus);
+		if(cpus.empty() && !placement.empty())
+			cpus.push_back(placement[(slot * automatic + position++) % placement.size()]);
+
+		if(!sm->addSolver(s.name, s.cmdOptions, s.inputOnStdin, cpus, s.tier, limits[i]))
+		{
+			delete sm;
+			exit(1);
+		}
+	}
+
+	sm->setTierDelay(tierDelay);
+	sm->setKillGrace(killGrace);
+	sm->setLogFormat(logFormat);
+	sm->setFastSpawn(fastSpawn);
+
+	sm->setResultCache(resultCache);
+
+	return sm;
+}
+
+const std::vector<SolverDescription>& Portfolio::getSolvers() const
+{
+	return solvers;
+}
+
+size_t Portfolio::getNumberOfSolvers() const
+{
+	return solvers.size();
+}
+
+size_t Portfolio::getNumberOfRacingSolvers() const
+{
+	if(selector != NULL && selectTop > 0 && selectTop < solvers.size())
+		return selectTop;
+
+	return solvers.size();
+}
+
+double Portfolio::getTimeout() const
+{
+	return timeout;
+}
+
+bool Portfolio::isLoggingMode() const
+{
+	return loggingMode;
+}
+
+void Portfolio::setTierDelay(double delay)
+{
+	tierDelay=delay;
+}
+
+void Portfolio::setLogFormat(RaceLog::Format format)
+{
+	logFormat=format;
+}
+
+void Portfolio::setKillGrace(double grace)
+{
+	killGrace=grace;
+}
+
+void Portfolio::setShareInput(bool enabled)
+{
+	shareInput=enabled;
+}
+
+void Portfolio::setFastSpawn(bool enabled)
+{
+	fastSpawn=enabled;
+}
+
+void Portfolio::setPoolMode(bool enabled, unsigned int workers)
+{
+	poolMode=enabled;
+	poolWorkers= workers > 0? workers : 1;
+}
+
+bool Portfolio::isPoolMode() const
+{
+	return poolMode;
+}
+
+unsigned int Portfolio::getPoolWorkers() const
+{
+	return poolWorkers;
+}
+
+std::string Portfolio::getKey() const
+{
+	/* The length of each field is included so that different portfolios
+	 * can never produce the same key.
+	 */
+	stringstream key;
+	key << "nsolv-portfolio " << solvers.size() << "\n";
+	for(vector<SolverDescription>::const_iterator s= solvers.begin(); s != solvers.end(); ++s)
+	{
+		key << s->name.size() << ":" << s->name << " " <<
+			s->cmdOptions.size() << ":" << s->cmdOptions << " " <<
+			(s->inputOnStdin? "stdin" : "file") << "\n";
+	}
+
+	return key.str();
+}
+
+void Portfolio::enableResultCache(const std::string& directory, unsigned long long maxBytes)
+{
+	delete resultCache;
+
+	try {resultCache = new ResultCache(directory,maxBytes,getKey(),verbose);}
+	catch(std::bad_alloc& e)
+	{
+		cerr << "Failed to allocate memory of ResultCache:" << e.what() << endl;
+		exit(1);
+	}
+}
+
+ResultCache* Portfolio::getResultCache() const
+{
+	return resultCache;
+}
+
+void Portfolio::enablePinning()
+{
+	CpuTopology topology("/sys/devices/system/cpu",verbose);
+	topology.getPlacementOrder(placement);
+
+	if(placement.empty())
+	{
+		cerr << "Warning: Couldn't read the CPU topology. Solvers will not be pinned." << endl;
+		return;
+	}
+
+	//Only count the solvers that are placed automatically
+	size_t automatic=0;
+	for(vector<SolverDescription>::const_iterator s= solvers.begin(); s != solvers.end(); ++s)
+	{
+		if(s->cpus.empty())
+			automatic++;
+	}
+
+	if(automatic > placement.size())
+		cerr << "Warning: There are more solvers (" << automatic << ") than CPUs (" << placement.size() <<
+			"). Some solvers will share a CPU." << endl;
+
+	if(verbose)
+	{
+		cerr << "Portfolio: Placing solvers on CPUs in the order:";
+		for(vector<int>::const_iterator c=placement.begin(); c != placement.end(); ++c)
+			cerr << " " << *c << "(node " << topology.getNode(*c) << ")";
+		cerr << endl;
+	}
+}
+
+void Portfolio::enableSelection(const std::string& history, unsigned int top, double exploreRate)
+{
+	selectTop=top;
+	createSelector(history,top,exploreRate);
+}
+
+void Portfolio::enableAdaptiveTimeouts(const std::string& history, double percentile, double slack)
+{
+	adaptivePercentile=percentile;
+	adaptiveSlack=slack;
+
+	//Selection may have already learnt from the history.
+	if(selector == NULL)
+		createSelector(history,solvers.size(),0.0);
+}
+
+void Portfolio::createSelector(const std::string& history, unsigned int top, double exploreRate)
+{
+	delete selector;
+	selector=NULL;
+
+	vector<string> names;
+	for(vector<SolverDescription>::const_iterator s= solvers.begin(); s != solvers.end(); ++s)
+		names.push_back(s->name);
+
+	try {selector = new PortfolioSelector(names,top,exploreRate);}
+	catch(std::bad_alloc& e)
+	{
+		cerr << "Failed to allocate memory of PortfolioSelector:" << e.what() << endl;
+		exit(1);
+	}
+
+	//Without a history every solver ranks the same so the first "top" are run until one builds up.
+	if(!history.empty() && !selector->train(history))
+		cerr << "Warning: No history to learn from yet (" << history << " can't be read)." << endl;
+}
+
+void Portfolio::chooseSolvers(const std::string& inputFile, std::vector<size_t>& chosen,
+		std::vector<ResourceLimits>& limits) const
+{
+	chosen.clear();
+	limits.clear();
+
+	QueryFeatures features;
+	bool haveFeatures= selector != NULL && features.computeFile(inputFile);
+
+	if(haveFeatures && selectTop > 0)
+	{
+		selector->select(features,chosen);
+
+		if(verbose)
+		{
+			cerr << "Portfolio: Selected";
+			for(vector<size_t>::const_iterator i=chosen.begin(); i != chosen.end(); ++i)
+				cerr << " " << solvers[*i].name;
+			cerr << " for " << inputFile << " (" << features.toString() << ")" << endl;
+		}
+	}
+	else
+	{
+		for(size_t index=0; index < solvers.size(); ++index)
+			chosen.push_back(index);
+	}
+
+	for(vector<size_t>::const_iterator i=chosen.begin(); i != chosen.end(); ++i)
+	{
+		limits.push_back(solvers[*i].limits);
+
+		//A timeout from the configuration file wins.
+		if(!haveFeatures || adaptivePercentile <= 0.0 || loggingMode || limits.back().timeout > 0.0)
+			continue;
+
+		limits.back().timeout=adaptiveSlack * selector->predictTimeout(features,*i,adaptivePercentile);
+		if(verbose && limits.back().timeout > 0.0)
+			cerr << "Portfolio: " << solvers[*i].name << " gets " << limits.back().timeout << " s for " << inputFile << endl;
+	}
+}
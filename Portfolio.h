@@ -0,0 +1,153 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PORTFOLIO_H_
+#define PORTFOLIO_H_
+
+#include <string>
+#include <vector>
+#include "Solver.h"
+#include "RaceLog.h"
+
+class SolverManager;
+class ResultCache;
+class PortfolioSelector;
+
+//Everything NSolv needs to know about a single configured solver.
+struct SolverDescription
+{
+	std::string name;
+	std::string cmdOptions; //empty for no cmd line options
+	bool inputOnStdin;
+	std::vector<int> cpus; //CPUs from the configuration file (<solver>.cpus). Empty for automatic placement.
+	unsigned int tier; //See SolverManager::setTierDelay()
+	ResourceLimits limits;
+
+	SolverDescription(const std::string& _name, const std::string& _cmdOptions, bool _inputOnStdin);
+};
+
+/* The parsed configuration (command line and configuration file) of NSolv.
+ * This is built once by parseOptions() and can then be used to create
+ * as many SolverManagers (one per query) as needed.
+ */
+class Portfolio
+{
+	public:
+		Portfolio(double _timeout, bool _loggingMode);
+		~Portfolio();
+
+		void addSolver(const SolverDescription& s);
+
+		/* Create a SolverManager for "inputFile" with all the solvers of the portfolio added.
+		 * Races that run at the same time should use different "slot"s so that their
+		 * solvers are placed on different CPUs (see enablePinning()).
+		 */
+		SolverManager* createSolverManager(const std::string& inputFile, unsigned int slot=0) const;
+
+		const std::vector<SolverDescription>& getSolvers() const;
+		size_t getNumberOfSolvers() const;
+
+		//Number of solvers run for each query (fewer than getNumberOfSolvers() with selection).
+		size_t getNumberOfRacingSolvers() const;
+
+		double getTimeout() const;
+		bool isLoggingMode() const;
+
+		//Seconds between starting one tier of solvers and the next.
+		void setTierDelay(double delay);
+
+		//Format of the log in logging mode.
+		void setLogFormat(RaceLog::Format format);
+
+		//Seconds between SIGTERM and SIGKILL for solvers still running after a race.
+		void setKillGrace(double grace);
+
+		//Give solvers a copy of the input in memory rather than the file (see SharedInput).
+		void setShareInput(bool enabled);
+
+		//Start solvers with clone(CLONE_VM) rather than fork() (see SolverManager::setFastSpawn()).
+		void setFastSpawn(bool enabled);
+
+		//Keep solvers alive between queries (see SolverPool). Only used by the daemon.
+		void setPoolMode(bool enabled, unsigned int workers);
+		bool isPoolMode() const;
+
+		//Number of daemon processes that each own a SolverPool
+		unsigned int getPoolWorkers() const;
+
+		//Identifies the solvers and their options. Used to key the result cache.
+		std::string getKey() const;
+
+		//Remember answers in "directory" (see ResultCache). Must be called after all solvers are added.
+		void enableResultCache(const std::string& directory, unsigned long long maxBytes);
+
+		//Returns NULL if the cache is disabled.
+		ResultCache* getResultCache() const;
+
+		/* Pin every solver without its own CPUs to a CPU picked from the machine's
+		 * topology (see CpuTopology). Must be called after all solvers are added.
+		 */
+		void enablePinning();
+
+		/* Only run the "top" solvers predicted to do best on each query by the logs
+		 * in "history" (see PortfolioSelector). Must be called after all solvers are added.
+		 */
+		void enableSelection(const std::string& history, unsigned int top, double exploreRate);
+
+		/* Give every solver without a timeout of its own (see ResourceLimits) "slack" times
+		 * the time it needed on "percentile" percent of the similar queries it solved according
+		 * to "history" (see PortfolioSelector::predictTimeout()). Not used in logging mode
+		 * because the log would then only ever learn shorter times.
+		 */
+		void enableAdaptiveTimeouts(const std::string& history, double percentile, double slack);
+
+	private:
+		std::vector<SolverDescription> solvers;
+		double timeout;
+		bool loggingMode;
+		double tierDelay;
+		double killGrace;
+		RaceLog::Format logFormat;
+		bool shareInput;
+		bool fastSpawn;
+		bool poolMode;
+		unsigned int poolWorkers;
+		ResultCache* resultCache;
+
+		//CPUs in the order they are handed out. Empty if pinning is disabled.
+		std::vector<int> placement;
+
+		//NULL if there is no history to learn from
+		PortfolioSelector* selector;
+		unsigned int selectTop; //0 if every solver is run for every query
+		double adaptivePercentile; //0 if adaptive timeouts are disabled
+		double adaptiveSlack;
+
+		//Create "selector" and train it on "history" (if it isn't empty).
+		void createSelector(const std::string& history, unsigned int top, double exploreRate);
+
+		//Indexes of the solvers to run on "inputFile" and their limits for it.
+		void chooseSolvers(const std::string& inputFile, std::vector<size_t>& chosen,
+				std::vector<ResourceLimits>& limits) const;
+
+		//Not copyable because we own the cache
+		Portfolio(const Portfolio&);
+		Portfolio& operator=(const Portfolio&);
+};
+
+#endif /* PORTFOLIO_H_ */
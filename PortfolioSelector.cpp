@@ -0,0 +1,231 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PortfolioSelector.h"
+#include "RaceLog.h"
+#include "global.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+//Used to sort solvers by their predicted score
+struct ByScore
+{
+	const vector<double>& scores;
+	ByScore(const vector<double>& _scores) : scores(_scores) { }
+	bool operator()(size_t a, size_t b) const { return scores[a] < scores[b] || (scores[a] == scores[b] && a < b); }
+};
+
+PortfolioSelector::Score::Score() :
+runs(0), solved(0), solvedTime(0.0), unsolvedTime(0.0), solvedTimes()
+{
+
+}
+
+PortfolioSelector::PortfolioSelector(const std::vector<std::string>& _solvers, unsigned int _top, double _exploreRate) :
+solvers(_solvers), top(_top), exploreRate(_exploreRate), groups(), longestTime(0.0), records(0)
+{
+
+}
+
+unsigned long PortfolioSelector::getNumberOfRecords() const
+{
+	return records;
+}
+
+void PortfolioSelector::groupKeys(const QueryFeatures& features, std::string keys[LEVELS]) const
+{
+	stringstream s;
+	s << features.logic << " " << features.theories;
+	keys[1]=s.str();
+
+	s << " " << features.getSizeClass() << " " << features.getAssertionClass();
+	keys[0]=s.str();
+
+	keys[2]=features.logic;
+	keys[3]="*";
+}
+
+bool PortfolioSelector::train(const std::string& path)
+{
+	vector<RaceRecord> log;
+	if(!RaceLog::read(path,log,verbose))
+	{
+		if(verbose) cerr << "PortfolioSelector: Couldn't open log " << path << endl;
+		return false;
+	}
+
+	//Solver name -> index in the portfolio
+	map<string,size_t> index;
+	for(size_t i=0; i < solvers.size(); ++i)
+		index[solvers[i]]=i;
+
+	//Only races whose features were logged can be used.
+	for(vector<RaceRecord>::const_iterator r=log.begin(); r != log.end(); ++r)
+	{
+		QueryFeatures features;
+		if(r->features.empty() || !features.parse(r->features))
+			continue;
+
+		map<size_t, pair<double,bool> > runs;
+		for(vector<SolverRun>::const_iterator run=r->runs.begin(); run != r->runs.end(); ++run)
+		{
+			map<string,size_t>::const_iterator i=index.find(run->solver);
+			if(i == index.end() || run->answer == "skipped")
+				continue;
+
+			runs[i->second]=make_pair(run->time, run->answer == "sat" || run->answer == "unsat");
+		}
+
+		if(!runs.empty())
+			addRecord(features,runs);
+	}
+
+	//For predictTimeout()
+	for(Groups::iterator g=groups.begin(); g != groups.end(); ++g)
+	{
+		for(vector<Score>::iterator s=g->second.begin(); s != g->second.end(); ++s)
+			sort(s->solvedTimes.begin(),s->solvedTimes.end());
+	}
+
+	if(verbose) cerr << "PortfolioSelector: Learnt from " << records << " queries in " << path << endl;
+	return true;
+}
+
+void PortfolioSelector::addRecord(const QueryFeatures& features, const std::map<size_t, std::pair<double,bool> >& runs)
+{
+	string keys[LEVELS];
+	groupKeys(features,keys);
+
+	for(unsigned int level=0; level < LEVELS; ++level)
+	{
+		vector<Score>& scores=groups[keys[level]];
+		scores.resize(solvers.size());
+
+		for(map<size_t, pair<double,bool> >::const_iterator r=runs.begin(); r != runs.end(); ++r)
+		{
+			Score& s=scores[r->first];
+			s.runs++;
+			if(r->second.second)
+			{
+				s.solved++;
+				s.solvedTime+=r->second.first;
+				s.solvedTimes.push_back(r->second.first);
+			}
+			else
+				s.unsolvedTime=max(s.unsolvedTime,r->second.first);
+		}
+	}
+
+	for(map<size_t, pair<double,bool> >::const_iterator r=runs.begin(); r != runs.end(); ++r)
+		longestTime=max(longestTime,r->second.first);
+
+	records++;
+}
+
+double PortfolioSelector::predict(const QueryFeatures& features, size_t solver) const
+{
+	string keys[LEVELS];
+	groupKeys(features,keys);
+
+	//Failing is worse than the slowest answer we've seen.
+	double penalty=2.0 * max(longestTime,1.0);
+
+	for(unsigned int level=0; level < LEVELS; ++level)
+	{
+		Groups::const_iterator g=groups.find(keys[level]);
+		if(g == groups.end())
+			continue;
+
+		const Score& s=g->second[solver];
+		if(s.runs < MIN_SAMPLES)
+			continue;
+
+		return (s.solvedTime + (s.runs - s.solved) * penalty) / s.runs;
+	}
+
+	//Not enough history so rank it first to get some.
+	return -1.0;
+}
+
+double PortfolioSelector::predictTimeout(const QueryFeatures& features, size_t solver, double percentile) const
+{
+	string keys[LEVELS];
+	groupKeys(features,keys);
+
+	for(unsigned int level=0; level < LEVELS; ++level)
+	{
+		Groups::const_iterator g=groups.find(keys[level]);
+		if(g == groups.end())
+			continue;
+
+		const vector<double>& times=g->second[solver].solvedTimes;
+		if(times.size() < MIN_SAMPLES)
+			continue;
+
+		//Nearest rank
+		size_t rank=static_cast<size_t>(ceil(percentile / 100.0 * times.size()));
+		rank= rank > 0? rank : 1;
+		rank= rank < times.size()? rank : times.size();
+		return times[rank - 1];
+	}
+
+	return 0.0;
+}
+
+void PortfolioSelector::select(const QueryFeatures& features, std::vector<size_t>& chosen) const
+{
+	chosen.clear();
+
+	vector<double> scores(solvers.size());
+	vector<size_t> ranking(solvers.size());
+	for(size_t i=0; i < solvers.size(); ++i)
+	{
+		scores[i]=predict(features,i);
+		ranking[i]=i;
+	}
+
+	sort(ranking.begin(),ranking.end(),ByScore(scores));
+
+	size_t k= top < solvers.size()? top : solvers.size();
+	chosen.assign(ranking.begin(),ranking.begin() + k);
+
+	if(k == 0 || k == solvers.size() || exploreRate <= 0.0)
+		return;
+
+	/* This is called in forked processes (batch, daemon) so seed from
+	 * the PID and the time rather than once at start up.
+	 */
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	unsigned int seed=static_cast<unsigned int>(now.tv_nsec) ^ (static_cast<unsigned int>(getpid()) << 16);
+
+	if(rand_r(&seed) < exploreRate * RAND_MAX)
+	{
+		size_t other=k + rand_r(&seed) % (solvers.size() - k);
+		if(verbose) cerr << "PortfolioSelector: Exploring with " << solvers[ranking[other]] << " instead of " <<
+				solvers[chosen.back()] << endl;
+		chosen.back()=ranking[other];
+	}
+}
@@ -0,0 +1,105 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PORTFOLIOSELECTOR_H_
+#define PORTFOLIOSELECTOR_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include "QueryFeatures.h"
+
+/* Picks the solvers most likely to win a query from the logs of earlier
+ * runs in logging mode.
+ *
+ * Every logged run of a solver is scored PAR-2 style: its time if it
+ * answered sat or unsat, otherwise twice the longest time in the logs.
+ * Scores are averaged per solver in groups of similar queries (see
+ * QueryFeatures):
+ *
+ * - same logic, theories, size class and assertion class
+ * - same logic and theories
+ * - same logic
+ * - all queries
+ *
+ * A solver is ranked by the most specific group it has at least
+ * MIN_SAMPLES runs in. Solvers that have (almost) never been run rank
+ * first so that they get a chance to build up a history.
+ *
+ * With probability "exploreRate" one of the chosen solvers is swapped for
+ * a random one that wasn't chosen so the logs keep covering every solver.
+ *
+ * The same groups give each solver a timeout (see predictTimeout()) from
+ * the times it took on the similar queries it solved.
+ */
+class PortfolioSelector
+{
+	public:
+		//"solvers" are the names of the solvers in the portfolio (indexes refer to this).
+		PortfolioSelector(const std::vector<std::string>& solvers, unsigned int _top, double _exploreRate);
+
+		//Learn from the log file "path". Returns false if it couldn't be read.
+		bool train(const std::string& path);
+
+		//Indexes of the solvers to run for a query with "features" (best first).
+		void select(const QueryFeatures& features, std::vector<size_t>& chosen) const;
+
+		/* Seconds within which "solver" answered "percentile" percent of the queries
+		 * like "features" that it solved. 0 if it hasn't solved enough of them.
+		 */
+		double predictTimeout(const QueryFeatures& features, size_t solver, double percentile) const;
+
+		//Number of runs learnt from by train().
+		unsigned long getNumberOfRecords() const;
+
+	private:
+		struct Score
+		{
+			unsigned long runs;
+			unsigned long solved;
+			double solvedTime; //Total time of the solved runs
+			double unsolvedTime; //Longest time of the unsolved runs
+			std::vector<double> solvedTimes; //Sorted once training is done
+
+			Score();
+		};
+
+		//Group key -> solver index -> score
+		typedef std::map<std::string, std::vector<Score> > Groups;
+
+		static const unsigned long MIN_SAMPLES=3;
+		static const unsigned int LEVELS=4;
+
+		std::vector<std::string> solvers;
+		unsigned int top;
+		double exploreRate;
+		Groups groups;
+		double longestTime;
+		unsigned long records;
+
+		//Keys of the groups "features" belongs to, most specific first.
+		void groupKeys(const QueryFeatures& features, std::string keys[LEVELS]) const;
+
+		//Record one finished query.
+		void addRecord(const QueryFeatures& features, const std::map<size_t, std::pair<double,bool> >& runs);
+
+		//Lower is better
+		double predict(const QueryFeatures& features, size_t solver) const;
+};
+
+#endif /* PORTFOLIOSELECTOR_H_ */
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Protocol.h"
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+using namespace std;
+
+//How much of a payload readFrame() reads at a time
+static const size_t READ_PIECE=1024 * 1024;
+
+//Write exactly "length" bytes, retrying on short writes.
+static bool writeAll(int fd, const char* data, size_t length)
+{
+	while(length > 0)
+	{
+		//Use send() so that a client hanging up gives EPIPE rather than SIGPIPE.
+		ssize_t result=::send(fd,data,length,MSG_NOSIGNAL);
+
+		if(result == -1 && errno == ENOTSOCK)
+			result=::write(fd,data,length);
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result <= 0)
+			return false;
+
+		data+=result;
+		length-=result;
+	}
+
+	return true;
+}
+
+//Read exactly "length" bytes, retrying on short reads.
+static bool readAll(int fd, char* data, size_t length)
+{
+	while(length > 0)
+	{
+		ssize_t result=::read(fd,data,length);
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result <= 0)
+			return false; //error or peer closed connection
+
+		data+=result;
+		length-=result;
+	}
+
+	return true;
+}
+
+bool Protocol::writeFrame(int fd, uint32_t type, const std::string& payload)
+{
+	if(payload.size() > MAX_PAYLOAD_SIZE)
+		return false;
+
+	uint32_t header[2];
+	header[0]=htonl(type);
+	header[1]=htonl(static_cast<uint32_t>(payload.size()));
+
+	if(!writeAll(fd,reinterpret_cast<const char*>(header),sizeof(header)))
+		return false;
+
+	return writeAll(fd,payload.data(),payload.size());
+}
+
+bool Protocol::readFrame(int fd, uint32_t& type, std::string& payload, uint32_t maxLength)
+{
+	uint32_t header[2];
+
+	if(!readAll(fd,reinterpret_cast<char*>(header),sizeof(header)))
+		return false;
+
+	type=ntohl(header[0]);
+	uint32_t length=ntohl(header[1]);
+
+	if(length > maxLength || length > MAX_PAYLOAD_SIZE)
+		return false;
+
+	//In pieces so that we only allocate what the peer has really sent.
+	payload.clear();
+	while(payload.size() < length)
+	{
+		size_t done=payload.size();
+		size_t piece=min(static_cast<size_t>(length) - done,READ_PIECE);
+		payload.resize(done + piece);
+		if(!readAll(fd,&payload[done],piece))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <string>
+#include <stdint.h>
+
+/* The wire protocol spoken between the NSolv daemon and its clients over
+ * a Unix domain socket.
+ *
+ * Every message is a frame made of two 32-bit unsigned integers in network
+ * byte order followed by a payload.
+ *
+ * [ type/status ] [ payload length ] [ payload ... ]
+ *
+ * A client sends a frame with type REQUEST_SOLVE whose payload is the
+ * absolute path to a SMTLIBv2 file. The daemon replies with a frame with
+ * status RESPONSE_ANSWER whose payload is the output of the winning solver
+ * or a frame with status RESPONSE_NO_ANSWER (empty payload) if no solver
+ * gave a useful answer. A connection may be used for any number of requests.
+ */
+namespace Protocol
+{
+	enum FrameType
+	{
+		REQUEST_SOLVE=0,
+		RESPONSE_ANSWER=1,
+		RESPONSE_NO_ANSWER=2
+	};
+
+	/* Frames bigger than this are considered malformed. It leaves room for a
+	 * large model in a response.
+	 */
+	const uint32_t MAX_PAYLOAD_SIZE=256 * 1024 * 1024;
+
+	//A request only carries a path so the daemon rejects anything bigger than this.
+	const uint32_t MAX_REQUEST_SIZE=64 * 1024;
+
+	//Returns false on failure
+	bool writeFrame(int fd, uint32_t type, const std::string& payload);
+
+	/* Returns false on failure, if the peer closed the connection before a complete
+	 * frame was read or if the payload is longer than "maxLength". The payload grows
+	 * as it arrives so a length that is never sent is never allocated.
+	 */
+	bool readFrame(int fd, uint32_t& type, std::string& payload, uint32_t maxLength=MAX_PAYLOAD_SIZE);
+}
+
+#endif /* PROTOCOL_H_ */
@@ -0,0 +1,291 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "QueryFeatures.h"
+#include "SmtLexer.h"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const struct
+{
+	const char* name;
+	unsigned int bit;
+} theoryNames[] =
+{
+	{"bv", QueryFeatures::BITVECTORS},
+	{"array", QueryFeatures::ARRAYS},
+	{"int", QueryFeatures::INTEGERS},
+	{"real", QueryFeatures::REALS},
+	{"fp", QueryFeatures::FLOATING_POINT},
+	{"string", QueryFeatures::STRINGS},
+	{"quantifiers", QueryFeatures::QUANTIFIERS}
+};
+
+static const size_t NUMBER_OF_THEORIES=sizeof(theoryNames) / sizeof(theoryNames[0]);
+
+static inline bool tokenIs(const SmtLexer::Token& t, const char* s, size_t length)
+{
+	return t.length == length && memcmp(t.text,s,length) == 0;
+}
+
+static inline bool tokenStartsWith(const SmtLexer::Token& t, const char* s, size_t length)
+{
+	return t.length >= length && memcmp(t.text,s,length) == 0;
+}
+
+//The theory (if any) an atom belongs to. Only sorts and a few distinctive operators are checked.
+static unsigned int theoryOf(const SmtLexer::Token& t)
+{
+	if(t.length < 3)
+		return 0;
+
+	switch(t.text[0])
+	{
+		case 'b': return tokenStartsWith(t,"bv",2)? QueryFeatures::BITVECTORS : 0;
+		case 'B': return tokenIs(t,"BitVec",6)? QueryFeatures::BITVECTORS : 0;
+		case 'c': return tokenIs(t,"concat",6)? QueryFeatures::BITVECTORS : 0;
+		case 'e':
+			if(tokenIs(t,"extract",7)) return QueryFeatures::BITVECTORS;
+			return tokenIs(t,"exists",6)? QueryFeatures::QUANTIFIERS : 0;
+		case 'A': return tokenIs(t,"Array",5)? QueryFeatures::ARRAYS : 0;
+		case 's':
+			if(tokenIs(t,"select",6) || tokenIs(t,"store",5)) return QueryFeatures::ARRAYS;
+			return tokenStartsWith(t,"str.",4)? QueryFeatures::STRINGS : 0;
+		case 'I': return tokenIs(t,"Int",3)? QueryFeatures::INTEGERS : 0;
+		case 'R':
+			if(tokenIs(t,"Real",4)) return QueryFeatures::REALS;
+			return tokenIs(t,"RoundingMode",12)? QueryFeatures::FLOATING_POINT : 0;
+		case 'F': return tokenIs(t,"FloatingPoint",13)? QueryFeatures::FLOATING_POINT : 0;
+		case 'f':
+			if(tokenStartsWith(t,"fp.",3)) return QueryFeatures::FLOATING_POINT;
+			return tokenIs(t,"forall",6)? QueryFeatures::QUANTIFIERS : 0;
+		case 'S': return tokenIs(t,"String",6)? QueryFeatures::STRINGS : 0;
+		default: return 0;
+	}
+}
+
+QueryFeatures::QueryFeatures() :
+logic(), size(0), assertions(0), theories(0), checkSats(0)
+{
+
+}
+
+void QueryFeatures::compute(const char* data, size_t length)
+{
+	logic.clear();
+	size=length;
+	assertions=0;
+	theories=0;
+	checkSats=0;
+
+	SmtLexer lexer(data,length);
+	SmtLexer::Token t;
+	bool afterParen=false;
+	bool wantLogic=false;
+	while(lexer.next(t))
+	{
+		if(t.type != SmtLexer::ATOM)
+		{
+			afterParen= t.type == SmtLexer::LEFT_PAREN;
+			wantLogic=false;
+			continue;
+		}
+
+		if(wantLogic)
+			logic.assign(t.text,t.length);
+		else if(afterParen && tokenIs(t,"assert",6))
+			assertions++;
+		else if(afterParen && tokenIs(t,"set-logic",9))
+			wantLogic=true;
+		else if(afterParen && tokenStartsWith(t,"check-sat",9))
+			checkSats++;
+		else
+			theories|=theoryOf(t);
+
+		if(!tokenIs(t,"set-logic",9))
+			wantLogic=false;
+		afterParen=false;
+	}
+}
+
+bool QueryFeatures::computeFile(const std::string& path)
+{
+	int fd=::open(path.c_str(),O_RDONLY);
+	if(fd == -1)
+	{
+		cerr << "QueryFeatures: Couldn't open " << path << endl;
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(fd,&info) != 0)
+	{
+		perror("QueryFeatures: fstat:");
+		close(fd);
+		return false;
+	}
+
+	if(info.st_size == 0)
+	{
+		close(fd);
+		compute("",0);
+		return true;
+	}
+
+	void* data=mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	if(data == MAP_FAILED)
+	{
+		//Not something we can map (e.g. a pipe) so read it instead.
+		string contents;
+		char chunk[65536];
+		ssize_t bytes=0;
+		while((bytes=::read(fd,chunk,sizeof(chunk))) != 0)
+		{
+			if(bytes == -1 && errno == EINTR)
+				continue;
+
+			if(bytes == -1)
+			{
+				perror("QueryFeatures: read:");
+				close(fd);
+				return false;
+			}
+
+			contents.append(chunk,bytes);
+		}
+		close(fd);
+
+		compute(contents.data(),contents.size());
+		return true;
+	}
+
+	madvise(data,info.st_size,MADV_SEQUENTIAL);
+	compute(static_cast<const char*>(data),info.st_size);
+
+	munmap(data,info.st_size);
+	close(fd);
+	return true;
+}
+
+std::string QueryFeatures::toString() const
+{
+	stringstream s;
+	s << "logic=" << (logic.empty()? "none" : logic) << " size=" << size << " assertions=" << assertions << " theories=";
+
+	bool first=true;
+	for(size_t i=0; i < NUMBER_OF_THEORIES; ++i)
+	{
+		if(theories & theoryNames[i].bit)
+		{
+			s << (first? "" : ",") << theoryNames[i].name;
+			first=false;
+		}
+	}
+
+	if(first)
+		s << "none";
+
+	return s.str();
+}
+
+bool QueryFeatures::parse(const std::string& s)
+{
+	logic.clear();
+	size=0;
+	assertions=0;
+	theories=0;
+	checkSats=0;
+
+	istringstream in(s);
+	string field;
+	unsigned int found=0;
+	while(in >> field)
+	{
+		size_t equals=field.find('=');
+		if(equals == string::npos)
+			return false;
+
+		string key=field.substr(0,equals);
+		string value=field.substr(equals +1);
+
+		if(key == "logic")
+		{
+			logic= value == "none"? "" : value;
+			found|=1;
+		}
+		else if(key == "size")
+		{
+			size=strtoull(value.c_str(),NULL,10);
+			found|=2;
+		}
+		else if(key == "assertions")
+		{
+			assertions=strtoul(value.c_str(),NULL,10);
+			found|=4;
+		}
+		else if(key == "theories")
+		{
+			stringstream names(value);
+			string name;
+			while(getline(names,name,','))
+			{
+				for(size_t i=0; i < NUMBER_OF_THEORIES; ++i)
+				{
+					if(name == theoryNames[i].name)
+						theories|=theoryNames[i].bit;
+				}
+			}
+			found|=8;
+		}
+		//Ignore fields we don't know about so the format can grow.
+	}
+
+	return found == 15;
+}
+
+static unsigned int log2Class(unsigned long long n)
+{
+	unsigned int c=0;
+	while(n > 1)
+	{
+		n>>=1;
+		c++;
+	}
+
+	return c;
+}
+
+unsigned int QueryFeatures::getSizeClass() const
+{
+	return log2Class(size);
+}
+
+unsigned int QueryFeatures::getAssertionClass() const
+{
+	return log2Class(assertions);
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef QUERYFEATURES_H_
+#define QUERYFEATURES_H_
+
+#include <string>
+
+/* Cheap features of a SMTLIBv2 query used to predict which solvers will
+ * do well on it (see PortfolioSelector). They are found with a single pass
+ * of SmtLexer over the query.
+ *
+ * Features are written to the log in logging mode as
+ *
+ * #Features logic=<logic> size=<bytes> assertions=<n> theories=<t1>,<t2>,...
+ */
+class QueryFeatures
+{
+	public:
+		//Bits of "theories"
+		enum Theory
+		{
+			BITVECTORS=1,
+			ARRAYS=2,
+			INTEGERS=4,
+			REALS=8,
+			FLOATING_POINT=16,
+			STRINGS=32,
+			QUANTIFIERS=64
+		};
+
+		std::string logic; //Empty if there is no (set-logic)
+		unsigned long long size;
+		unsigned long assertions;
+		unsigned int theories;
+
+		//Number of (check-sat) commands. Not written to the log.
+		unsigned long checkSats;
+
+		QueryFeatures();
+
+		void compute(const char* data, size_t length);
+
+		//Returns false if "path" couldn't be read.
+		bool computeFile(const std::string& path);
+
+		//The form written to the log (without "#Features ").
+		std::string toString() const;
+
+		//The inverse of toString(). Returns false if "s" is malformed.
+		bool parse(const std::string& s);
+
+		//Coarse size of the query (log2 of the size) for grouping similar queries.
+		unsigned int getSizeClass() const;
+		unsigned int getAssertionClass() const;
+};
+
+#endif /* QUERYFEATURES_H_ */
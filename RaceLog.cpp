@@ -0,0 +1,990 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "RaceLog.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+using namespace std;
+
+/* A binary record is
+ *
+ * "NSLR" <length of the rest> <version>
+ * <query> <fingerprint> <features> <start time> <time> <result> <winner> <winning tier>
+ * <number of solvers> <solver>...
+ * <number of tier starts> (<tier> <time>)...
+ * <number of runs> (<solver> <tier> <cpus> <answer> <time> <exit code> <signal>
+ *     <user time> <system time> <max rss> <voluntary switches> <involuntary switches>)...
+ *
+ * Strings are a 32 bit length followed by the characters, unsigned
+ * integers are 32 bits, exit codes and signals are signed 32 bits,
+ * times are IEEE doubles and the other resource usage is 64 bits.
+ * Version 1 records have no resource usage.
+ */
+static const char BINARY_MAGIC[]="NSLR";
+static const uint8_t BINARY_VERSION=2;
+
+SolverRun::SolverRun() :
+solver(), tier(0), cpus(), answer(), time(0.0), exitCode(-1), signal(0), userTime(0.0), systemTime(0.0),
+maxRss(0), voluntarySwitches(0), involuntarySwitches(0), solverIndex(-1)
+{
+
+}
+
+RaceRecord::RaceRecord() :
+query(), fingerprint(), features(), startTime(0.0), time(0.0), result(), winner(), winningTier(0),
+solvers(), tierStarts(), runs()
+{
+
+}
+
+RaceLog::RaceLog() :
+fd(-1), format(TEXT)
+{
+
+}
+
+RaceLog::~RaceLog()
+{
+	if(fd != -1)
+		close(fd);
+}
+
+bool RaceLog::parseFormat(const std::string& name, Format& format)
+{
+	if(name == "text")
+		format=TEXT;
+	else if(name == "jsonl")
+		format=JSON_LINES;
+	else if(name == "binary")
+		format=BINARY;
+	else
+		return false;
+
+	return true;
+}
+
+bool RaceLog::open(const std::string& path, Format _format)
+{
+	if(fd != -1)
+		close(fd);
+
+	format=_format;
+	fd=::open(path.c_str(),O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,0644);
+	return fd != -1;
+}
+
+bool RaceLog::isOpen() const
+{
+	return fd != -1;
+}
+
+void RaceLog::setFormat(Format _format)
+{
+	format=_format;
+}
+
+bool RaceLog::append(const RaceRecord& record)
+{
+	if(fd == -1)
+		return false;
+
+	string encoded;
+	encode(record,format,encoded);
+
+	/* With O_APPEND the kernel moves to the end of the file and writes as one
+	 * step so records from other processes can't end up in the middle of ours.
+	 * Only a short write (e.g. the disk is full) splits it.
+	 */
+	size_t written=0;
+	while(written < encoded.size())
+	{
+		ssize_t result=::write(fd,encoded.data() + written,encoded.size() - written);
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			perror("RaceLog: Couldn't write to the log:");
+			return false;
+		}
+
+		written+=result;
+	}
+
+	return true;
+}
+
+/*
+ * Encoding
+ */
+
+static string formatTime(double t, int decimals)
+{
+	char buffer[64];
+	snprintf(buffer,sizeof(buffer),"%.*f",decimals,t);
+	return buffer;
+}
+
+static void encodeText(const RaceRecord& r, string& out)
+{
+	stringstream s;
+	s << "#Start\n";
+	s << "#Query " << formatTime(r.startTime,6) << " " << r.query << "\n";
+
+	s << "# " << r.solvers.size() << " solvers: ";
+	for(vector<string>::const_iterator i=r.solvers.begin(); i != r.solvers.end(); ++i)
+		s << *i << ",";
+	s << "\n";
+
+	if(!r.fingerprint.empty())
+		s << "#Fingerprint " << r.fingerprint << "\n";
+
+	if(!r.features.empty())
+		s << "#Features " << r.features << "\n";
+
+	for(vector<SolverRun>::const_iterator i=r.runs.begin(); i != r.runs.end(); ++i)
+	{
+		if(!i->cpus.empty())
+			s << "#CPU " << i->solver << " " << i->cpus << "\n";
+	}
+
+	s << "# [Solver name ] [ time (seconds)] [answer]\n";
+
+	for(vector< pair<unsigned int,double> >::const_iterator i=r.tierStarts.begin(); i != r.tierStarts.end(); ++i)
+		s << "#Tier " << i->first << " started " << formatTime(i->second,9) << "\n";
+
+	if(!r.winner.empty())
+	{
+		s << "#First solver to finish " << r.winner << "\n";
+		s << "#Winning tier " << r.winningTier << "\n";
+	}
+
+	for(vector<SolverRun>::const_iterator i=r.runs.begin(); i != r.runs.end(); ++i)
+	{
+		if(i->answer == "skipped")
+			s << "#Skipped " << i->solver << " tier " << i->tier << "\n";
+		else
+			s << i->solver << " " << formatTime(i->time,9) << " " << i->answer << "\n";
+	}
+
+	for(vector<SolverRun>::const_iterator i=r.runs.begin(); i != r.runs.end(); ++i)
+	{
+		if(i->exitCode != -1 || i->signal != 0)
+			s << "#Exit " << i->solver << " " << i->exitCode << " " << i->signal << "\n";
+	}
+
+	for(vector<SolverRun>::const_iterator i=r.runs.begin(); i != r.runs.end(); ++i)
+	{
+		if(i->exitCode != -1 || i->signal != 0)
+			s << "#Usage " << i->solver << " " << formatTime(i->userTime,6) << " " << formatTime(i->systemTime,6) << " " <<
+				i->maxRss << " " << i->voluntarySwitches << " " << i->involuntarySwitches << "\n";
+	}
+
+	s << "#Result " << r.result << " " << formatTime(r.time,9) << "\n";
+	s << "\n";
+	out=s.str();
+}
+
+static void encodeJsonString(const string& value, stringstream& s)
+{
+	s << '"';
+	for(string::const_iterator c=value.begin(); c != value.end(); ++c)
+	{
+		switch(*c)
+		{
+			case '"': s << "\\\""; break;
+			case '\\': s << "\\\\"; break;
+			case '\n': s << "\\n"; break;
+			case '\t': s << "\\t"; break;
+			case '\r': s << "\\r"; break;
+			default:
+				if(static_cast<unsigned char>(*c) < 0x20)
+				{
+					char buffer[8];
+					snprintf(buffer,sizeof(buffer),"\\u%04x",static_cast<unsigned char>(*c));
+					s << buffer;
+				}
+				else
+					s << *c;
+		}
+	}
+	s << '"';
+}
+
+static void encodeJson(const RaceRecord& r, string& out)
+{
+	stringstream s;
+	s << "{\"query\":"; encodeJsonString(r.query,s);
+	s << ",\"fingerprint\":"; encodeJsonString(r.fingerprint,s);
+	s << ",\"features\":"; encodeJsonString(r.features,s);
+	s << ",\"start\":" << formatTime(r.startTime,6);
+	s << ",\"time\":" << formatTime(r.time,9);
+	s << ",\"result\":"; encodeJsonString(r.result,s);
+
+	if(r.winner.empty())
+		s << ",\"winner\":null,\"winning_tier\":null";
+	else
+	{
+		s << ",\"winner\":"; encodeJsonString(r.winner,s);
+		s << ",\"winning_tier\":" << r.winningTier;
+	}
+
+	s << ",\"solvers\":[";
+	for(size_t i=0; i < r.solvers.size(); ++i)
+	{
+		if(i > 0) s << ",";
+		encodeJsonString(r.solvers[i],s);
+	}
+
+	s << "],\"tiers\":[";
+	for(size_t i=0; i < r.tierStarts.size(); ++i)
+	{
+		if(i > 0) s << ",";
+		s << "{\"tier\":" << r.tierStarts[i].first << ",\"start\":" << formatTime(r.tierStarts[i].second,9) << "}";
+	}
+
+	s << "],\"runs\":[";
+	for(size_t i=0; i < r.runs.size(); ++i)
+	{
+		const SolverRun& run=r.runs[i];
+		if(i > 0) s << ",";
+		s << "{\"solver\":"; encodeJsonString(run.solver,s);
+		s << ",\"tier\":" << run.tier;
+		s << ",\"cpus\":"; encodeJsonString(run.cpus,s);
+		s << ",\"answer\":"; encodeJsonString(run.answer,s);
+		s << ",\"time\":" << formatTime(run.time,9);
+		s << ",\"exit_code\":" << run.exitCode;
+		s << ",\"signal\":" << run.signal;
+		s << ",\"user_time\":" << formatTime(run.userTime,6);
+		s << ",\"system_time\":" << formatTime(run.systemTime,6);
+		s << ",\"max_rss_kib\":" << run.maxRss;
+		s << ",\"voluntary_switches\":" << run.voluntarySwitches;
+		s << ",\"involuntary_switches\":" << run.involuntarySwitches << "}";
+	}
+	s << "]}\n";
+	out=s.str();
+}
+
+static void putU32(string& out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value),sizeof(value));
+}
+
+static void putI32(string& out, int32_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value),sizeof(value));
+}
+
+static void putI64(string& out, int64_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value),sizeof(value));
+}
+
+static void putDouble(string& out, double value)
+{
+	out.append(reinterpret_cast<const char*>(&value),sizeof(value));
+}
+
+static void putString(string& out, const string& value)
+{
+	putU32(out,value.size());
+	out.append(value);
+}
+
+static void encodeBinary(const RaceRecord& r, string& out)
+{
+	string body;
+	body.push_back(static_cast<char>(BINARY_VERSION));
+	putString(body,r.query);
+	putString(body,r.fingerprint);
+	putString(body,r.features);
+	putDouble(body,r.startTime);
+	putDouble(body,r.time);
+	putString(body,r.result);
+	putString(body,r.winner);
+	putU32(body,r.winningTier);
+
+	putU32(body,r.solvers.size());
+	for(vector<string>::const_iterator i=r.solvers.begin(); i != r.solvers.end(); ++i)
+		putString(body,*i);
+
+	putU32(body,r.tierStarts.size());
+	for(vector< pair<unsigned int,double> >::const_iterator i=r.tierStarts.begin(); i != r.tierStarts.end(); ++i)
+	{
+		putU32(body,i->first);
+		putDouble(body,i->second);
+	}
+
+	putU32(body,r.runs.size());
+	for(vector<SolverRun>::const_iterator i=r.runs.begin(); i != r.runs.end(); ++i)
+	{
+		putString(body,i->solver);
+		putU32(body,i->tier);
+		putString(body,i->cpus);
+		putString(body,i->answer);
+		putDouble(body,i->time);
+		putI32(body,i->exitCode);
+		putI32(body,i->signal);
+		putDouble(body,i->userTime);
+		putDouble(body,i->systemTime);
+		putI64(body,i->maxRss);
+		putI64(body,i->voluntarySwitches);
+		putI64(body,i->involuntarySwitches);
+	}
+
+	out.assign(BINARY_MAGIC,4);
+	putU32(out,body.size());
+	out.append(body);
+}
+
+void RaceLog::encode(const RaceRecord& record, Format format, std::string& out)
+{
+	switch(format)
+	{
+		case TEXT: encodeText(record,out); break;
+		case JSON_LINES: encodeJson(record,out); break;
+		case BINARY: encodeBinary(record,out); break;
+	}
+}
+
+/*
+ * Decoding
+ */
+
+//Reads the fields of a binary record in order. Any read past the end makes it fail.
+class BinaryReader
+{
+	public:
+		BinaryReader(const char* _data, size_t _length) : data(_data), length(_length), position(0), ok(true) { }
+
+		bool good() const { return ok; }
+
+		uint32_t u32() { uint32_t v=0; get(&v,sizeof(v)); return v; }
+		int32_t i32() { int32_t v=0; get(&v,sizeof(v)); return v; }
+		int64_t i64() { int64_t v=0; get(&v,sizeof(v)); return v; }
+		double number() { double v=0.0; get(&v,sizeof(v)); return v; }
+		uint8_t byte() { uint8_t v=0; get(&v,sizeof(v)); return v; }
+
+		string str()
+		{
+			uint32_t size=u32();
+			if(!ok || size > length - position)
+			{
+				ok=false;
+				return string();
+			}
+
+			string s(data + position,size);
+			position+=size;
+			return s;
+		}
+
+	private:
+		const char* data;
+		size_t length;
+		size_t position;
+		bool ok;
+
+		void get(void* to, size_t size)
+		{
+			if(!ok || size > length - position)
+			{
+				ok=false;
+				return;
+			}
+
+			memcpy(to,data + position,size);
+			position+=size;
+		}
+};
+
+static bool decodeBinary(const char* data, size_t length, RaceRecord& r)
+{
+	BinaryReader in(data,length);
+	uint8_t version=in.byte();
+	if(version < 1 || version > BINARY_VERSION)
+		return false;
+
+	r.query=in.str();
+	r.fingerprint=in.str();
+	r.features=in.str();
+	r.startTime=in.number();
+	r.time=in.number();
+	r.result=in.str();
+	r.winner=in.str();
+	r.winningTier=in.u32();
+
+	uint32_t count=in.u32();
+	for(uint32_t i=0; i < count && in.good(); ++i)
+		r.solvers.push_back(in.str());
+
+	count=in.u32();
+	for(uint32_t i=0; i < count && in.good(); ++i)
+	{
+		unsigned int tier=in.u32();
+		r.tierStarts.push_back(make_pair(tier,in.number()));
+	}
+
+	count=in.u32();
+	for(uint32_t i=0; i < count && in.good(); ++i)
+	{
+		SolverRun run;
+		run.solver=in.str();
+		run.tier=in.u32();
+		run.cpus=in.str();
+		run.answer=in.str();
+		run.time=in.number();
+		run.exitCode=in.i32();
+		run.signal=in.i32();
+		if(version >= 2)
+		{
+			run.userTime=in.number();
+			run.systemTime=in.number();
+			run.maxRss=in.i64();
+			run.voluntarySwitches=in.i64();
+			run.involuntarySwitches=in.i64();
+		}
+		r.runs.push_back(run);
+	}
+
+	return in.good();
+}
+
+/* Just enough JSON to read back what encodeJson() writes. Members that
+ * aren't known are skipped so that records may gain fields later.
+ */
+class JsonReader
+{
+	public:
+		JsonReader(const string& _text) : text(_text), position(0), ok(true) { }
+
+		bool good() const { return ok; }
+
+		bool record(RaceRecord& r)
+		{
+			std::string key;
+			if(!begin('{'))
+				return false;
+
+			while(member(key))
+			{
+				if(key == "query") readString(r.query);
+				else if(key == "fingerprint") readString(r.fingerprint);
+				else if(key == "features") readString(r.features);
+				else if(key == "start") readNumber(r.startTime);
+				else if(key == "time") readNumber(r.time);
+				else if(key == "result") readString(r.result);
+				else if(key == "winner") { if(!null()) readString(r.winner); }
+				else if(key == "winning_tier") { if(!null()) r.winningTier=static_cast<unsigned int>(readNumber()); }
+				else if(key == "solvers") solvers(r.solvers);
+				else if(key == "tiers") tiers(r.tierStarts);
+				else if(key == "runs") runs(r.runs);
+				else skip();
+			}
+
+			return ok && end('}');
+		}
+
+	private:
+		const std::string& text;
+		size_t position;
+		bool ok;
+
+		void space()
+		{
+			while(position < text.size() && (text[position] == ' ' || text[position] == '\t' ||
+					text[position] == '\r' || text[position] == '\n'))
+				position++;
+		}
+
+		bool peek(char c)
+		{
+			space();
+			return ok && position < text.size() && text[position] == c;
+		}
+
+		bool begin(char c)
+		{
+			if(!peek(c))
+				return ok=false;
+
+			position++;
+			return true;
+		}
+
+		bool end(char c)
+		{
+			return begin(c);
+		}
+
+		/* Start the next member of an object and set "key". Returns false (and
+		 * consumes the "}") at the end of the object.
+		 */
+		bool member(std::string& key)
+		{
+			if(!ok || peek('}'))
+				return false;
+
+			if(text[position] == ',')
+				position++;
+
+			readString(key);
+			if(!begin(':'))
+				return false;
+			return ok;
+		}
+
+		//The same for the elements of an array
+		bool element()
+		{
+			if(!ok || peek(']'))
+				return false;
+
+			if(text[position] == ',')
+				position++;
+			return true;
+		}
+
+		bool null()
+		{
+			space();
+			if(text.compare(position,4,"null") != 0)
+				return false;
+
+			position+=4;
+			return true;
+		}
+
+		void readString(std::string& value)
+		{
+			value.clear();
+			if(!begin('"'))
+				return;
+
+			while(position < text.size() && text[position] != '"')
+			{
+				char c=text[position++];
+				if(c != '\\')
+				{
+					value.push_back(c);
+					continue;
+				}
+
+				if(position >= text.size())
+					break;
+
+				c=text[position++];
+				switch(c)
+				{
+					case 'n': value.push_back('\n'); break;
+					case 't': value.push_back('\t'); break;
+					case 'r': value.push_back('\r'); break;
+					case 'b': value.push_back('\b'); break;
+					case 'f': value.push_back('\f'); break;
+					case 'u':
+					{
+						//Only control characters are escaped like this by encodeJsonString()
+						if(position + 4 > text.size())
+						{
+							ok=false;
+							return;
+						}
+						value.push_back(static_cast<char>(strtol(text.substr(position,4).c_str(),NULL,16)));
+						position+=4;
+						break;
+					}
+					default: value.push_back(c);
+				}
+			}
+
+			if(position >= text.size())
+			{
+				ok=false;
+				return;
+			}
+			position++;
+		}
+
+		double readNumber()
+		{
+			double value=0.0;
+			readNumber(value);
+			return value;
+		}
+
+		void readNumber(double& value)
+		{
+			space();
+			const char* start=text.c_str() + position;
+			char* stop=NULL;
+			value=strtod(start,&stop);
+			if(stop == start)
+			{
+				ok=false;
+				return;
+			}
+			position+=stop - start;
+		}
+
+		void solvers(std::vector<std::string>& names)
+		{
+			if(!begin('['))
+				return;
+
+			while(element())
+			{
+				std::string name;
+				readString(name);
+				names.push_back(name);
+			}
+			end(']');
+		}
+
+		void tiers(std::vector< std::pair<unsigned int,double> >& starts)
+		{
+			if(!begin('['))
+				return;
+
+			while(element())
+			{
+				unsigned int tier=0;
+				double start=0.0;
+				std::string key;
+
+				if(!begin('{'))
+					return;
+				while(member(key))
+				{
+					if(key == "tier") tier=static_cast<unsigned int>(readNumber());
+					else if(key == "start") readNumber(start);
+					else skip();
+				}
+				end('}');
+				starts.push_back(make_pair(tier,start));
+			}
+			end(']');
+		}
+
+		void runs(std::vector<SolverRun>& runs)
+		{
+			if(!begin('['))
+				return;
+
+			while(element())
+			{
+				SolverRun run;
+				std::string key;
+
+				if(!begin('{'))
+					return;
+				while(member(key))
+				{
+					if(key == "solver") readString(run.solver);
+					else if(key == "tier") run.tier=static_cast<unsigned int>(readNumber());
+					else if(key == "cpus") readString(run.cpus);
+					else if(key == "answer") readString(run.answer);
+					else if(key == "time") readNumber(run.time);
+					else if(key == "exit_code") run.exitCode=static_cast<int>(readNumber());
+					else if(key == "signal") run.signal=static_cast<int>(readNumber());
+					else if(key == "user_time") readNumber(run.userTime);
+					else if(key == "system_time") readNumber(run.systemTime);
+					else if(key == "max_rss_kib") run.maxRss=static_cast<long>(readNumber());
+					else if(key == "voluntary_switches") run.voluntarySwitches=static_cast<long>(readNumber());
+					else if(key == "involuntary_switches") run.involuntarySwitches=static_cast<long>(readNumber());
+					else skip();
+				}
+				end('}');
+				runs.push_back(run);
+			}
+			end(']');
+		}
+
+		//Skip any value
+		void skip()
+		{
+			std::string ignored;
+			std::string key;
+
+			if(null())
+				return;
+
+			space();
+			if(position >= text.size())
+			{
+				ok=false;
+				return;
+			}
+
+			switch(text[position])
+			{
+				case '"':
+					readString(ignored);
+					break;
+
+				case '{':
+					position++;
+					while(member(key))
+						skip();
+					end('}');
+					break;
+
+				case '[':
+					position++;
+					while(element())
+						skip();
+					end(']');
+					break;
+
+				case 't':
+				case 'f':
+					while(position < text.size() && isalpha(text[position]))
+						position++;
+					break;
+
+				default:
+					readNumber();
+			}
+		}
+};
+
+//Builds records from the lines of text logs, including those written before RaceRecord existed.
+class TextReader
+{
+	public:
+		TextReader(std::vector<RaceRecord>& _records) : records(_records), record(), cpus(), exits(), usage(), pending(false) { }
+
+		void line(const string& l)
+		{
+			if(l == "#Start")
+			{
+				finish();
+				pending=true;
+				return;
+			}
+
+			if(l.empty())
+			{
+				finish();
+				return;
+			}
+
+			if(!pending)
+				return;
+
+			istringstream s(l);
+			string word;
+
+			if(l.compare(0,7,"#Query ") == 0)
+			{
+				s >> word >> record.startTime;
+				s.get();
+				getline(s,record.query);
+			}
+			else if(l.compare(0,2,"# ") == 0 && l.find(" solvers: ") != string::npos)
+			{
+				string names=l.substr(l.find(" solvers: ") + 10);
+				istringstream n(names);
+				string name;
+				while(getline(n,name,','))
+				{
+					if(!name.empty())
+						record.solvers.push_back(name);
+				}
+			}
+			else if(l.compare(0,13,"#Fingerprint ") == 0)
+				record.fingerprint=l.substr(13);
+			else if(l.compare(0,10,"#Features ") == 0)
+				record.features=l.substr(10);
+			else if(l.compare(0,5,"#CPU ") == 0)
+			{
+				string name;
+				s >> word >> name >> cpus[name];
+			}
+			else if(l.compare(0,6,"#Tier ") == 0)
+			{
+				unsigned int tier=0;
+				double start=0.0;
+				s >> word >> tier >> word >> start;
+				record.tierStarts.push_back(make_pair(tier,start));
+			}
+			else if(l.compare(0,24,"#First solver to finish ") == 0)
+				record.winner=l.substr(24);
+			else if(l.compare(0,14,"#Winning tier ") == 0)
+				s >> word >> word >> record.winningTier;
+			else if(l.compare(0,9,"#Skipped ") == 0)
+			{
+				SolverRun run;
+				s >> word >> run.solver >> word >> run.tier;
+				run.answer="skipped";
+				record.runs.push_back(run);
+			}
+			else if(l.compare(0,6,"#Exit ") == 0)
+			{
+				string name;
+				s >> word >> name;
+				s >> exits[name].first >> exits[name].second;
+			}
+			else if(l.compare(0,7,"#Usage ") == 0)
+			{
+				string name;
+				s >> word >> name;
+				SolverRun& u=usage[name];
+				s >> u.userTime >> u.systemTime >> u.maxRss >> u.voluntarySwitches >> u.involuntarySwitches;
+			}
+			else if(l.compare(0,8,"#Result ") == 0)
+				s >> word >> record.result >> record.time;
+			else if(l[0] != '#')
+			{
+				SolverRun run;
+				if(s >> run.solver >> run.time >> run.answer)
+					record.runs.push_back(run);
+			}
+		}
+
+		void finish()
+		{
+			if(!pending)
+				return;
+
+			for(vector<SolverRun>::iterator r=record.runs.begin(); r != record.runs.end(); ++r)
+			{
+				if(cpus.count(r->solver))
+					r->cpus=cpus[r->solver];
+
+				if(exits.count(r->solver))
+				{
+					r->exitCode=exits[r->solver].first;
+					r->signal=exits[r->solver].second;
+				}
+
+				if(usage.count(r->solver))
+				{
+					const SolverRun& u=usage[r->solver];
+					r->userTime=u.userTime;
+					r->systemTime=u.systemTime;
+					r->maxRss=u.maxRss;
+					r->voluntarySwitches=u.voluntarySwitches;
+					r->involuntarySwitches=u.involuntarySwitches;
+				}
+
+				if(r->solver == record.winner)
+				{
+					r->tier=record.winningTier;
+					if(record.result.empty())
+					{
+						record.result=r->answer;
+						record.time=r->time;
+					}
+				}
+			}
+
+			//Logs from before #Result
+			if(record.result.empty())
+				record.result= record.runs.empty() || record.runs.back().answer != "timeout"? "error" : "timeout";
+
+			records.push_back(record);
+			record=RaceRecord();
+			cpus.clear();
+			exits.clear();
+			usage.clear();
+			pending=false;
+		}
+
+	private:
+		std::vector<RaceRecord>& records;
+		RaceRecord record;
+		map<string,string> cpus;
+		map<string, pair<int,int> > exits;
+		map<string,SolverRun> usage; //Only the resource usage is used
+		bool pending;
+};
+
+bool RaceLog::read(const std::string& path, std::vector<RaceRecord>& records, bool verbose)
+{
+	ifstream in(path.c_str(),ios::in | ios::binary);
+	if(!in.good())
+		return false;
+
+	stringstream contents;
+	contents << in.rdbuf();
+	string data=contents.str();
+
+	TextReader text(records);
+	size_t position=0;
+	while(position < data.size())
+	{
+		if(data.compare(position,4,BINARY_MAGIC) == 0)
+		{
+			text.finish();
+
+			uint32_t length=0;
+			if(data.size() - position < 8)
+				break;
+			memcpy(&length,data.data() + position + 4,sizeof(length));
+			if(length > data.size() - position - 8)
+			{
+				if(verbose) cerr << "RaceLog: Truncated record at the end of " << path << endl;
+				break;
+			}
+
+			RaceRecord r;
+			if(decodeBinary(data.data() + position + 8,length,r))
+				records.push_back(r);
+			else if(verbose)
+				cerr << "RaceLog: Skipping broken binary record in " << path << endl;
+
+			position+=8 + length;
+			continue;
+		}
+
+		size_t end=data.find('\n',position);
+		if(end == string::npos)
+			end=data.size();
+		string line=data.substr(position,end - position);
+		position=end + 1;
+
+		if(!line.empty() && line[0] == '{')
+		{
+			text.finish();
+
+			RaceRecord r;
+			JsonReader json(line);
+			if(json.record(r))
+				records.push_back(r);
+			else if(verbose)
+				cerr << "RaceLog: Skipping broken JSON record in " << path << endl;
+			continue;
+		}
+
+		text.line(line);
+	}
+
+	text.finish();
+	return true;
+}
@@ -0,0 +1,132 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef RACELOG_H_
+#define RACELOG_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+//What happened to one solver of a race.
+struct SolverRun
+{
+	std::string solver;
+	unsigned int tier;
+	std::string cpus; //See CpuTopology::toString(). Empty if it wasn't pinned.
+
+	/* sat, unsat, unknown, error, memout, cpuout, timeout (still running when the
+	 * race was given up on) or skipped (its tier was never started).
+	 */
+	std::string answer;
+	double time; //Seconds from the start of the race. 0 if skipped.
+
+	int exitCode; //-1 unless it exited by itself
+	int signal; //0 unless it was killed by a signal
+
+	//What it used (from wait4()) including any children it waited for. 0 if it was never reaped.
+	double userTime; //Seconds
+	double systemTime; //Seconds
+	long maxRss; //KiB
+	long voluntarySwitches; //Mostly waiting for I/O
+	long involuntarySwitches; //Preempted, e.g. because the machine is oversubscribed
+
+	//Position of the solver in RaceRecord::solvers. Isn't written to the log so -1 once read back.
+	int solverIndex;
+
+	SolverRun();
+};
+
+//Everything logging mode records about one race.
+struct RaceRecord
+{
+	std::string query; //The input as given to NSolv
+	std::string fingerprint; //See Fingerprinter. Empty if it couldn't be computed.
+	std::string features; //See QueryFeatures::toString(). Empty if they couldn't be computed.
+	double startTime; //Seconds since the epoch
+	double time; //Seconds until the race was decided
+	std::string result; //sat, unsat, unknown, timeout or error
+	std::string winner; //Empty if no solver answered sat or unsat
+	unsigned int winningTier;
+	std::vector<std::string> solvers; //Every solver of the portfolio
+	std::vector< std::pair<unsigned int,double> > tierStarts; //Tier and seconds from the start. Only with several tiers.
+	std::vector<SolverRun> runs; //In the order the solvers finished
+
+	RaceRecord();
+};
+
+/* The log of logging mode. Each race is one RaceRecord which is encoded in
+ * memory and appended to the log with a single write() on a file opened
+ * with O_APPEND. Any number of NSolv processes can therefore share a log
+ * without their records being interleaved, and a race costs one system
+ * call rather than a flush per line.
+ *
+ * There are three formats and a log may mix them:
+ *
+ * - TEXT is the original line based format (see scripts/). A record
+ *   starts with "#Start" and ends with an empty line.
+ * - JSON_LINES is one JSON object per record and line.
+ * - BINARY is compact. Each record is "NSLR", its length as a 32 bit
+ *   integer and then its fields (see RaceLog.cpp). Numbers are in the
+ *   byte order of the machine that wrote them.
+ */
+class RaceLog
+{
+	public:
+		enum Format
+		{
+			TEXT,
+			JSON_LINES,
+			BINARY
+		};
+
+		RaceLog();
+		~RaceLog();
+
+		//"text", "jsonl" or "binary". Returns false for anything else.
+		static bool parseFormat(const std::string& name, Format& format);
+
+		//Open "path" for appending (it is created if needed). Returns false on failure.
+		bool open(const std::string& path, Format _format);
+
+		bool isOpen() const;
+
+		//Records appended from now on use "_format".
+		void setFormat(Format _format);
+
+		//Append "record" in one write(). Returns false on failure.
+		bool append(const RaceRecord& record);
+
+		static void encode(const RaceRecord& record, Format format, std::string& out);
+
+		/* Read every record in "path" (in any format) and append them to "records".
+		 * Broken records are skipped (and reported on stderr if "verbose"). Returns
+		 * false if "path" couldn't be read.
+		 */
+		static bool read(const std::string& path, std::vector<RaceRecord>& records, bool verbose=false);
+
+	private:
+		int fd;
+		Format format;
+
+		//Not copyable because we own the file descriptor
+		RaceLog(const RaceLog&);
+		RaceLog& operator=(const RaceLog&);
+};
+
+#endif /* RACELOG_H_ */
@@ -0,0 +1,246 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "ResponseParser.h"
+#include <cstring>
+
+using namespace std;
+
+static inline bool isWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+//Characters that end an atom
+static inline bool isDelimiter(char c)
+{
+	return isWhitespace(c) || c == '(' || c == ')' || c == ';' || c == '"' || c == '|';
+}
+
+ResponseParser::ResponseParser() :
+output(), expected(1), decided(false), result(Solver::ERROR), responses(), errors(0), position(0), tokenStart(0),
+inAtom(false), depth(0), inComment(false), inString(false), stringQuoteSeen(false), inQuotedSymbol(false)
+{
+
+}
+
+void ResponseParser::setExpectedResponses(unsigned int _expected)
+{
+	expected= _expected > 0? _expected : 1;
+}
+
+bool ResponseParser::feed(const char* data, size_t length)
+{
+	output.append(data,length);
+
+	if(!decided)
+		parse();
+
+	return decided;
+}
+
+void ResponseParser::finish()
+{
+	if(decided)
+		return;
+
+	//An atom at the very end is complete now.
+	if(inAtom && depth == 0)
+	{
+		inAtom=false;
+		atom(output.length());
+	}
+
+	if(!decided)
+	{
+		decided=true;
+		result=Solver::ERROR;
+	}
+}
+
+bool ResponseParser::isDecided() const
+{
+	return decided;
+}
+
+Solver::Result ResponseParser::getResult() const
+{
+	return decided? result : Solver::ERROR;
+}
+
+const std::vector<Solver::Result>& ResponseParser::getResponses() const
+{
+	return responses;
+}
+
+unsigned int ResponseParser::getNumberOfErrors() const
+{
+	return errors;
+}
+
+const std::string& ResponseParser::getOutput() const
+{
+	return output;
+}
+
+void ResponseParser::parse()
+{
+	size_t length=output.length();
+
+	while(position < length && !decided)
+	{
+		char c=output[position];
+
+		if(inComment)
+		{
+			if(c == '\n')
+				inComment=false;
+			position++;
+			continue;
+		}
+
+		if(inString)
+		{
+			if(stringQuoteSeen)
+			{
+				//"" is a double quote inside the string, anything else follows the string.
+				stringQuoteSeen=false;
+				if(c == '"')
+				{
+					position++;
+					continue;
+				}
+
+				//Look at "c" again now that the string has ended.
+				inString=false;
+				continue;
+			}
+
+			if(c == '"')
+				stringQuoteSeen=true;
+			position++;
+			continue;
+		}
+
+		if(inQuotedSymbol)
+		{
+			if(c == '|')
+				inQuotedSymbol=false;
+			position++;
+			continue;
+		}
+
+		if(inAtom)
+		{
+			if(!isDelimiter(c))
+			{
+				position++;
+				continue;
+			}
+
+			//Look at "c" again once the atom is dealt with.
+			inAtom=false;
+			atom(position);
+			continue;
+		}
+
+		switch(c)
+		{
+			case ';':
+				inComment=true;
+				break;
+
+			case '"':
+				inString=true;
+				break;
+
+			case '|':
+				inQuotedSymbol=true;
+				break;
+
+			case '(':
+				if(depth == 0)
+					tokenStart=position;
+				depth++;
+				break;
+
+			case ')':
+				//A stray ')' at the top level is ignored.
+				if(depth > 0)
+				{
+					depth--;
+					if(depth == 0)
+						list(position + 1);
+				}
+				break;
+
+			default:
+				//Atoms inside parentheses don't matter.
+				if(depth == 0 && !isWhitespace(c))
+				{
+					inAtom=true;
+					tokenStart=position;
+				}
+		}
+
+		position++;
+	}
+}
+
+void ResponseParser::atom(size_t end)
+{
+	const char* token=output.data() + tokenStart;
+	size_t length=end - tokenStart;
+
+	#define TOKEN_IS(s) (length == sizeof(s) -1 && memcmp(token,s,length) == 0)
+
+	if(TOKEN_IS("success") || TOKEN_IS("unsupported"))
+		return;
+
+	if(TOKEN_IS("sat"))
+		respond(Solver::SAT);
+	else if(TOKEN_IS("unsat"))
+		respond(Solver::UNSAT);
+	else if(TOKEN_IS("unknown"))
+		respond(Solver::UNKNOWN);
+	else
+		respond(Solver::ERROR);
+
+	#undef TOKEN_IS
+}
+
+void ResponseParser::list(size_t end)
+{
+	//Only (error ...) responses are of interest.
+	size_t index=tokenStart +1;
+	while(index < end && isWhitespace(output[index]))
+		index++;
+
+	if(end - index > 5 && output.compare(index,5,"error") == 0 && isDelimiter(output[index + 5]))
+		errors++;
+}
+
+void ResponseParser::respond(Solver::Result r)
+{
+	responses.push_back(r);
+	result=r;
+
+	//There is no point waiting for more responses if this one isn't useful.
+	if(r == Solver::UNKNOWN || r == Solver::ERROR || responses.size() >= expected)
+		decided=true;
+}
@@ -0,0 +1,106 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef RESPONSEPARSER_H_
+#define RESPONSEPARSER_H_
+
+#include <string>
+#include <vector>
+#include "Solver.h"
+
+/* Decides the answer of a solver from its output as it arrives, however
+ * the output is split up.
+ *
+ * The output is tokenized as SMTLIBv2 responses:
+ *
+ * - "success" and "unsupported" (general responses to other commands) are skipped.
+ * - Parenthesised responses are skipped as a whole. These are (error ...)
+ *   responses to earlier commands (which are counted) and the output of
+ *   (get-model), (get-value ...) and so on.
+ * - "sat", "unsat" and "unknown" are responses to (check-sat). Any other
+ *   symbol is taken as a broken response (ERROR).
+ *
+ * The result is decided as soon as "expected" (check-sat) responses have
+ * been seen, or straight away if one of them is unknown or broken. It is
+ * then the last response seen. If the output ends before that the result
+ * is ERROR.
+ *
+ * Everything given to feed() is kept so that it can be forwarded once the
+ * solver has won.
+ */
+class ResponseParser
+{
+	public:
+		ResponseParser();
+
+		//Number of (check-sat) responses needed (at least 1). Call before feed().
+		void setExpectedResponses(unsigned int _expected);
+
+		//Parse more output. Returns true once the result is decided.
+		bool feed(const char* data, size_t length);
+
+		//There won't be any more output. Always decides the result.
+		void finish();
+
+		bool isDecided() const;
+
+		//ERROR until decided.
+		Solver::Result getResult() const;
+
+		//(check-sat) responses seen so far.
+		const std::vector<Solver::Result>& getResponses() const;
+
+		//Number of (error ...) responses seen so far.
+		unsigned int getNumberOfErrors() const;
+
+		//All the output given to feed().
+		const std::string& getOutput() const;
+
+	private:
+		std::string output;
+		unsigned int expected;
+		bool decided;
+		Solver::Result result;
+		std::vector<Solver::Result> responses;
+		unsigned int errors;
+
+		//Where to carry on parsing "output" from.
+		size_t position;
+
+		//Start of the atom or parenthesised response being parsed.
+		size_t tokenStart;
+
+		bool inAtom;
+		unsigned int depth; //Of parentheses
+		bool inComment;
+		bool inString;
+		bool stringQuoteSeen; //Last character was a '"' inside a string (it might be "").
+		bool inQuotedSymbol;
+
+		void parse();
+
+		//Handle the top level atom output[tokenStart,end)
+		void atom(size_t end);
+
+		//Handle the parenthesised response output[tokenStart,end)
+		void list(size_t end);
+
+		void respond(Solver::Result r);
+};
+
+#endif /* RESPONSEPARSER_H_ */
@@ -0,0 +1,312 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "ResultCache.h"
+#include "Hash.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+using namespace std;
+
+//First line of every entry. Changing the entry format requires a new version.
+static const char ENTRY_MAGIC[] = "nsolv-cache-1";
+
+//Temporary files older than this (in seconds) were left behind by a crashed NSolv.
+static const time_t STALE_TEMPORARY_AGE=3600;
+
+//Fraction of the size bound to shrink to when evicting, so we don't evict on every store.
+static const double EVICTION_TARGET=0.9;
+
+ResultCache::ResultCache(const std::string& _directory, unsigned long long _maxBytes, const std::string& _portfolioKey, bool _verbose) :
+directory(_directory), maxBytes(_maxBytes), portfolioKey(_portfolioKey), verbose(_verbose), knownBytes(0),
+sizeKnown(false)
+{
+	if(mkdir(directory.c_str(),S_IRWXU) != 0 && errno != EEXIST)
+	{
+		cerr << "ResultCache: Failed to create cache directory " << directory << endl;
+		perror("mkdir:");
+	}
+}
+
+bool ResultCache::computeKey(const std::string& inputFile, std::string& key) const
+{
+	int fd=::open(inputFile.c_str(),O_RDONLY);
+	if(fd == -1)
+	{
+		cerr << "ResultCache: Couldn't open input file " << inputFile << endl;
+		return false;
+	}
+
+	Hasher h;
+	h.update(portfolioKey);
+
+	char chunk[65536];
+	ssize_t result=0;
+	while((result=::read(fd,chunk,sizeof(chunk))) != 0)
+	{
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			perror("ResultCache: Failed to read input file:");
+			close(fd);
+			return false;
+		}
+
+		h.update(chunk,result);
+	}
+
+	close(fd);
+	key=h.hexDigest();
+	return true;
+}
+
+bool ResultCache::lookup(const std::string& key, Solver::Result& result, std::string& output) const
+{
+	string path=getEntryPath(key);
+	int fd=::open(path.c_str(),O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	string entry;
+	char chunk[65536];
+	ssize_t bytes=0;
+	while((bytes=::read(fd,chunk,sizeof(chunk))) != 0)
+	{
+		if(bytes == -1 && errno == EINTR)
+			continue;
+
+		if(bytes == -1)
+		{
+			close(fd);
+			return false;
+		}
+
+		entry.append(chunk,bytes);
+	}
+	close(fd);
+
+	//Header is "<magic> <sat|unsat> <output length>\n"
+	size_t headerEnd=entry.find('\n');
+	if(headerEnd == string::npos)
+		return false;
+
+	istringstream header(entry.substr(0,headerEnd));
+	string magic;
+	string answer;
+	size_t length=0;
+	header >> magic >> answer >> length;
+
+	if(magic != ENTRY_MAGIC || entry.size() - headerEnd - 1 != length)
+	{
+		cerr << "ResultCache: Ignoring corrupt entry " << path << endl;
+		return false;
+	}
+
+	if(answer == Solver::resultToString(Solver::SAT))
+		result=Solver::SAT;
+	else if(answer == Solver::resultToString(Solver::UNSAT))
+		result=Solver::UNSAT;
+	else
+		return false;
+
+	output.assign(entry,headerEnd +1,length);
+
+	//Record the use for LRU eviction.
+	utimensat(AT_FDCWD,path.c_str(),NULL,0);
+
+	if(verbose) cerr << "ResultCache: Hit " << key << " (" << answer << ")" << endl;
+	return true;
+}
+
+void ResultCache::store(const std::string& key, Solver::Result result, const std::string& output) const
+{
+	if(result != Solver::SAT && result != Solver::UNSAT)
+		return;
+
+	stringstream header;
+	header << ENTRY_MAGIC << " " << Solver::resultToString(result) << " " << output.size() << "\n";
+	string entry=header.str() + output;
+
+	//It would only push everything else out and then be evicted itself.
+	if(entry.size() > maxBytes)
+	{
+		if(verbose) cerr << "ResultCache: Not storing " << key << " (" << entry.size() << " bytes is more than the cache holds)" << endl;
+		return;
+	}
+
+	string path=getEntryPath(key);
+	string subdirectory=path.substr(0,path.rfind('/'));
+	if(mkdir(subdirectory.c_str(),S_IRWXU) != 0 && errno != EEXIST)
+	{
+		perror("ResultCache: Failed to create cache directory:");
+		return;
+	}
+
+	stringstream s;
+	s << directory << "/tmp-" << getpid() << "-" << key;
+	string temporaryPath=s.str();
+
+	int fd=::open(temporaryPath.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,S_IRUSR | S_IWUSR);
+	if(fd == -1)
+	{
+		perror("ResultCache: Failed to create entry:");
+		return;
+	}
+
+
+	const char* data=entry.data();
+	size_t remaining=entry.size();
+	while(remaining > 0)
+	{
+		ssize_t written=::write(fd,data,remaining);
+		if(written == -1 && errno == EINTR)
+			continue;
+
+		if(written <= 0)
+		{
+			perror("ResultCache: Failed to write entry:");
+			close(fd);
+			unlink(temporaryPath.c_str());
+			return;
+		}
+
+		data+=written;
+		remaining-=written;
+	}
+	close(fd);
+
+	//Atomically publish the entry
+	if(rename(temporaryPath.c_str(),path.c_str()) != 0)
+	{
+		perror("ResultCache: Failed to publish entry:");
+		unlink(temporaryPath.c_str());
+		return;
+	}
+
+	if(verbose) cerr << "ResultCache: Stored " << key << " (" << Solver::resultToString(result) << ")" << endl;
+
+	/* Scanning the cache is expensive so only do it once we know of more than
+	 * it may hold. Eviction shrinks it below the bound so that takes a while.
+	 */
+	knownBytes+=entry.size();
+	if(!sizeKnown || knownBytes > maxBytes)
+		evict();
+}
+
+void ResultCache::evict() const
+{
+	struct Entry
+	{
+		string path;
+		time_t lastUsed;
+		unsigned long long size;
+
+		bool operator<(const Entry& other) const { return lastUsed < other.lastUsed; }
+	};
+
+	vector<Entry> entries;
+	unsigned long long total=0;
+	time_t now=time(NULL);
+
+	DIR* top=opendir(directory.c_str());
+	if(top == NULL)
+		return;
+
+	struct dirent* d=NULL;
+	while((d=readdir(top)) != NULL)
+	{
+		string name(d->d_name);
+		if(name == "." || name == "..")
+			continue;
+
+		string path=directory + "/" + name;
+		struct stat info;
+		if(lstat(path.c_str(),&info) != 0)
+			continue;
+
+		//Clean up after NSolv processes that died while storing.
+		if(name.compare(0,4,"tmp-") == 0)
+		{
+			if(S_ISREG(info.st_mode) && now - info.st_mtime > STALE_TEMPORARY_AGE)
+				unlink(path.c_str());
+			continue;
+		}
+
+		if(!S_ISDIR(info.st_mode))
+			continue;
+
+		DIR* sub=opendir(path.c_str());
+		if(sub == NULL)
+			continue;
+
+		struct dirent* e=NULL;
+		while((e=readdir(sub)) != NULL)
+		{
+			if(e->d_name[0] == '.')
+				continue;
+
+			Entry entry;
+			entry.path=path + "/" + e->d_name;
+			if(lstat(entry.path.c_str(),&info) != 0 || !S_ISREG(info.st_mode))
+				continue;
+
+			entry.lastUsed=info.st_mtime;
+			entry.size=info.st_size;
+			total+=entry.size;
+			entries.push_back(entry);
+		}
+		closedir(sub);
+	}
+	closedir(top);
+
+	sizeKnown=true;
+	knownBytes=total;
+	if(total <= maxBytes)
+		return;
+
+	sort(entries.begin(),entries.end());
+
+	unsigned long long target=static_cast<unsigned long long>(maxBytes * EVICTION_TARGET);
+	for(vector<Entry>::const_iterator i=entries.begin(); i != entries.end() && total > target; ++i)
+	{
+		//Another NSolv may have beaten us to it. That's fine.
+		if(unlink(i->path.c_str()) == 0 || errno == ENOENT)
+			total-=i->size;
+	}
+	knownBytes=total;
+
+	if(verbose) cerr << "ResultCache: Evicted entries. Cache is now " << total << " bytes." << endl;
+}
+
+std::string ResultCache::getEntryPath(const std::string& key) const
+{
+	return directory + "/" + key.substr(0,2) + "/" + key;
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+#include <string>
+#include "Solver.h"
+
+/* A persistent on disk cache of answers (sat|unsat) and the output of the
+ * winning solver, indexed by the hash of the query and of the portfolio.
+ *
+ * Entries live in <directory>/<first two hex digits>/<hash>. They are
+ * written to a temporary file and then rename()'d into place so that any
+ * number of NSolv processes can share a cache without locking. A reader
+ * sees either the whole entry or nothing.
+ *
+ * The size of the cache is bounded. Looking up an entry updates its
+ * modification time and when the cache is too big the least recently used
+ * entries are removed.
+ */
+class ResultCache
+{
+	public:
+		//_portfolioKey identifies the solvers and their options (see Portfolio::getKey()). "_verbose" reports hits and stores.
+		ResultCache(const std::string& _directory, unsigned long long _maxBytes, const std::string& _portfolioKey, bool _verbose=false);
+
+		//Compute the key of the query in "inputFile". Returns false on failure.
+		bool computeKey(const std::string& inputFile, std::string& key) const;
+
+		//Returns true on a hit.
+		bool lookup(const std::string& key, Solver::Result& result, std::string& output) const;
+
+		//Only sat and unsat answers are stored, and only if the entry fits in the size bound.
+		void store(const std::string& key, Solver::Result result, const std::string& output) const;
+
+		//Remove the least recently used entries until the cache fits in its size bound.
+		void evict() const;
+
+	private:
+		std::string directory;
+		unsigned long long maxBytes;
+		std::string portfolioKey;
+		bool verbose;
+
+		/* Size of the cache when evict() last scanned it plus what we have stored since.
+		 * Other NSolv processes' stores are only seen by the next scan.
+		 */
+		mutable unsigned long long knownBytes;
+		mutable bool sizeKnown;
+
+		std::string getEntryPath(const std::string& key) const;
+};
+
+#endif /* RESULTCACHE_H_ */
@@ -0,0 +1,528 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Session.h"
+#include "SolverManager.h"
+#include "SmtLib.h"
+#include "global.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <signal.h>
+
+using namespace std;
+
+Session::Session(const Portfolio& portfolio, unsigned int _resyncLimit) :
+members(), lastWinner(NULL), log(), pushPositions(), printSuccess(false), resyncLimit(_resyncLimit),
+markerSequence(0), events()
+{
+	originalTimeout=fromDouble(portfolio.getTimeout());
+
+	//A solver that dies while we write to it must not kill us.
+	signal(SIGPIPE,SIG_IGN);
+
+	const vector<SolverDescription>& solvers=portfolio.getSolvers();
+	for(vector<SolverDescription>::const_iterator s=solvers.begin(); s != solvers.end(); ++s)
+	{
+		Member* m=new Member();
+		m->solver=new InteractiveSolver(s->name,s->cmdOptions);
+		m->timesBehind=0;
+
+		if(!m->solver->start())
+		{
+			cerr << "Session: Failed to start solver " << s->name << endl;
+			delete m->solver;
+			delete m;
+			continue;
+		}
+
+		members.push_back(m);
+	}
+}
+
+Session::~Session()
+{
+	for(vector<Member*>::iterator m=members.begin(); m != members.end(); ++m)
+	{
+		delete (*m)->solver;
+		delete *m;
+	}
+}
+
+bool Session::run(int inputFd)
+{
+	if(members.empty())
+	{
+		cerr << "Session: There are no solvers to invoke." << endl;
+		return false;
+	}
+
+	string buffer;
+	char chunk[4096];
+
+	while(true)
+	{
+		ssize_t result=::read(inputFd,chunk,sizeof(chunk));
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			perror("Session: Failed to read commands");
+			return false;
+		}
+
+		if(result == 0)
+			break; //End of input is the same as (exit)
+
+		buffer.append(chunk,result);
+
+		vector<string> commands;
+		size_t consumed=0;
+		SmtLib::splitCommands(buffer,commands,&consumed);
+		buffer.erase(0,consumed);
+
+		for(vector<string>::const_iterator c=commands.begin(); c != commands.end(); ++c)
+		{
+			if(!handleCommand(*c))
+				return true;
+		}
+	}
+
+	if(buffer.find_first_not_of(" \t\r\n") != string::npos)
+		cerr << "Session: Warning input ended with an incomplete command." << endl;
+
+	return true;
+}
+
+bool Session::handleCommand(const std::string& command)
+{
+	string name=SmtLib::commandName(command);
+
+	if(verbose) cerr << "Session: Received " << command << endl;
+
+	if(name == "exit")
+		return false;
+
+	if(name == "check-sat" || name == "check-sat-assuming")
+	{
+		checkSat(command);
+		return true;
+	}
+
+	if(name.compare(0,4,"get-") == 0 || name == "echo")
+	{
+		askWinner(command);
+		return true;
+	}
+
+	if(name == "set-option" && command.find(":print-success") != string::npos)
+	{
+		//We print the "success" responses ourselves so the solvers don't need to.
+		printSuccess= SmtLib::commandArgument(command) == ":print-success" &&
+				command.find("true") != string::npos;
+		if(printSuccess) respond("success");
+		return true;
+	}
+
+	changeState(command,name);
+
+	if(printSuccess) respond("success");
+	return true;
+}
+
+void Session::changeState(const std::string& command, const std::string& name)
+{
+	for(vector<Member*>::iterator m=members.begin(); m != members.end(); ++m)
+	{
+		(*m)->solver->send(command + "\n");
+		(*m)->solver->flushInput();
+	}
+
+	if(name == "reset")
+	{
+		log.clear();
+		pushPositions.clear();
+		lastWinner=NULL;
+	}
+	else if(name == "reset-assertions")
+	{
+		//Only the options and the logic survive.
+		vector<string> kept;
+		for(vector<string>::const_iterator c=log.begin(); c != log.end(); ++c)
+		{
+			string n=SmtLib::commandName(*c);
+			if(n == "set-option" || n == "set-logic" || n == "set-info")
+				kept.push_back(*c);
+		}
+		log=kept;
+		pushPositions.clear();
+	}
+	else if(name == "push" || name == "pop")
+	{
+		int levels=atoi(SmtLib::commandArgument(command).c_str());
+		if(SmtLib::commandArgument(command).empty()) levels=1;
+
+		for(int level=0; level < levels; level++)
+		{
+			if(name == "push")
+			{
+				//Record each level separately so that any (pop n) can be replayed.
+				pushPositions.push_back(log.size());
+				log.push_back("(push 1)");
+			}
+			else if(!pushPositions.empty())
+			{
+				log.resize(pushPositions.back());
+				pushPositions.pop_back();
+			}
+		}
+	}
+	else
+		log.push_back(command);
+}
+
+void Session::checkSat(const std::string& command)
+{
+	//Bring everyone up to date and deal with those that have fallen behind.
+	vector<Member*> current(members);
+	for(vector<Member*>::iterator i=current.begin(); i != current.end(); ++i)
+	{
+		Member* m=*i;
+		catchUp(m);
+
+		if(m->solver->isRunning() && m->outstanding.empty())
+		{
+			m->timesBehind=0;
+			continue;
+		}
+
+		m->timesBehind++;
+		if(m->timesBehind > resyncLimit)
+		{
+			cerr << "Session: Solver " << m->solver->toString() << " keeps falling behind. Dropping it." << endl;
+			drop(m);
+			continue;
+		}
+
+		if(verbose) cerr << "Session: Solver " << m->solver->toString() << " has fallen behind. Resynchronising it." << endl;
+		if(!resync(m))
+			drop(m);
+	}
+
+	if(members.empty())
+	{
+		cerr << "Session: There are no solvers left." << endl;
+		respond("unknown");
+		return;
+	}
+
+	string marker=nextMarker();
+	for(vector<Member*>::iterator m=members.begin(); m != members.end(); ++m)
+	{
+		(*m)->solver->send(command + "\n(echo \"" + marker + "\")\n");
+		(*m)->solver->flushInput();
+		(*m)->outstanding.push_back(marker);
+	}
+
+	timespec deadline=getDeadline();
+	vector<Member*> racing(members);
+	lastWinner=NULL;
+	Solver::Result answer=Solver::UNKNOWN;
+
+	while(!racing.empty() && lastWinner == NULL)
+	{
+		if(!waitForOutput(racing,deadline))
+		{
+			cerr << "Timeout expired!" << endl;
+
+			//These are stuck so get them ready for the next (check-sat)
+			for(vector<Member*>::iterator m=racing.begin(); m != racing.end(); ++m)
+			{
+				if(!resync(*m))
+					drop(*m);
+			}
+			break;
+		}
+
+		vector<Member*> stillRacing;
+		for(vector<Member*>::iterator i=racing.begin(); i != racing.end(); ++i)
+		{
+			Member* m=*i;
+			bool running=m->solver->isRunning();
+
+			size_t markerPosition=m->solver->findMarker(marker);
+			bool complete= markerPosition != string::npos || !running;
+
+			Solver::Result result=Solver::ERROR;
+			if(!SmtLib::parseCheckSatResponse(m->solver->getOutput().substr(0,markerPosition),complete,result))
+			{
+				stillRacing.push_back(m);
+				continue;
+			}
+
+			if(verbose) cerr << "Session: Solver " << m->solver->toString() << " returned " << Solver::resultToString(result) << endl;
+
+			if(result == Solver::SAT || result == Solver::UNSAT)
+			{
+				lastWinner=m;
+				answer=result;
+				break;
+			}
+
+			if(result == Solver::ERROR)
+				cerr << "Result: Solver (" << m->solver->toString() << ") failed." << endl;
+		}
+
+		racing=stillRacing;
+	}
+
+	respond(Solver::resultToString(answer == Solver::ERROR? Solver::UNKNOWN : answer));
+}
+
+void Session::askWinner(const std::string& command)
+{
+	Member* m=lastWinner;
+
+	if(m == NULL)
+	{
+		//Nobody has won a race yet. Ask anyone who is up to date.
+		for(vector<Member*>::iterator i=members.begin(); i != members.end() && m == NULL; ++i)
+		{
+			catchUp(*i);
+			if((*i)->solver->isRunning() && (*i)->outstanding.empty())
+				m=*i;
+		}
+	}
+
+	if(m == NULL)
+	{
+		respond("(error \"nsolv: no solver is available to answer this command\")");
+		return;
+	}
+
+	string marker=nextMarker();
+	m->solver->send(command + "\n(echo \"" + marker + "\")\n");
+	m->outstanding.push_back(marker);
+
+	vector<Member*> watched(1,m);
+	timespec deadline=getDeadline();
+
+	//Wait until we have seen the responses to everything we sent before and this command.
+	while(true)
+	{
+		catchUp(m,1);
+
+		if(m->outstanding.size() == 1 && m->solver->findMarker(marker) != string::npos)
+			break;
+
+		if(!m->solver->isRunning())
+		{
+			respond("(error \"nsolv: solver " + m->solver->toString() + " exited\")");
+			if(!resync(m)) drop(m);
+			return;
+		}
+
+		if(!waitForOutput(watched,deadline))
+		{
+			cerr << "Timeout expired!" << endl;
+			respond("(error \"nsolv: timeout\")");
+			if(!resync(m)) drop(m);
+			return;
+		}
+	}
+
+	string response;
+	m->solver->consumeThroughMarker(marker,&response);
+	m->outstanding.pop_front();
+
+	//The response already ends with a new line
+	fwrite(response.data(),1,response.size(),stdout);
+	fflush(stdout);
+}
+
+void Session::catchUp(Member* m, size_t keep)
+{
+	if(!m->solver->isRunning())
+		return;
+
+	if(!m->solver->flushInput() || !m->solver->readOutput())
+	{
+		//It has exited.
+		m->solver->stop();
+		return;
+	}
+
+	while(m->outstanding.size() > keep && m->solver->consumeThroughMarker(m->outstanding.front(),NULL))
+		m->outstanding.pop_front();
+}
+
+bool Session::resync(Member* m)
+{
+	if(!m->solver->restart())
+	{
+		cerr << "Session: Failed to restart solver " << m->solver->toString() << endl;
+		return false;
+	}
+
+	m->outstanding.clear();
+
+	if(lastWinner == m)
+		lastWinner=NULL;
+
+	string replay;
+	for(vector<string>::const_iterator c=log.begin(); c != log.end(); ++c)
+	{
+		replay+=*c;
+		replay+='\n';
+	}
+
+	m->solver->send(replay);
+	m->solver->flushInput();
+	return true;
+}
+
+void Session::drop(Member* m)
+{
+	vector<Member*>::iterator i=find(members.begin(),members.end(),m);
+	if(i == members.end())
+		return;
+
+	if(lastWinner == m)
+		lastWinner=NULL;
+
+	members.erase(i);
+	delete m->solver;
+	delete m;
+}
+
+bool Session::waitForOutput(const std::vector<Member*>& watched, const timespec& deadline)
+{
+	//Unlike select() epoll copes with descriptors of any value.
+	vector<int> readFds;
+	vector<int> writeFds;
+
+	for(vector<Member*>::const_iterator m=watched.begin(); m != watched.end(); ++m)
+	{
+		if(!(*m)->solver->isRunning())
+			continue;
+
+		int fd=(*m)->solver->getReadFileDescriptor();
+		if(events.watchReadable(fd,NULL))
+			readFds.push_back(fd);
+
+		if((*m)->solver->hasPendingInput())
+		{
+			fd=(*m)->solver->getWriteFileDescriptor();
+			if(events.watchWritable(fd,NULL))
+				writeFds.push_back(fd);
+		}
+	}
+
+	//Everything we are watching has exited.
+	if(readFds.empty() && writeFds.empty())
+		return true;
+
+	if(timeoutEnabled())
+		events.setDeadline(deadline);
+
+	vector<EventEngine::Event> ready;
+	int numberOfEvents=events.wait(ready);
+	int error=errno;
+
+	for(vector<int>::const_iterator fd=readFds.begin(); fd != readFds.end(); ++fd)
+		events.unwatchReadable(*fd);
+	for(vector<int>::const_iterator fd=writeFds.begin(); fd != writeFds.end(); ++fd)
+		events.unwatchWritable(*fd);
+	events.clearDeadline();
+
+	if(numberOfEvents == -1)
+	{
+		errno=error;
+		if(errno != EINTR)
+			perror("Session: Something went wrong waiting for solvers via epoll");
+		return true;
+	}
+
+	set<int> readable;
+	set<int> writable;
+	bool expired=false;
+	for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+	{
+		if(e->type == EventEngine::READABLE)
+			readable.insert(e->fd);
+		else if(e->type == EventEngine::WRITABLE)
+			writable.insert(e->fd);
+		else if(e->type == EventEngine::TIMER)
+			expired=true;
+	}
+
+	if(expired && readable.empty() && writable.empty())
+		return false;
+
+	for(vector<Member*>::const_iterator i=watched.begin(); i != watched.end(); ++i)
+	{
+		InteractiveSolver* s=(*i)->solver;
+		if(!s->isRunning())
+			continue;
+
+		bool alive=true;
+		if(writable.count(s->getWriteFileDescriptor()))
+			alive=s->flushInput();
+
+		if(alive && readable.count(s->getReadFileDescriptor()))
+			alive=s->readOutput();
+
+		if(!alive)
+		{
+			if(verbose) cerr << "Session: Solver " << s->toString() << " exited." << endl;
+			s->stop();
+		}
+	}
+
+	return true;
+}
+
+std::string Session::nextMarker()
+{
+	stringstream s;
+	s << "nsolv-session-" << getpid() << "-" << ++markerSequence;
+	return s.str();
+}
+
+bool Session::timeoutEnabled()
+{
+	return originalTimeout.tv_sec != 0 || originalTimeout.tv_nsec != 0;
+}
+
+timespec Session::getDeadline()
+{
+	timespec current;
+	clock_gettime(CLOCK_MONOTONIC,&current);
+	return add(current,originalTimeout);
+}
+
+void Session::respond(const std::string& response)
+{
+	cout << response << endl;
+}
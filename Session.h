@@ -0,0 +1,120 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <time.h>
+#include "InteractiveSolver.h"
+#include "Portfolio.h"
+#include "EventEngine.h"
+
+/* An incremental SMTLIBv2 session. Commands are read from a stream (usually
+ * NSolv's standard input) and every solver of the portfolio is kept alive
+ * for the whole session.
+ *
+ * Commands that change the state of a solver (declarations, (assert),
+ * (push), (pop), ...) are forwarded to every solver. (check-sat) is
+ * forwarded to every solver and the first to answer (sat|unsat) wins.
+ * Commands like (get-model) are only sent to the solver that won the last
+ * (check-sat).
+ *
+ * Losing solvers carry on with the (check-sat) in the background. A solver
+ * that still hasn't answered an earlier (check-sat) when a new one arrives
+ * has fallen behind. It is restarted and the current assertion stack is
+ * replayed to it. A solver that falls behind too many races in a row is
+ * dropped from the session.
+ */
+class Session
+{
+	public:
+		//A solver is dropped after falling behind "_resyncLimit" races in a row.
+		Session(const Portfolio& portfolio, unsigned int _resyncLimit);
+		~Session();
+
+		//Read commands from "inputFd" until (exit) or end of input. Returns false on failure.
+		bool run(int inputFd);
+
+	private:
+		struct Member
+		{
+			InteractiveSolver* solver;
+
+			//Markers of the (echo "<marker>") responses that we haven't seen yet.
+			std::deque<std::string> outstanding;
+
+			//Number of races in a row this solver has fallen behind.
+			unsigned int timesBehind;
+		};
+
+		std::vector<Member*> members;
+		Member* lastWinner;
+
+		/* The commands needed to rebuild the current state of a solver.
+		 * pushPositions records where each (push 1) is in the log so (pop) can remove the level.
+		 */
+		std::vector<std::string> log;
+		std::vector<size_t> pushPositions;
+
+		bool printSuccess;
+		unsigned int resyncLimit;
+		unsigned long markerSequence;
+
+		timespec originalTimeout;
+
+		//Only watches the solvers while waitForOutput() waits.
+		EventEngine events;
+
+		//Returns false if the session should end.
+		bool handleCommand(const std::string& command);
+
+		//Forward a command that changes the state of the solvers and record it in the log.
+		void changeState(const std::string& command, const std::string& name);
+
+		void checkSat(const std::string& command);
+
+		//Send a command to the last winner and print its response.
+		void askWinner(const std::string& command);
+
+		/* Read what is available from a member and drop the responses we are no longer interested in.
+		 * The last "keep" outstanding responses are left alone.
+		 */
+		void catchUp(Member* m, size_t keep=0);
+
+		//Restart a member and replay the log to it. Returns false on failure.
+		bool resync(Member* m);
+
+		void drop(Member* m);
+
+		//Wait for output from "watched" until "deadline". Returns false on timeout.
+		bool waitForOutput(const std::vector<Member*>& watched, const timespec& deadline);
+
+		std::string nextMarker();
+
+		bool timeoutEnabled();
+
+		//Returns the deadline of something starting now.
+		timespec getDeadline();
+
+		void respond(const std::string& response);
+};
+
+#endif /* SESSION_H_ */
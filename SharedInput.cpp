@@ -0,0 +1,260 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "SharedInput.h"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+//For C libraries older than the kernel feature
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+static int createMemFd(const char* name, unsigned int flags)
+{
+#ifdef SYS_memfd_create
+	return syscall(SYS_memfd_create,name,flags);
+#else
+	errno=ENOSYS;
+	return -1;
+#endif
+}
+
+SharedInput::SharedInput() :
+fd(-1), path(), size(0), verbose(false)
+{
+
+}
+
+SharedInput::~SharedInput()
+{
+	if(fd != -1)
+		close(fd);
+}
+
+bool SharedInput::load(const std::string& inputPath)
+{
+	int input=::open(inputPath.c_str(),O_RDONLY | O_CLOEXEC);
+	if(input == -1)
+	{
+		cerr << "SharedInput: Couldn't open " << inputPath << endl;
+		return false;
+	}
+
+	bool loaded=load(input,inputPath);
+	close(input);
+	return loaded;
+}
+
+bool SharedInput::load(int input, const std::string& name)
+{
+	return create() && finish(copy(input),name);
+}
+
+bool SharedInput::load(const char* data, size_t length, const std::string& name)
+{
+	size=0;
+	return create() && finish(write(data,length),name);
+}
+
+void SharedInput::setVerbose(bool _verbose)
+{
+	verbose=_verbose;
+}
+
+bool SharedInput::create()
+{
+	fd=createMemFd("nsolv-input",MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd == -1)
+	{
+		if(verbose) perror("SharedInput: memfd_create:");
+		return false;
+	}
+
+	return true;
+}
+
+bool SharedInput::finish(bool copied, const std::string& name)
+{
+	//Nobody (not even us) can change the query from now on.
+	if(!copied || fcntl(fd,F_ADD_SEALS,F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+	{
+		if(copied) perror("SharedInput: Couldn't seal memfd:");
+		close(fd);
+		fd=-1;
+		return false;
+	}
+
+	stringstream s;
+	s << "/proc/self/fd/" << fd;
+	path=s.str();
+
+	//Solvers can only find the memfd through /proc
+	if(access(path.c_str(),R_OK) != 0)
+	{
+		if(verbose) cerr << "SharedInput: " << path << " isn't usable (is /proc mounted?)" << endl;
+		close(fd);
+		fd=-1;
+		path.clear();
+		return false;
+	}
+
+	if(verbose) cerr << "SharedInput: Copied " << size << " bytes of " << name << " to " << path << endl;
+	return true;
+}
+
+bool SharedInput::copy(int from)
+{
+	size=0;
+
+	//Copy in the kernel where we can, there's no need for the query to pass through us.
+	while(true)
+	{
+		ssize_t result=sendfile(fd,from,NULL,1 << 30);
+
+		if(result == 0)
+			return true;
+
+		if(result > 0)
+		{
+			size+=result;
+			continue;
+		}
+
+		if(errno == EINTR)
+			continue;
+
+		//Not something sendfile() can read (e.g. a pipe). Try splice() next.
+		if(errno == EINVAL || errno == ENOSYS)
+			break;
+
+		perror("SharedInput: sendfile:");
+		return false;
+	}
+
+	//Pipes (e.g. our stdin) can be spliced into the memfd without a copy through us.
+	while(true)
+	{
+		ssize_t result=splice(from,NULL,fd,NULL,1 << 20,SPLICE_F_MOVE | SPLICE_F_MORE);
+
+		if(result == 0)
+			return true;
+
+		if(result > 0)
+		{
+			size+=result;
+			continue;
+		}
+
+		if(errno == EINTR)
+			continue;
+
+		//Neither side is a pipe (e.g. a terminal) so copy it ourselves.
+		if(errno == EINVAL || errno == ENOSYS)
+			break;
+
+		perror("SharedInput: splice:");
+		return false;
+	}
+
+	char chunk[65536];
+	while(true)
+	{
+		ssize_t result=::read(from,chunk,sizeof(chunk));
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			perror("SharedInput: read:");
+			return false;
+		}
+
+		if(result == 0)
+			return true;
+
+		if(!write(chunk,result))
+			return false;
+	}
+}
+
+bool SharedInput::write(const char* data, size_t length)
+{
+	for(size_t written=0; written < length;)
+	{
+		ssize_t w=::write(fd,data + written,length - written);
+		if(w == -1 && errno == EINTR)
+			continue;
+
+		if(w == -1)
+		{
+			perror("SharedInput: write:");
+			return false;
+		}
+
+		written+=w;
+	}
+
+	size+=length;
+	return true;
+}
+
+bool SharedInput::isValid() const
+{
+	return fd != -1;
+}
+
+int SharedInput::getFd() const
+{
+	return fd;
+}
+
+const std::string& SharedInput::getPath() const
+{
+	return path;
+}
+
+unsigned long long SharedInput::getSize() const
+{
+	return size;
+}
+
+void SharedInput::shareWithChild() const
+{
+	if(fd != -1)
+		fcntl(fd,F_SETFD,0);
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SHAREDINPUT_H_
+#define SHAREDINPUT_H_
+
+#include <string>
+
+/* A copy of the input query in memory (a sealed memfd) that every solver
+ * of a race reads instead of the original file.
+ *
+ * The file is read once however many solvers there are, and the solvers
+ * can't see it change half way through the race because the memfd is
+ * sealed against writes.
+ *
+ * The memfd is close on exec. Call shareWithChild() in a forked child
+ * before exec() so that getPath() ("/proc/self/fd/<n>") refers to it in
+ * the solver too. Opening getPath() gives a file description of its own
+ * (with its own offset) so solvers reading it on stdin don't interfere.
+ */
+class SharedInput
+{
+	public:
+		SharedInput();
+		~SharedInput();
+
+		//Copy "path" into a new memfd. Returns false (and stays invalid) on failure.
+		bool load(const std::string& path);
+
+		//Copy everything that can be read from "input" (e.g. stdin). "name" is for messages.
+		bool load(int input, const std::string& name);
+
+		//Copy "length" bytes at "data" (a query held in memory).
+		bool load(const char* data, size_t length, const std::string& name);
+
+		//Report what is happening on stderr
+		void setVerbose(bool _verbose);
+
+		bool isValid() const;
+
+		//Only valid after load()
+		int getFd() const;
+		const std::string& getPath() const;
+		unsigned long long getSize() const;
+
+		//Let solvers exec()'d from this (forked) process inherit the memfd.
+		void shareWithChild() const;
+
+	private:
+		int fd;
+		std::string path;
+		unsigned long long size;
+		bool verbose;
+
+		//Create the (empty) memfd. Returns false on failure.
+		bool create();
+
+		//Seal the memfd once "copied" is in it and check that solvers can open it.
+		bool finish(bool copied, const std::string& name);
+
+		//Copy everything from "from" into "fd". Returns false on failure.
+		bool copy(int from);
+
+		//Write all of "data" to "fd". Returns false on failure.
+		bool write(const char* data, size_t length);
+
+		//Not copyable because we own the memfd
+		SharedInput(const SharedInput&);
+		SharedInput& operator=(const SharedInput&);
+};
+
+#endif /* SHAREDINPUT_H_ */
@@ -0,0 +1,317 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "SmtLexer.h"
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//SMTLIBv2 treats all control characters as whitespace
+static inline bool isWhitespace(unsigned char c)
+{
+	return c <= ' ';
+}
+
+static inline bool isDelimiter(unsigned char c)
+{
+	return isWhitespace(c) || c == '(' || c == ')' || c == '|' || c == ';' || c == '"';
+}
+
+#ifdef __SSE2__
+//Bit i is set if byte i of "x" is whitespace.
+static inline int whitespaceMask(__m128i x)
+{
+	const __m128i space=_mm_set1_epi8(' ');
+
+	//unsigned x <= ' '
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x,space),space));
+}
+
+//Bit i is set if byte i of "x" ends an atom.
+static inline int delimiterMask(__m128i x)
+{
+	const __m128i space=_mm_set1_epi8(' ');
+	__m128i d=_mm_cmpeq_epi8(_mm_max_epu8(x,space),space);
+	d=_mm_or_si128(d,_mm_cmpeq_epi8(x,_mm_set1_epi8('(')));
+	d=_mm_or_si128(d,_mm_cmpeq_epi8(x,_mm_set1_epi8(')')));
+	d=_mm_or_si128(d,_mm_cmpeq_epi8(x,_mm_set1_epi8('|')));
+	d=_mm_or_si128(d,_mm_cmpeq_epi8(x,_mm_set1_epi8(';')));
+	d=_mm_or_si128(d,_mm_cmpeq_epi8(x,_mm_set1_epi8('"')));
+	return _mm_movemask_epi8(d);
+}
+#endif
+
+//Size of the blocks classified at once with SSE2
+static const ptrdiff_t BLOCK_SIZE=64;
+
+SmtLexer::SmtLexer(const char* _begin, size_t length, bool _vectorised) :
+position(_begin), end(_begin + length), vectorised(_vectorised), blockStart(NULL), pending(0), delimiters(0)
+{
+#ifndef __SSE2__
+	vectorised=false;
+#endif
+}
+
+bool SmtLexer::isVectorised() const
+{
+	return vectorised;
+}
+
+const char* SmtLexer::findDelimiter(const char* p) const
+{
+#ifdef __SSE2__
+	if(vectorised)
+	{
+		//Never read past the end of the buffer.
+		while(end - p >= 16)
+		{
+			int mask=delimiterMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+			if(mask != 0)
+				return p + __builtin_ctz(mask);
+
+			p+=16;
+		}
+	}
+#endif
+
+	while(p != end && !isDelimiter(*p))
+		++p;
+
+	return p;
+}
+
+const char* SmtLexer::skipWhitespace(const char* p) const
+{
+	//Most whitespace is a single space so check that before using SSE2.
+	if(p == end || !isWhitespace(*p))
+		return p;
+
+#ifdef __SSE2__
+	if(vectorised)
+	{
+		while(end - p >= 16)
+		{
+			int mask=whitespaceMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) ^ 0xFFFF;
+			if(mask != 0)
+				return p + __builtin_ctz(mask);
+
+			p+=16;
+		}
+	}
+#endif
+
+	while(p != end && isWhitespace(*p))
+		++p;
+
+	return p;
+}
+
+void SmtLexer::loadBlock()
+{
+#ifdef __SSE2__
+	const __m128i space=_mm_set1_epi8(' ');
+	uint64_t structural=0;
+	uint64_t delimiter=0;
+
+	for(int i=0; i < 4; ++i)
+	{
+		__m128i x=_mm_loadu_si128(reinterpret_cast<const __m128i*>(position + 16*i));
+		__m128i whitespace=_mm_cmpeq_epi8(_mm_max_epu8(x,space),space);
+
+		//Bytes that start a token all by themselves
+		__m128i s=_mm_cmpeq_epi8(x,_mm_set1_epi8('('));
+		s=_mm_or_si128(s,_mm_cmpeq_epi8(x,_mm_set1_epi8(')')));
+		s=_mm_or_si128(s,_mm_cmpeq_epi8(x,_mm_set1_epi8('|')));
+		s=_mm_or_si128(s,_mm_cmpeq_epi8(x,_mm_set1_epi8(';')));
+		s=_mm_or_si128(s,_mm_cmpeq_epi8(x,_mm_set1_epi8('"')));
+
+		structural|=static_cast<uint64_t>(_mm_movemask_epi8(s)) << (16*i);
+		delimiter|=static_cast<uint64_t>(_mm_movemask_epi8(_mm_or_si128(s,whitespace))) << (16*i);
+	}
+
+	/* An atom starts at a byte that isn't a delimiter but follows one. "position"
+	 * is always at the end of a token so the first byte counts as following one.
+	 */
+	uint64_t atomStarts=~delimiter & ((delimiter << 1) | 1);
+
+	blockStart=position;
+	delimiters=delimiter;
+	pending=structural | atomStarts;
+#endif
+}
+
+bool SmtLexer::next(Token& t)
+{
+#ifdef __SSE2__
+	while(vectorised)
+	{
+		if(pending == 0)
+		{
+			//Everything left in the last block was whitespace
+			if(blockStart != NULL && position < blockStart + BLOCK_SIZE)
+				position=blockStart + BLOCK_SIZE;
+
+			//Leave the last few bytes to the scalar code so we never read past the end.
+			if(end - position < BLOCK_SIZE)
+			{
+				blockStart=NULL;
+				break;
+			}
+
+			loadBlock();
+			continue;
+		}
+
+		unsigned int index=__builtin_ctzll(pending);
+		pending&=pending -1;
+
+		const char* start=blockStart + index;
+
+		//Part of a comment, quoted symbol or string we've already dealt with.
+		if(start < position)
+			continue;
+
+		switch(*start)
+		{
+			case '(':
+				t.type=LEFT_PAREN;
+				t.text=start;
+				t.length=1;
+				position=start +1;
+				return true;
+
+			case ')':
+				t.type=RIGHT_PAREN;
+				t.text=start;
+				t.length=1;
+				position=start +1;
+				return true;
+
+			case ';':
+			case '|':
+			case '"':
+			{
+				position=start;
+				bool found=nextScalar(t);
+
+				//Don't bother with the rest of the block if we are past it.
+				if(position >= blockStart + BLOCK_SIZE)
+					pending=0;
+
+				return found;
+			}
+
+			default:
+			{
+				uint64_t after= index == 63? 0 : delimiters >> (index +1);
+				position= after != 0? start + 1 + __builtin_ctzll(after) : findDelimiter(blockStart + BLOCK_SIZE);
+				t.type=ATOM;
+				t.text=start;
+				t.length=position - start;
+				return true;
+			}
+		}
+	}
+#endif
+
+	return nextScalar(t);
+}
+
+bool SmtLexer::nextScalar(Token& t)
+{
+	while(true)
+	{
+		position=skipWhitespace(position);
+		if(position == end)
+			return false;
+
+		const char* start=position;
+		switch(*start)
+		{
+			case ';':
+			{
+				//Comment runs to the end of the line. memchr() is already vectorised.
+				const void* newLine=memchr(start,'\n',end - start);
+				position= newLine? static_cast<const char*>(newLine) +1 : end;
+				continue;
+			}
+
+			case '(':
+				t.type=LEFT_PAREN;
+				t.text=start;
+				t.length=1;
+				position++;
+				return true;
+
+			case ')':
+				t.type=RIGHT_PAREN;
+				t.text=start;
+				t.length=1;
+				position++;
+				return true;
+
+			case '|':
+			{
+				//Quoted symbols can't contain '|' so there is no escaping to worry about.
+				const void* bar=memchr(start +1,'|',end - start -1);
+				const char* close= bar? static_cast<const char*>(bar) : end;
+				t.type=QUOTED_SYMBOL;
+				t.text=start +1;
+				t.length=close - start -1;
+				position= bar? close +1 : end;
+				return true;
+			}
+
+			case '"':
+			{
+				//"" inside a string literal is an escaped quote.
+				const char* p=start +1;
+				while(true)
+				{
+					const void* quote=memchr(p,'"',end - p);
+					if(quote == NULL)
+					{
+						p=end;
+						break;
+					}
+
+					p=static_cast<const char*>(quote) +1;
+					if(p == end || *p != '"')
+						break;
+
+					p++;
+				}
+
+				t.type=STRING;
+				t.text=start;
+				t.length=p - start;
+				position=p;
+				return true;
+			}
+
+			default:
+				position=findDelimiter(start +1);
+				t.type=ATOM;
+				t.text=start;
+				t.length=position - start;
+				return true;
+		}
+	}
+}
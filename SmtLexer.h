@@ -0,0 +1,93 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SMTLEXER_H_
+#define SMTLEXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A lexer for SMTLIBv2 that works directly on a buffer in memory
+ * (usually a mmap()'d query) without copying it.
+ *
+ * Whitespace and comments are skipped. Every other token is
+ * returned as a pointer into the buffer. It is not a validating lexer;
+ * anything that isn't a parenthesis, quoted symbol or string literal is
+ * returned as an ATOM (symbols, keywords, numerals, ...).
+ *
+ * On x86 the buffer is classified 64 bytes at a time with SSE2. The result
+ * is a bitmap with a bit set for the start of every token in the block so
+ * there is no byte by byte scanning (and no unpredictable branches) for
+ * whitespace and the ends of atoms. Comments, quoted symbols and string
+ * literals are rare so they are handled by the scalar code.
+ */
+class SmtLexer
+{
+	public:
+		enum TokenType
+		{
+			LEFT_PAREN,
+			RIGHT_PAREN,
+			ATOM,
+			QUOTED_SYMBOL, //text is the symbol without the |bars|
+			STRING //text includes the "quotes"
+		};
+
+		struct Token
+		{
+			TokenType type;
+			const char* text;
+			size_t length;
+		};
+
+		//If "vectorised" is false the scalar code is used even if SSE2 is available.
+		SmtLexer(const char* _begin, size_t length, bool _vectorised=true);
+
+		//Returns false at the end of the buffer.
+		bool next(Token& t);
+
+		//True if the lexer will use SSE2.
+		bool isVectorised() const;
+
+	private:
+		const char* position;
+		const char* end;
+		bool vectorised;
+
+		//The 64 byte block being lexed with SSE2 (NULL if there isn't one).
+		const char* blockStart;
+
+		//Bit i is set if block byte i starts a token we haven't returned yet.
+		uint64_t pending;
+
+		//Bit i is set if block byte i ends an atom (whitespace, parentheses, ...).
+		uint64_t delimiters;
+
+		//Classify the 64 bytes at "position".
+		void loadBlock();
+
+		bool nextScalar(Token& t);
+
+		//Returns the first byte at or after "p" that ends an atom (or "end").
+		const char* findDelimiter(const char* p) const;
+
+		//Returns the first byte at or after "p" that isn't whitespace (or "end").
+		const char* skipWhitespace(const char* p) const;
+};
+
+#endif /* SMTLEXER_H_ */
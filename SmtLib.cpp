@@ -0,0 +1,177 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "SmtLib.h"
+#include "ResponseParser.h"
+
+using namespace std;
+
+static bool isWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool SmtLib::splitCommands(const std::string& script, std::vector<std::string>& commands, size_t* consumed)
+{
+	size_t length=script.length();
+	size_t index=0;
+
+	if(consumed != NULL) *consumed=0;
+
+	while(index < length)
+	{
+		char c=script[index];
+
+		if(isWhitespace(c))
+		{
+			index++;
+			continue;
+		}
+
+		//Comments run to the end of the line
+		if(c == ';')
+		{
+			while(index < length && script[index] != '\n')
+				index++;
+			continue;
+		}
+
+		size_t start=index;
+		int depth=0;
+		bool complete=false;
+
+		while(index < length && !complete)
+		{
+			c=script[index];
+
+			switch(c)
+			{
+				case '(':
+					depth++;
+					index++;
+					break;
+
+				case ')':
+					depth--;
+					index++;
+					if(depth <= 0) complete=true;
+					break;
+
+				case ';':
+					while(index < length && script[index] != '\n')
+						index++;
+					break;
+
+				case '"':
+					//String literal. A double quote inside is written as "".
+					index++;
+					while(index < length)
+					{
+						if(script[index] == '"')
+						{
+							if(index + 1 < length && script[index +1] == '"')
+							{
+								index+=2;
+								continue;
+							}
+
+							break;
+						}
+						index++;
+					}
+					index++;
+					break;
+
+				case '|':
+					//Quoted symbol
+					index++;
+					while(index < length && script[index] != '|')
+						index++;
+					index++;
+					break;
+
+				default:
+					index++;
+
+					//A top level atom ends at whitespace.
+					if(depth == 0 && (index >= length || isWhitespace(script[index]) || script[index] == '('))
+						complete=true;
+			}
+		}
+
+		if(!complete)
+			return false;
+
+		commands.push_back(script.substr(start,index - start));
+		if(consumed != NULL) *consumed=index;
+	}
+
+	if(consumed != NULL) *consumed=length;
+	return true;
+}
+
+std::string SmtLib::commandName(const std::string& command)
+{
+	size_t index=0;
+	size_t length=command.length();
+
+	//Skip the opening parenthesis and any whitespace after it.
+	while(index < length && (command[index] == '(' || isWhitespace(command[index])))
+		index++;
+
+	size_t start=index;
+	while(index < length && !isWhitespace(command[index]) && command[index] != '(' && command[index] != ')')
+		index++;
+
+	return command.substr(start,index - start);
+}
+
+std::string SmtLib::commandArgument(const std::string& command)
+{
+	string name=commandName(command);
+	size_t index=command.find(name);
+	if(name.empty() || index == string::npos)
+		return "";
+
+	index+=name.length();
+	size_t length=command.length();
+
+	while(index < length && isWhitespace(command[index]))
+		index++;
+
+	size_t start=index;
+	while(index < length && !isWhitespace(command[index]) && command[index] != ')')
+		index++;
+
+	return command.substr(start,index - start);
+}
+
+bool SmtLib::parseCheckSatResponse(const std::string& output, bool complete, Solver::Result& result)
+{
+	ResponseParser parser;
+	parser.feed(output.data(),output.length());
+
+	if(complete)
+		parser.finish();
+
+	if(!parser.isDecided())
+		return false;
+
+	result=parser.getResult();
+	return true;
+}
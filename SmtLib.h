@@ -0,0 +1,52 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SMTLIB_H_
+#define SMTLIB_H_
+
+#include <string>
+#include <vector>
+#include "Solver.h"
+
+//Helpers for dealing with SMTLIBv2 scripts.
+namespace SmtLib
+{
+	/* Split "script" into its top level commands (e.g. "(assert (= a b))").
+	 * Comments and whitespace between commands are dropped.
+	 * Returns false if the script ends in the middle of a command (the
+	 * incomplete command is not added to "commands").
+	 * If "consumed" is not NULL it is set to the number of characters of
+	 * "script" used by the complete commands.
+	 */
+	bool splitCommands(const std::string& script, std::vector<std::string>& commands, size_t* consumed=NULL);
+
+	//Returns the name of a command (e.g. "check-sat" for "(check-sat)") or an empty string.
+	std::string commandName(const std::string& command);
+
+	//Returns the first argument of a command (e.g. "2" for "(push 2)") or an empty string.
+	std::string commandArgument(const std::string& command);
+
+	/* Decide the answer to a (check-sat) from the start of a solver's output.
+	 * "success" responses and (error ...) responses to earlier commands are skipped (see ResponseParser).
+	 * "complete" should be true if the solver won't print anything else for this (check-sat).
+	 * Returns false if more output is needed.
+	 */
+	bool parseCheckSatResponse(const std::string& output, bool complete, Solver::Result& result);
+}
+
+#endif /* SMTLIB_H_ */
@@ -17,7 +17,7 @@
     along with NSolv.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "Solver.h"
-#include "global.h"
+#include "ResponseParser.h"
 #include <signal.h>
 #include <errno.h>
 #include <unistd.h>
@@ -26,20 +26,37 @@
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <stdexcept>
 
 using namespace std;
-Solver::Solver(const std::string& _name, const std::string& _cmdOptions, const std::string& _inputFile, bool _inputOnStdin) :
-name(_name), cmdOptions(), inputFile(_inputFile) , argv(NULL), pid(0), inputOnStdin(_inputOnStdin), resultAlreadyRead(false),
-numberOfBytesReadFromPipe(0)
+
+ResourceLimits::ResourceLimits() :
+maxMemory(0), maxCpu(0), coreDumps(true), timeout(0.0)
+{
+
+}
+
+Solver::Solver(const std::string& _name, const std::string& _cmdOptions, const std::string& _inputFile, bool _inputOnStdin, bool _verbose) :
+name(_name), cmdOptions(), inputFile(_inputFile) , argv(NULL), pid(0), inputOnStdin(_inputOnStdin), cpus(), tier(0),
+response(new ResponseParser()), outputTaken(false), limits(), exited(false), exitStatus(0), verbose(_verbose)
 {
+	memset(&usage,0,sizeof(usage));
+
 	setupArguments(_cmdOptions,_inputFile);
 
-	//Setup half duplex pipe.
-	int result= pipe(this->fd);
+	/* Setup half duplex pipe. Close on exec so that other solvers don't hold on to
+	 * our write end (and stop us from seeing end of file) after we are killed. exec()
+	 * uses dup2() which clears the flag on the solver's stdout.
+	 */
+	int result= pipe2(this->fd,O_CLOEXEC);
 	if(result == -1)
 	{
-		perror("Problem setting up pipe:");
-		exit(1);
+		int error=errno;
+		delete [] argv;
+		delete response;
+		throw std::runtime_error(string("Problem setting up pipe: ") + strerror(error));
 	}
 
 	//Solver::exec() should be called in child after fork() so we'll close fd appropriately there.
@@ -50,10 +67,15 @@ Solver::~Solver()
 {
 	//It is presumed this is called only in the parent.
 
-	kill();
+	//Once reaped our PID (and so process group) could be reused by someone else.
+	if(!exited)
+		kill();
 	delete [] argv;
 	argv=NULL;
 
+	delete response;
+	response=NULL;
+
 	//Try closing the read end of the pipe. It may have already been closed in dumpResult()
 	close(fd[0]);
 }
@@ -67,12 +89,9 @@ bool Solver::setPID(pid_t p)
 		/* We're in parent and the child has already forked from us (hopefully).
 		 * So we should now close the writing end of the file descriptor.
 		 */
-		int result=close(fd[1]);
-		if(result == -1)
-		{
+		//Nothing to be done if this fails. We only lose end of file on the pipe.
+		if(close(fd[1]) == -1)
 			perror("Error closing file descriptor in parent.");
-			exit(1);
-		}
 
 
 		return true;
@@ -81,103 +100,366 @@ bool Solver::setPID(pid_t p)
 		return false;
 }
 
+bool Solver::readResult()
+{
+	if(response->isDecided())
+		return true;
+
+	char chunk[4096];
+	ssize_t result=0;
+	do
+	{
+		result=::read(fd[0],chunk,sizeof(chunk));
+	} while(result == -1 && errno == EINTR);
+
+	if(result == -1)
+	{
+		perror("read:");
+		response->finish();
+		return true;
+	}
+
+	//The solver closed its output (probably exited) so we have all there is.
+	if(result == 0)
+	{
+		response->finish();
+		return true;
+	}
+
+	return response->feed(chunk,result);
+}
+
+/* A solver that failed as if an allocation had failed is only counted as a memout if
+ * its peak RSS got to this fraction of its address space limit.
+ */
+static const double MEMOUT_RSS_FRACTION=0.75;
+
 Solver::Result Solver::getResult()
 {
-	//Read the result from the child if we haven't already tried
-	if(!resultAlreadyRead)
+	Result result=response->getResult();
+	if(result != ERROR || !exited)
+		return result;
+
+	//Reaching RLIMIT_CPU sends SIGXCPU, and SIGKILL a second later if that was ignored.
+	double cpuTime=usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+	if(limits.maxCpu > 0 && WIFSIGNALED(exitStatus) &&
+	   (WTERMSIG(exitStatus) == SIGXCPU || (WTERMSIG(exitStatus) == SIGKILL && cpuTime >= limits.maxCpu)))
+		return CPUOUT;
+
+	/* Reaching RLIMIT_AS just makes allocations fail, which solvers handle by aborting,
+	 * crashing or printing an error and exiting. The address space isn't all resident
+	 * so count it as a memout if it failed like that with its peak RSS near the limit
+	 * (see MEMOUT_RSS_FRACTION). Other crashes are still errors.
+	 */
+	bool allocationFailure= (WIFEXITED(exitStatus) && WEXITSTATUS(exitStatus) != 0) ||
+			(WIFSIGNALED(exitStatus) && (WTERMSIG(exitStatus) == SIGABRT || WTERMSIG(exitStatus) == SIGSEGV ||
+			WTERMSIG(exitStatus) == SIGBUS));
+	if(limits.maxMemory > 0 && allocationFailure &&
+	   usage.ru_maxrss >= MEMOUT_RSS_FRACTION * limits.maxMemory * 1024)
+		return MEMOUT;
+
+	return result;
+}
+
+void Solver::setExitStatus(int status, const struct rusage& _usage)
+{
+	exited=true;
+	exitStatus=status;
+	usage=_usage;
+}
+
+bool Solver::hasExited() const
+{
+	return exited;
+}
+
+int Solver::getExitStatus() const
+{
+	return exitStatus;
+}
+
+const struct rusage& Solver::getUsage() const
+{
+	return usage;
+}
+
+void Solver::setLimits(const ResourceLimits& _limits)
+{
+	limits=_limits;
+}
+
+const ResourceLimits& Solver::getLimits() const
+{
+	return limits;
+}
+
+bool Solver::hasLimits() const
+{
+	return limits.maxMemory > 0 || limits.maxCpu > 0;
+}
+
+pid_t Solver::getPID() const
+{
+	return pid;
+}
+
+/* Report a failure in the child before exec(). The child may share our memory
+ * (see exec()) so stdio and perror() can't be used.
+ */
+static void childError(const char* message, const char* name=NULL)
+{
+	int error=errno;
+
+	char line[512];
+	size_t length=0;
+	const char* parts[]={message, name != NULL? " " : "", name != NULL? name : ""};
+	for(size_t p=0; p < sizeof(parts) / sizeof(parts[0]); p++)
 	{
-			int result=::read(fd[0],buffer,sizeof(buffer));
-			if(result == -1)
-			{
-				perror("read:");
-				exit(1);
-			}
-
-		resultAlreadyRead=true;
-
-		/* Ideally we would like to read sizeof(buffer) bytes, but the read()
-		 * system call does NOT guarantee this! So we must record how many bytes it gave us.
-		 * This might not actually be enough to check for (sat|unsat|unknown) but let's hope it is!
-		 */
-		numberOfBytesReadFromPipe=result;
+		size_t partLength=strlen(parts[p]);
+		if(partLength > sizeof(line) - 32 - length)
+			partLength=sizeof(line) - 32 - length;
+		memcpy(line + length,parts[p],partLength);
+		length+=partLength;
 	}
 
-	//check for the valid responses from a SMTLIBv2 solver
-	if(bufferMatch("sat"))
+	const char errnoText[]=" (errno ";
+	memcpy(line + length,errnoText,sizeof(errnoText) -1);
+	length+=sizeof(errnoText) -1;
+
+	//The digits of "error" come out least significant first
+	char digits[16];
+	int n=0;
+	do
 	{
-		return Solver::SAT;
+		digits[n++]='0' + error % 10;
+		error/=10;
+	} while(error > 0);
+
+	while(n > 0)
+		line[length++]=digits[--n];
+
+	line[length++]=')';
+	line[length++]='\n';
+
+	ssize_t written=write(STDERR_FILENO,line,length);
+	(void) written;
+}
+
+void Solver::applyLimits()
+{
+	struct rlimit limit;
+
+	if(limits.maxMemory > 0)
+	{
+		limit.rlim_cur=limit.rlim_max=static_cast<rlim_t>(limits.maxMemory) << 20;
+		if(setrlimit(RLIMIT_AS,&limit) == -1)
+			childError("Problem setting memory limit of solver");
 	}
-	else if(bufferMatch("unsat"))
+
+	//The hard limit is a second later so that solvers catching SIGXCPU still get killed.
+	if(limits.maxCpu > 0)
 	{
-		return Solver::UNSAT;
+		limit.rlim_cur=limits.maxCpu;
+		limit.rlim_max=limits.maxCpu + 1;
+		if(setrlimit(RLIMIT_CPU,&limit) == -1)
+			childError("Problem setting CPU time limit of solver");
 	}
-	else if(bufferMatch("unknown"))
+
+	if(!limits.coreDumps)
 	{
-		return Solver::UNKNOWN;
+		limit.rlim_cur=limit.rlim_max=0;
+		if(setrlimit(RLIMIT_CORE,&limit) == -1)
+			childError("Problem disabling core dumps of solver");
+	}
+}
+
+void Solver::setExpectedResponses(unsigned int n)
+{
+	response->setExpectedResponses(n);
+}
+
+//Size of the chunks used to copy output when splice() can't be used.
+static const size_t COPY_CHUNK=65536;
+
+//Write all of "length" bytes. Returns false on error.
+static bool writeAll(int fd, const char* data, size_t length)
+{
+	while(length > 0)
+	{
+		ssize_t result=::write(fd,data,length);
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+			return false;
+
+		data+=result;
+		length-=result;
+	}
+
+	return true;
+}
+
+bool Solver::forward(int from, int to)
+{
+	/* Move the data in the kernel. One side of splice() must be a pipe which
+	 * "from" always is. The other side works if it is a pipe, file or socket.
+	 */
+	bool canSplice=true;
+	while(canSplice)
+	{
+		ssize_t result=splice(from,NULL,to,NULL,1 << 20,SPLICE_F_MOVE | SPLICE_F_MORE);
+
+		if(result == 0)
+			return true;
+
+		if(result > 0)
+			continue;
+
+		if(errno == EINTR)
+			continue;
+
+		//"to" doesn't support splice() (e.g. a terminal) so copy instead.
+		if(errno == EINVAL || errno == ENOSYS)
+			canSplice=false;
+		else
+		{
+			perror("Solver::forward() : splice:");
+			return false;
+		}
+	}
+
+	char chunk[COPY_CHUNK];
+	while(true)
+	{
+		ssize_t result=::read(from,chunk,sizeof(chunk));
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			perror("Solver::forward() : read:");
+			return false;
+		}
+
+		if(result == 0)
+			return true;
+
+		if(!writeAll(to,chunk,result))
+		{
+			perror("Solver::forward() : write:");
+			return false;
+		}
 	}
-	else
-		return Solver::ERROR;
 }
 
 void Solver::dumpResult()
 {
-	if(resultAlreadyRead==false)
+	if(!response->isDecided())
 	{
-		cerr << "Solver::dumpResult() . You need to call getResult() first!" << endl;
+		cerr << "Solver::dumpResult() . You need to call readResult() first!" << endl;
 		return;
 	}
 
-	int result=0;
+	//Anything already buffered by stdio has to come first.
+	fflush(stdout);
 
-	//dump the buffer to stdout
-	result=write(fileno(stdout),buffer,numberOfBytesReadFromPipe);
-	if(result== -1)
+	//dump what the parser has already read to stdout
+	const string& received=response->getOutput();
+	if(!writeAll(fileno(stdout),received.data(),received.size()))
 	{
 		cerr << "Solver::dumpResult() : Failed to write buffer to stdout." << endl;
 		perror("Write:");
 		return;
 	}
-	fflush(stdout);
 
-	//print out what remains inside the pipe.
-	FILE* f = fdopen(fd[0],"r");
+	//Write what remains in the pipe to stdout.
+	if(!forward(fd[0],fileno(stdout)))
+		cerr << "Solver::dumpResult() : Failed to forward the remainder of the pipe to stdout." << endl;
+}
 
-	if(f == NULL)
+void Solver::dumpResult(std::string& output)
+{
+	if(!response->isDecided())
 	{
-		cerr << "Solver::dumpResult() : Failed to open pipe to print remainder." << endl;
+		cerr << "Solver::dumpResult() . You need to call readResult() first!" << endl;
 		return;
 	}
 
-	//Write what remains in the pipe to stdout.
-	//Not very efficient but not sure how to do this a better way
-	int c=fgetc(f);
-	while(c != EOF)
+	output.append(response->getOutput());
+
+	//Append what remains in the pipe.
+	char chunk[COPY_CHUNK];
+	while(true)
 	{
-		putchar(c);
-		c=fgetc(f);
+		ssize_t result=::read(fd[0],chunk,sizeof(chunk));
+
+		if(result == -1 && errno == EINTR)
+			continue;
+
+		if(result == -1)
+		{
+			cerr << "Solver::dumpResult() : Failed to read remainder from pipe." << endl;
+			perror("read:");
+			return;
+		}
+
+		if(result == 0)
+			break;
+
+		output.append(chunk,result);
 	}
-	fflush(stdout);
-	result=fclose(f);
-	if(result !=0)
+}
+
+bool Solver::readOutput(std::string& output)
+{
+	if(!response->isDecided())
+	{
+		cerr << "Solver::readOutput() . You need to call readResult() first!" << endl;
+		return false;
+	}
+
+	if(!outputTaken)
+	{
+		output.append(response->getOutput());
+		outputTaken=true;
+	}
+
+	char chunk[COPY_CHUNK];
+	ssize_t result=0;
+	do
+	{
+		result=::read(fd[0],chunk,sizeof(chunk));
+	} while(result == -1 && errno == EINTR);
+
+	if(result == -1)
 	{
-		cerr << "Solver::dumpResult() : Failed to close FILE* to pipe." << endl;
+		cerr << "Solver::readOutput() : Failed to read remainder from pipe." << endl;
+		perror("read:");
+		return false;
 	}
 
+	output.append(chunk,result);
+	return result > 0;
 }
 
 void Solver::exec()
 {
+	//Lead our own process group so the solver and its children can be killed together.
+	setpgid(0,0);
+
 	//We should be in child after fork. We close the reading end of the pipe.
 	int result=close(fd[0]);
 	if(result == -1)
-		perror("Problem closing file descriptor in child.");
+		childError("Problem closing file descriptor in child");
 
 	//We want stdout of the child to be sent to the parent via the pipe.
-	result=dup2(fd[1],fileno(stdout));
+	result=dup2(fd[1],STDOUT_FILENO);
 	if(result == -1)
 	{
-		perror("Problem redirecting stdout of child to pipe!");
-		exit(1);
+		childError("Problem redirecting stdout of child to pipe");
+		_exit(1);
 	}
 
 	if(inputOnStdin)
@@ -190,28 +472,69 @@ void Solver::exec()
 
 		if(smtlibFd == -1)
 		{
-			perror("Problem opening input SMTLIBv2 file:");
-			exit(1);
+			childError("Problem opening input SMTLIBv2 file",inputFile.c_str());
+			_exit(1);
 		}
 
 		//We want the stdinput for the solver to come from the input SMTLIBv2 file
-		result=dup2(smtlibFd,fileno(stdin));
+		result=dup2(smtlibFd,STDIN_FILENO);
 		if(result == -1)
 		{
-			perror("Problem redirecting input SMTLIBv2 file to stdinput:");
-			exit(1);
+			childError("Problem redirecting input SMTLIBv2 file to stdinput");
+			_exit(1);
 		}
 
 	}
 
-	//Now execute the solver
-	result = execvp(name.c_str(), (char * const*) argv);
-	if(result == -1)
+	if(!cpus.empty())
 	{
-		cerr << "Failed to execute solver:" << name << "!" << endl;
-		perror("execvp:");
-		exit(1);
+		/* Pin the solver before it starts so it never migrates. The kernel allocates
+		 * memory on the node of the CPU that first touches it so this keeps the
+		 * solver's memory local too.
+		 */
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(vector<int>::const_iterator c=cpus.begin(); c != cpus.end(); ++c)
+		{
+			if(*c >= 0 && *c < CPU_SETSIZE)
+				CPU_SET(*c,&set);
+		}
+
+		if(sched_setaffinity(0,sizeof(set),&set) == -1)
+			childError("Problem setting CPU affinity of solver (running it unpinned)");
 	}
+
+	applyLimits();
+
+	//Now execute the solver
+	execvp(name.c_str(), (char * const*) argv);
+	childError("Failed to execute solver",name.c_str());
+	_exit(1);
+}
+
+void Solver::setCpus(const std::vector<int>& _cpus)
+{
+	cpus=_cpus;
+}
+
+const std::vector<int>& Solver::getCpus() const
+{
+	return cpus;
+}
+
+void Solver::setTier(unsigned int _tier)
+{
+	tier=_tier;
+}
+
+unsigned int Solver::getTier() const
+{
+	return tier;
+}
+
+bool Solver::isStarted() const
+{
+	return pid != 0;
 }
 
 const std::string& Solver::toString()
@@ -219,43 +542,27 @@ const std::string& Solver::toString()
 	return name;
 }
 
-void Solver::kill()
+void Solver::kill(int signal)
 {
-	if(verbose) cerr << "Trying to kill solver " << name << " with pid:" << pid << endl;
-	int result = ::kill(pid, SIGTERM);
+	//Never started (e.g. a later tier). kill(0,...) would signal our whole process group!
+	if(pid == 0)
+		return;
+
+	if(verbose) cerr << "Trying to kill solver " << name << " with pid:" << pid << " (signal " << signal << ")" << endl;
+	int result = ::kill(-pid, signal);
 
-	//Note ESRCH is when pid didn't exists, we don't care about that case.
+	//Note ESRCH is when the group doesn't exist (anymore), we don't care about that case.
 	if(result == -1 && errno != ESRCH)
-		cerr << "Killing process with PID:" << pid << " failed!" << endl;
+		cerr << "Killing process group " << pid << " failed!" << endl;
 }
 
 void Solver::setupArguments(const std::string& cmdOptionsStr, const std::string& inputFile)
 {
 
-	string temp("");//Temporary token holder
-
 	//push the argv[0] argument which is the program name.
 	cmdOptions.push_back(name);
 
-	string::const_iterator lastElement = cmdOptionsStr.end() -1;
-	for(string::const_iterator c = cmdOptionsStr.begin(); c != cmdOptionsStr.end() ; ++c)
-	{
-		//ignore whitespace leading up to a token
-		if(*c == ' ' && temp.length() ==0)
-			continue;
-
-		temp+=*c;
-
-		//Hit end of token
-		if( (c == lastElement || *(c +1) == ' ' ) && temp.length() > 0)
-		{
-			cmdOptions.push_back(temp);
-			temp=""; //blank the temporary token holder
-			continue;;
-		}
-
-
-	}
+	tokenizeOptions(cmdOptionsStr,cmdOptions);
 
 	//That last argument is the input file if that is what's requested for.
 	if(!inputOnStdin)
@@ -282,12 +589,7 @@ void Solver::setupArguments(const std::string& cmdOptionsStr, const std::string&
 	/* We now need to setup a (char*) NULL terminated C
 	 * array for execvp().
 	 */
-	try {argv = new const char* [cmdOptions.size() +1]; }
-	catch(std::bad_alloc& e)
-	{
-		cerr << "Failed to allocate space for options array!" << endl;
-		exit(1);
-	}
+	argv = new const char* [cmdOptions.size() +1];
 	index=0;
 	for(vector<string>::const_iterator i =cmdOptions.begin(); i != cmdOptions.end(); ++i, ++index)
 		argv[index] = i->c_str();
@@ -296,6 +598,36 @@ void Solver::setupArguments(const std::string& cmdOptionsStr, const std::string&
 	argv[cmdOptions.size()] = (char*) NULL ;
 }
 
+void Solver::tokenizeOptions(const std::string& cmdOptionsStr, std::vector<std::string>& tokens)
+{
+	string temp("");//Temporary token holder
+
+	string::const_iterator lastElement = cmdOptionsStr.end() -1;
+	for(string::const_iterator c = cmdOptionsStr.begin(); c != cmdOptionsStr.end() ; ++c)
+	{
+		//ignore whitespace leading up to a token
+		if(*c == ' ' && temp.length() ==0)
+			continue;
+
+		temp+=*c;
+
+		//Hit end of token
+		if( (c == lastElement || *(c +1) == ' ' ) && temp.length() > 0)
+		{
+			tokens.push_back(temp);
+			temp=""; //blank the temporary token holder
+			continue;;
+		}
+
+
+	}
+}
+
+bool Solver::hasOutput() const
+{
+	return !response->getOutput().empty();
+}
+
 int Solver::getReadFileDescriptor()
 {
 	return fd[0];
@@ -308,26 +640,10 @@ const char* Solver::resultToString(Solver::Result r)
 		case SAT: return "sat";
 		case UNSAT: return "unsat";
 		case UNKNOWN: return "unknown";
+		case MEMOUT: return "memout";
+		case CPUOUT: return "cpuout";
 		case ERROR:
 		default:
 			return "error";
 	}
 }
-
-bool Solver::bufferMatch(const char cstring[])
-{
-	unsigned int strLength=strlen(cstring);
-
-	if(strLength==0) return false; //can't deal with empty strings.
-
-	for(unsigned int index=0; index < sizeof(buffer) && index < strLength; index++)
-	{
-		if(cstring[index] != buffer[index])
-			return false;
-
-		if(strLength == (index + 1))
-			return true;// There was a match
-	}
-
-	return false;
-}
@@ -22,6 +22,23 @@
 #include <string>
 #include <vector>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <signal.h>
+
+class ResponseParser;
+
+/* Limits applied to a solver with setrlimit() just before it starts, apart
+ * from "timeout" which SolverManager enforces. 0 means no limit.
+ */
+struct ResourceLimits
+{
+	unsigned long maxMemory; //MiB of address space (RLIMIT_AS)
+	unsigned long maxCpu; //Seconds of CPU time (RLIMIT_CPU)
+	bool coreDumps; //False sets RLIMIT_CORE to 0
+	double timeout; //Seconds of wall clock time from the start of the solver
+
+	ResourceLimits();
+};
 
 class Solver
 {
@@ -32,13 +49,16 @@ class Solver
 			SAT,
 			UNSAT,
 			UNKNOWN,
-			ERROR
+			ERROR,
+			MEMOUT, //Failed after reaching its memory limit
+			CPUOUT //Killed for reaching its CPU time limit
 		};
 
 		//_name is executable path
 		//_cmdOptions is a string with space seperated options (empty for no cmd line options)
+		//Throws std::runtime_error if the solver's pipe can't be created.
 		Solver(const std::string& _name, const std::string& _cmdOptions, const std::string& _inputFile,
-				bool _inputOnStdin);
+				bool _inputOnStdin, bool _verbose=false);
 
 		//Triggering destructor will kill solver
 		~Solver();
@@ -47,22 +67,89 @@ class Solver
 		bool setPID(pid_t p);
 
 
-		//call from parent when it is known that child finished
+		/* Call from parent when the solver's pipe is readable. Reads what is available
+		 * and returns true once the result is decided (see ResponseParser).
+		 */
+		bool readResult();
+
+		/* The result decided by readResult() (ERROR until then). A solver that failed
+		 * is reported as MEMOUT or CPUOUT if its exit status and resource usage (see
+		 * setExitStatus()) show that it ran into one of its limits.
+		 */
 		Result getResult();
 
+		//Called by the parent once the solver has been reaped (see wait4()).
+		void setExitStatus(int status, const struct rusage& _usage);
+		bool hasExited() const;
+
+		//As given by wait4(). Only valid once hasExited().
+		int getExitStatus() const;
+		const struct rusage& getUsage() const;
+
+		void setLimits(const ResourceLimits& _limits);
+		const ResourceLimits& getLimits() const;
+
+		//True if a memory or CPU limit is set (the results that depend on the exit status).
+		bool hasLimits() const;
+
+		pid_t getPID() const;
+
+		//Number of (check-sat) commands in the query. The solver answers each of them.
+		void setExpectedResponses(unsigned int n);
+
 		//Dump the output from the solver to stdout.
 		void dumpResult();
 
-		//Only to be called within child. Will replace current process with solver program.
+		//Append the output from the solver to "output" instead of writing it to stdout.
+		void dumpResult(std::string& output);
+
+		/* Like dumpResult(output) but only appends what one read() of the pipe gives so
+		 * that the caller never blocks. Call it when the pipe is readable. The first call
+		 * also appends what readResult() has read. Returns false at end of file.
+		 */
+		bool readOutput(std::string& output);
+
+		/* Only to be called within child. Will replace current process with solver program.
+		 * The solver leads a new process group (see kill()).
+		 *
+		 * The child may share our memory (see SolverManager::spawnSolver()) so this only
+		 * makes async-signal-safe calls and never returns (it _exit()s if exec fails).
+		 */
 		void exec();
 
+		//Run the solver on these CPUs only (sched_setaffinity() in exec()). Empty means anywhere.
+		void setCpus(const std::vector<int>& _cpus);
+		const std::vector<int>& getCpus() const;
+
+		//Solvers are started tier by tier (see SolverManager). Tier 0 starts first.
+		void setTier(unsigned int _tier);
+		unsigned int getTier() const;
+
+		//True once setPID() has been called.
+		bool isStarted() const;
+
 		int getReadFileDescriptor();
 
+		//True once readResult() has read anything.
+		bool hasOutput() const;
+
 		const std::string& toString();
 
 		static const char* resultToString(Solver::Result r);
 
-		void kill();
+		/* Copy everything from the pipe "from" to "to" until end of file. Uses splice()
+		 * so the data never enters user space, or plain reads and writes if "to"
+		 * doesn't support it. Returns false on error.
+		 */
+		static bool forward(int from, int to);
+
+		//Split space separated command line options and append them to "tokens"
+		static void tokenizeOptions(const std::string& cmdOptionsStr, std::vector<std::string>& tokens);
+
+		/* Send "signal" to the solver's process group so that anything it started
+		 * (e.g. the real solver behind a wrapper script) gets it too.
+		 */
+		void kill(int signal=SIGTERM);
 
 	private:
 		std::string name;
@@ -75,20 +162,31 @@ class Solver
 		pid_t pid;
 		const char** argv;
 
-		//Raw byte buffer used to read the first bits of data coming from the child
-		unsigned char buffer[7];
-
 		bool inputOnStdin;
 
-		bool resultAlreadyRead;
+		std::vector<int> cpus;
+		unsigned int tier;
+
+		//Output read so far, kept so that it can be dumped if we win.
+		ResponseParser* response;
+		bool outputTaken; //True once readOutput() has appended what "response" read
+
+		ResourceLimits limits;
 
-		int numberOfBytesReadFromPipe;
+		bool exited;
+		int exitStatus;
+		struct rusage usage;
 
+		bool verbose;
 
+		//Apply "limits" to ourself. Only called in the child (see exec()).
+		void applyLimits();
 
 		void setupArguments(const std::string& _cmdOptions, const std::string& inputFile);
 
-		bool bufferMatch(const char cstring[]);
+		//Not copyable because we own the pipe and parser
+		Solver(const Solver&);
+		Solver& operator=(const Solver&);
 };
 
 
@@ -16,8 +16,13 @@
     You should have received a copy of the GNU General Public License
     along with NSolv.  If not, see <http://www.gnu.org/licenses/>
  */
-#include "global.h"
 #include "SolverManager.h"
+#include "ResultCache.h"
+#include "Fingerprint.h"
+#include "CpuTopology.h"
+#include "QueryFeatures.h"
+#include "EventEngine.h"
+#include "Trace.h"
 #include <iostream>
 #include <cmath>
 #include <signal.h>
@@ -26,94 +31,150 @@
 #include <errno.h>
 #include <cstdio>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sched.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sstream>
+#include <algorithm>
 using namespace std;
 
+//Stack of a solver's process started with clone(). It only needs enough to get to exec().
+static const size_t SPAWN_STACK_SIZE=256 * 1024;
 
-SolverManager::SolverManager(const std::string& _inputFile, double _timeout, bool _loggingMode ) :
-solvers(), pidToSolverMap(), inputFile(_inputFile), empty(""), fdToSolverMap(), largestFileDescriptor(0),
-loggingMode(_loggingMode)
+//What cloneEntry() is given. Kept at the bottom of the new process's stack.
+struct SpawnArguments
 {
+	SolverManager* manager;
+	Solver* solver;
+	sigset_t mask;
+	int firstRealtimeSignal;
+};
+
+/* Signals we set to SIG_IGN ourselves (see main(), Session and SolverPool).
+ * Solvers get them back as SIG_DFL.
+ */
+static const int IGNORED_BY_NSOLV[]={SIGPIPE, SIGTERM, SIGQUIT, SIGINT};
+
+SolverManager::SolverManager(const std::string& _inputFile, double _timeout, const std::string& _loggingPath, bool shareInput,
+		bool _verbose, Trace* _tracer) :
+solvers(), pidToSolverMap(), inputFile(_inputFile), queryName(_inputFile), sharedInput(), empty(""), fdToSolverMap(), events(),
+reaped(), awaitingExit(), exitsWatched(EventEngine::supportsProcesses()),
+loggingMode(!_loggingPath.empty()), timedOut(false), raceLog(), logRecord(), raceLogged(false),
+valid(true), verbose(_verbose), tracer(_tracer), cancelFd(-1), cancelled(false), raceResult(Solver::ERROR), winnerName(),
+resultCache(NULL), tiers(), tiersLaunched(0),
+phase(READY), won(false), winningSolver(NULL), numberOfUsableSolvers(0), cacheKey(), raceOutput(NULL), outputStart(0), dumpStart(0), ready(),
+stopping(), stopStarted(false), stopExpired(false),
+fastSpawn(true), spawnStack(NULL)
+{
+	if(!initialise(_timeout,_loggingPath))
+		return;
+
+	//Read the input once here rather than once per solver. "-" is our stdin which can only be read once.
+	if(_inputFile == "-")
+	{
+		TracedPhase p(tracer,"share input");
+		if(!sharedInput.load(STDIN_FILENO,"stdin"))
+		{
+			cerr << "SolverManager: Couldn't copy the input on stdin to memory" << endl;
+			valid=false;
+			return;
+		}
+
+		inputFile=sharedInput.getPath();
+	}
+	else if(shareInput)
+	{
+		TracedPhase p(tracer,"share input");
+		if(sharedInput.load(_inputFile))
+			inputFile=sharedInput.getPath();
+		else
+			cerr << "SolverManager: Couldn't copy the input to memory, solvers will read " << _inputFile << " themselves." << endl;
+	}
+}
+
+SolverManager::SolverManager(const char* query, size_t length, const std::string& name, double _timeout, const std::string& _loggingPath,
+		bool _verbose, Trace* _tracer) :
+solvers(), pidToSolverMap(), inputFile(name), queryName(name), sharedInput(), empty(""), fdToSolverMap(), events(),
+reaped(), awaitingExit(), exitsWatched(EventEngine::supportsProcesses()),
+loggingMode(!_loggingPath.empty()), timedOut(false), raceLog(), logRecord(), raceLogged(false),
+valid(true), verbose(_verbose), tracer(_tracer), cancelFd(-1), cancelled(false), raceResult(Solver::ERROR), winnerName(),
+resultCache(NULL), tiers(), tiersLaunched(0),
+phase(READY), won(false), winningSolver(NULL), numberOfUsableSolvers(0), cacheKey(), raceOutput(NULL), outputStart(0), dumpStart(0), ready(),
+stopping(), stopStarted(false), stopExpired(false),
+fastSpawn(true), spawnStack(NULL)
+{
+	if(!initialise(_timeout,_loggingPath))
+		return;
+
+	//There is no file so the solvers always read the copy.
+	TracedPhase p(tracer,"share input");
+	if(!sharedInput.load(query,length,name))
+	{
+		cerr << "SolverManager: Couldn't copy " << name << " to memory" << endl;
+		valid=false;
+		return;
+	}
+
+	inputFile=sharedInput.getPath();
+}
+
+bool SolverManager::initialise(double timeout, const std::string& loggingPath)
+{
+	startBarrier[0]=startBarrier[1]=-1;
+	tierDelay.tv_sec=tierDelay.tv_nsec=0;
+	setKillGrace(1.0);
+	sharedInput.setVerbose(verbose);
+
 	//set timeout
-	double intPart;
-	modf(_timeout,&intPart);
+	originalTimeout=fromDouble(timeout);
 
-	originalTimeout.tv_sec = timeout.tv_sec = static_cast<time_t>(intPart);
-	originalTimeout.tv_nsec = timeout.tv_nsec = 0;
+	if(verbose && timeoutEnabled())
+		cerr << "SolverManager: Using timeout of " << toDouble(originalTimeout) << " second(s)." << endl;
 
-	if(verbose && _timeout != 0)
-		cerr << "SolverManager: Using timeout of " << timeout.tv_sec << " second(s)." << endl;
+	if(!events.isValid())
+	{
+		cerr << "SolverManager: Failed to set up the event engine" << endl;
+		valid=false;
+		return false;
+	}
 
 	if(loggingMode)
 	{
 		if(verbose) cerr << "SolverManager: Using logging mode. Log file is " << loggingPath << endl;
 
 		//Open the file for output and append to previous logging data
-		loggingFile.open(loggingPath.c_str(), ios_base::out | ios_base::app);
-
-		//set precision for use with times
-		loggingFile.setf(ios::fixed,ios::floatfield);
-		loggingFile.precision(9); //show nanosecond precision.
-
-		if(! loggingFile.is_open())
+		if(!raceLog.open(loggingPath,RaceLog::TEXT))
 		{
 			cerr << "Error : Could not open log file." << endl;
-			exit(1);
+			valid=false;
+			return false;
 		}
-		else
-			loggingFile << "#Start" << endl;
-
 	}
 
 	if(verbose && !loggingMode)
 		cerr << "SolverManager: Using performance mode" << endl;
 
-	//Setup up semaphore
-	solverSynchronisingSemaphore=NULL;
-	stringstream s;
-	s << "/nsolv-sem-" << time(NULL); //pick a unique name for the semaphore
-	solverSyncName=s.str();
-	solverSynchronisingSemaphore=sem_open(solverSyncName.c_str(),
-			O_CREAT | //Create a new semaphore if it doesn't already exist
-			O_EXCL | //Only allow exclusive access (i.e. with O_CREAT means that we can only create a new semaphore)
-			O_CLOEXEC, //Close semaphore on exec() call
-			S_IRWXU,
-			0U);
-
-	if(solverSynchronisingSemaphore==SEM_FAILED)
-	{
-		cerr << "SolverManager: Failed to create semaphore for synchronisation" << endl;
-		perror(NULL);
-	}
-	else
-		if(verbose) cerr << "SolverManger: Created named semaphore \"" << solverSyncName << "\"" << endl;
-
-
+	return true;
 }
 
 SolverManager::~SolverManager()
 {
-	//clean up the semaphore
+	stopSolvers();
 
-	if(sem_close(solverSynchronisingSemaphore)!=0)
+	//Every solver has been reaped so how they exited can be logged.
+	if(loggingMode && raceLogged)
 	{
-		cerr << "SolverManager: Failed to close semaphore" << endl;
-		perror(NULL);
+		TracedPhase p(tracer,"write log");
+		writeLog();
 	}
-	else
-		if(verbose) cerr << "SolverManger: Closing semaphore \"" << solverSyncName << "\"" << endl;
 
-	//We assume that we are the parent process and so only the parent performs the unlink
-	if(sem_unlink(solverSyncName.c_str())!=0)
+	//Solvers that were never started aren't in pidToSolverMap
+	for(vector<Solver*>::iterator s=solvers.begin(); s != solvers.end(); ++s)
 	{
-		cerr << "SolverManager: Failed to unlink semaphore" << endl;
-		perror(NULL);
+		if(!(*s)->isStarted())
+			delete *s;
 	}
-	else
-		if(verbose) cerr << "SolverManger: Unlinking semaphore \"" << solverSyncName << "\"" << endl;
-
 
 	string solverName("");
 	//Try to delete all the solvers
@@ -125,25 +186,30 @@ SolverManager::~SolverManager()
 		delete i->second;
 		i->second=NULL;
 
-		//Try to reap the child. We don't want any zombies lying around!!
-		if(i->first != 0)
+		//Try to reap the child (unless the event engine already did). We don't want any zombies lying around!!
+		if(i->first != 0 && !reaped.count(i->first))
 		{
 			if(verbose) cerr << "Reaping child PID:" << i->first << " (" << solverName << ")" << endl;
 			waitpid(i->first,NULL,0);
 		}
 	}
 
-	//close log
-	if(loggingMode) { loggingFile << endl; loggingFile.close();}
+	if(spawnStack != NULL)
+		munmap(spawnStack,SPAWN_STACK_SIZE);
+}
+
+bool SolverManager::isValid() const
+{
+	return valid;
 }
 
-void SolverManager::addSolver(const std::string& name,
+bool SolverManager::addSolver(const std::string& name,
 		const std::string& cmdLineArgs, bool inputOnStdin)
 {
 	Solver* s=NULL;
 	try
 	{
-		s=new Solver(name,cmdLineArgs,inputFile, inputOnStdin);
+		s=new Solver(name,cmdLineArgs,inputFile, inputOnStdin, verbose);
 		solvers.push_back(s);
 
 		if(! fdToSolverMap.insert( make_pair(s->getReadFileDescriptor(),s)).second)
@@ -151,329 +217,1118 @@ void SolverManager::addSolver(const std::string& name,
 
 		if(verbose)
 			cerr << "SolverManager: Added solver \"" << name << "\"" << endl;
+		return true;
 	}
 	catch(exception& e)
 	{
-		cerr << "Failed to allocate memory for solver " << name << " : " << e.what() << endl;
-		exit(1);
+		cerr << "Failed to set up solver " << name << " : " << e.what() << endl;
+		return false;
 	}
 }
 
-void SolverManager::addSolver(const std::string& name, bool inputOnStdin)
-{
-	addSolver(name,empty, inputOnStdin);
+bool SolverManager::addSolver(const std::string& name, const std::string& cmdLineArgs, bool inputOnStdin,
+		const std::vector<int>& cpus, unsigned int tier, const ResourceLimits& limits)
+{
+	if(!addSolver(name,cmdLineArgs,inputOnStdin))
+		return false;
+
+	solvers.back()->setCpus(cpus);
+	solvers.back()->setTier(tier);
+	solvers.back()->setLimits(limits);
+
+	if(verbose && !cpus.empty())
+		cerr << "SolverManager: Solver \"" << name << "\" will run on CPU(s) " << CpuTopology::toString(cpus) << endl;
+	return true;
+}
+
+bool SolverManager::addSolver(const std::string& name, bool inputOnStdin)
+{
+	return addSolver(name,empty, inputOnStdin);
+}
+
+bool SolverManager::invokeSolvers()
+{
+	return race(NULL);
+}
+
+bool SolverManager::invokeSolvers(std::string& output)
+{
+	return race(&output);
+}
+
+void SolverManager::setResultCache(ResultCache* cache)
+{
+	resultCache=cache;
+}
+
+bool SolverManager::answerFromCache(std::string& key, std::string* output)
+{
+	if(resultCache == NULL || !resultCache->computeKey(inputFile,key))
+		return false;
+
+	if(loggingMode)
+		return false;
+
+	Solver::Result result=Solver::ERROR;
+	string cached;
+	if(!resultCache->lookup(key,result,cached))
+		return false;
+
+	raceResult=result;
+
+	if(output != NULL)
+		output->append(cached);
+	else
+	{
+		fwrite(cached.data(),1,cached.size(),stdout);
+		fflush(stdout);
+	}
+
+	return true;
+}
+
+bool SolverManager::race(std::string* output)
+{
+	TracedPhase racing(tracer,"race");
+	beginRace(output);
+	while(phase == RACING)
+		stepRace(true);
+
+	//Free the CPUs for whatever runs next.
+	stopSolvers();
+	return won;
+}
+
+void SolverManager::startRace(std::string& output)
+{
+	beginRace(&output);
+
+	//It may be decided already (e.g. from the cache).
+	continueRace();
+}
+
+void SolverManager::continueRace()
+{
+	bool progress=true;
+	while(progress)
+	{
+		switch(phase)
+		{
+			case RACING: progress=stepRace(false); break;
+			case DUMPING: progress=stepDump(); break;
+			case STOPPING: progress=stepStop(false); break;
+			default: progress=false;
+		}
+	}
+}
+
+bool SolverManager::isDecided() const
+{
+	return phase == STOPPING || phase == FINISHED;
+}
+
+bool SolverManager::isFinished() const
+{
+	return phase == FINISHED;
+}
+
+int SolverManager::getFileDescriptor() const
+{
+	return events.getFileDescriptor();
+}
+
+bool SolverManager::hasWinner() const
+{
+	return won;
+}
+
+void SolverManager::cancelRace()
+{
+	if(phase != RACING && phase != DUMPING)
+		return;
+
+	if(verbose) cerr << "SolverManager: The race was cancelled" << endl;
+	cancelled=true;
+	if(loggingMode && phase == RACING) {printUnfinishedSolversToLog("cancelled"); printSkippedSolversToLog();}
+	endRace(false);
+}
+
+void SolverManager::endRace(bool _won)
+{
+	won=_won;
+	phase=STOPPING;
+}
+
+void SolverManager::beginRace(std::string* output)
+{
+	raceResult=Solver::ERROR;
+	winnerName.clear();
+	cancelled=false;
+	won=false;
+	winningSolver=NULL;
+	numberOfUsableSolvers=0;
+	raceOutput=output;
+
+	if(phase != READY)
+	{
+		cerr << "SolverManager::invokeSolvers : The solvers have already been invoked." << endl;
+		return;
+	}
+	phase=RACING;
+
+	if(getNumberOfSolvers() == 0)
+	{
+		cerr << "SolverManager::invokeSolvers : There are no solvers to invoke." << endl;
+		endRace(false);
+		return;
+	}
+
+	if(cancelFd != -1 && !events.watchReadable(cancelFd,NULL))
+	{
+		endRace(false);
+		return;
+	}
+
+	//Repeated queries don't need any solvers
+	if(answerFromCache(cacheKey,output))
+	{
+		endRace(true);
+		return;
+	}
+
+	QueryFeatures features;
+	bool haveFeatures=false;
+	if(loggingMode)
+	{
+		TracedPhase p(tracer,"features and fingerprint");
+		haveFeatures=features.computeFile(inputFile);
+		listSolversToLog(); printFingerprintToLog();
+		if(haveFeatures) printFeaturesToLog(features);
+	}
+
+	//record the start time
+	if(clock_gettime(CLOCK_MONOTONIC,&startTime) == -1)
+		cerr << "WARNING: Failed to record start time!" << endl;
+
+	//The tiers in the order they are launched
+	tiers.clear();
+	for(vector<Solver*>::const_iterator s=solvers.begin(); s != solvers.end(); ++s)
+	{
+		if(find(tiers.begin(),tiers.end(),(*s)->getTier()) == tiers.end())
+			tiers.push_back((*s)->getTier());
+	}
+	sort(tiers.begin(),tiers.end());
+	tiersLaunched=0;
+
+	if(!launchNextTier(numberOfUsableSolvers))
+	{
+		endRace(false);
+		return;
+	}
+
+	/* Solvers answer every (check-sat) in the query so that is how many responses
+	 * decide a result. Count them while the first solvers start up.
+	 */
+	if(!haveFeatures)
+	{
+		TracedPhase p(tracer,"count check-sats");
+		haveFeatures=features.computeFile(inputFile);
+	}
+
+	if(haveFeatures && features.checkSats > 1)
+	{
+		for(vector<Solver*>::iterator s=solvers.begin(); s != solvers.end(); ++s)
+			(*s)->setExpectedResponses(features.checkSats);
+	}
+}
+
+bool SolverManager::stepRace(bool block)
+{
+	if(numberOfUsableSolvers == 0 && (winningSolver != NULL || tiersLaunched == tiers.size()))
+	{
+		finishRace(block);
+		return true;
+	}
+
+	/* Promote the next tier straight away if there is nothing left to wait for
+	 * (every solver so far answered unknown or failed).
+	 */
+	if(numberOfUsableSolvers == 0)
+	{
+		if(!launchNextTier(numberOfUsableSolvers))
+			endRace(false);
+		return true;
+	}
+
+	//Wake up for whichever comes first; the timeout, the start of the next tier or a solver's own timeout.
+	bool tierPending= winningSolver == NULL && tiersLaunched < tiers.size();
+	bool haveDeadline=timeoutEnabled();
+	timespec deadline=add(startTime,originalTimeout);
+	timespec nextTier=add(lastTierLaunch,tierDelay);
+	if(tierPending && (!haveDeadline || deadline > nextTier))
+	{
+		deadline=nextTier;
+		haveDeadline=true;
+	}
+
+	for(map<Solver*,timespec>::const_iterator d=solverDeadlines.begin(); d != solverDeadlines.end(); ++d)
+	{
+		if(!haveDeadline || deadline > d->second)
+		{
+			deadline=d->second;
+			haveDeadline=true;
+		}
+	}
+
+	if(haveDeadline)
+		events.setDeadline(deadline);
+	else
+		events.clearDeadline();
+
+	//Now wait for a solver to return (or exit).
+	ready.clear();
+	int n=events.wait(ready,block? -1 : 0);
+	if(n == -1)
+	{
+		//A signal handler of whoever we are running in (e.g. for SIGCHLD). Carry on waiting.
+		if(errno == EINTR)
+			return true;
+
+		perror("Something went wrong waiting for solvers via epoll_wait()");
+		endRace(false);
+		return true;
+	}
+
+	for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+	{
+		//In performance mode nothing matters once we have a winner.
+		if(winningSolver != NULL && !loggingMode)
+			break;
+
+		if(e->type == EventEngine::EXITED)
+		{
+			//Reap it now. Its answer (if any) is still in its pipe.
+			Solver* exited=static_cast<Solver*>(e->data);
+			reapSolver(exited);
+
+			if(awaitingExit.erase(exited) && !checkResult(exited,winningSolver,numberOfUsableSolvers))
+			{
+				endRace(false);
+				return true;
+			}
+			continue;
+		}
+
+		if(e->type == EventEngine::TIMER)
+		{
+			timespec current;
+			clock_gettime(CLOCK_MONOTONIC,&current);
+
+			if(winningSolver == NULL && tiersLaunched < tiers.size() && current >= add(lastTierLaunch,tierDelay))
+			{
+				//Nothing has answered yet so start the next tier.
+				if(!launchNextTier(numberOfUsableSolvers))
+				{
+					endRace(false);
+					return true;
+				}
+				continue;
+			}
+
+			if(timeoutEnabled() && current >= add(startTime,originalTimeout))
+			{
+				//Timeout expired!
+				cerr << "Timeout expired!" << endl;
+				timedOut=true;
+				if(loggingMode) {printUnfinishedSolversToLog("timeout"); printSkippedSolversToLog();}
+				endRace(false);
+				return true;
+			}
+
+			int expired=expireSolvers(current);
+			numberOfUsableSolvers-=expired;
+
+			if(expired > 0 && numberOfUsableSolvers == 0 && winningSolver == NULL && tiersLaunched == tiers.size())
+			{
+				//Every solver has run out of its own time.
+				cerr << "Timeout expired!" << endl;
+				timedOut=true;
+				if(loggingMode) printSkippedSolversToLog();
+				endRace(false);
+				return true;
+			}
+
+			//Otherwise an expiry for a deadline we have since moved.
+			continue;
+		}
+
+		if(e->fd == cancelFd)
+		{
+			cancelRace();
+			return true;
+		}
+
+		Solver* solverOfInterest=static_cast<Solver*>(e->data);
+
+		//Wait for more output if the result can't be decided yet.
+		bool decided=solverOfInterest->readResult();
+		if(tracer && solverOfInterest->hasOutput()) tracer->solverEvent(solverOfInterest,Trace::FIRST_BYTE);
+		if(!decided)
+			continue;
+
+		if(tracer) tracer->solverEvent(solverOfInterest,Trace::DECIDED);
+
+		if(verbose) cerr << "Solver:" << solverOfInterest->toString() << " returned. Checking result..." << endl;
+
+		//Stop watching that solver's pipe and remove it from the file descriptor map.
+		events.unwatchReadable(e->fd);
+		removeSolverFromFileDescriptorSet(solverOfInterest);
+
+		//Whether a failure was a memout or cpuout depends on how it exited.
+		if(solverOfInterest->getResult() == Solver::ERROR && solverOfInterest->hasLimits() &&
+		   !solverOfInterest->hasExited() && exitsWatched)
+		{
+			awaitingExit.insert(solverOfInterest);
+			continue;
+		}
+
+		if(!checkResult(solverOfInterest,winningSolver,numberOfUsableSolvers))
+		{
+			endRace(false);
+			return true;
+		}
+	}
+
+	return n > 0;
+}
+
+void SolverManager::finishRace(bool block)
+{
+	if(loggingMode) printSkippedSolversToLog();
+
+	if(winningSolver==NULL)
+	{
+		cerr << "SolverManager::invokeSolvers() : Ran out of usable solvers!" << endl;
+		endRace(false);
+		return;
+	}
+
+	raceResult=winningSolver->getResult();
+	winnerName=winningSolver->toString();
+	dumpStart= tracer? Trace::now() : 0;
+
+	if(!block)
+	{
+		/* Copy the winner's output as it arrives (see stepDump()). Only its pipe (and
+		 * exits) matter now. The timeout still applies in case it never stops.
+		 */
+		for(map<int,Solver*>::const_iterator i=fdToSolverMap.begin(); i != fdToSolverMap.end(); ++i)
+			events.unwatchReadable(i->first);
+		if(cancelFd != -1)
+			events.unwatchReadable(cancelFd);
+
+		if(timeoutEnabled())
+			events.setDeadline(add(startTime,originalTimeout));
+		else
+			events.clearDeadline();
+
+		outputStart=raceOutput->size();
+		if(!events.watchReadable(winningSolver->getReadFileDescriptor(),winningSolver))
+		{
+			endRace(false);
+			return;
+		}
+
+		phase=DUMPING;
+		return;
+	}
+
+	/* Forward the winner's output before killing the other solvers so the user
+	 * isn't kept waiting by large portfolios. Solver pipes are close on exec so
+	 * the other solvers can't hold the winner's pipe open.
+	 */
+	if(!cacheKey.empty())
+	{
+		//We need a copy of the output to store in the cache
+		string winningOutput;
+		winningSolver->dumpResult(winningOutput);
+		resultCache->store(cacheKey,winningSolver->getResult(),winningOutput);
+
+		if(raceOutput != NULL)
+			raceOutput->append(winningOutput);
+		else
+		{
+			fwrite(winningOutput.data(),1,winningOutput.size(),stdout);
+			fflush(stdout);
+		}
+	}
+	else if(raceOutput != NULL)
+		winningSolver->dumpResult(*raceOutput);
+	else
+		winningSolver->dumpResult();
+
+	if(tracer)
+	{
+		tracer->phase("dump output",dumpStart);
+		tracer->solverEvent(winningSolver,Trace::FLUSHED);
+	}
+
+	endRace(true);
+}
+
+bool SolverManager::stepDump()
+{
+	ready.clear();
+	int n=events.wait(ready,0);
+	if(n == -1)
+	{
+		if(errno == EINTR)
+			return true;
+
+		perror("Something went wrong waiting for the winner's output via epoll_wait()");
+		endRace(false);
+		return true;
+	}
+
+	bool copied=false;
+	for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+	{
+		if(e->type == EventEngine::EXITED)
+			reapSolver(static_cast<Solver*>(e->data));
+		else if(e->type == EventEngine::TIMER)
+		{
+			cerr << "Timeout expired!" << endl;
+			timedOut=true;
+			events.unwatchReadable(winningSolver->getReadFileDescriptor());
+			endRace(false);
+			return true;
+		}
+		else if(!winningSolver->readOutput(*raceOutput))
+			copied=true;
+	}
+
+	if(!copied)
+		return n > 0;
+
+	events.unwatchReadable(winningSolver->getReadFileDescriptor());
+	events.clearDeadline();
+	if(!cacheKey.empty())
+		resultCache->store(cacheKey,winningSolver->getResult(),raceOutput->substr(outputStart));
+
+	if(tracer)
+	{
+		tracer->phase("dump output",dumpStart);
+		tracer->solverEvent(winningSolver,Trace::FLUSHED);
+	}
+
+	endRace(true);
+	return true;
+}
+
+bool SolverManager::checkResult(Solver* solverOfInterest, Solver*& winningSolver, int& numberOfUsableSolvers)
+{
+	Solver::Result solverResult=solverOfInterest->getResult();
+	switch(solverResult)
+	{
+		case Solver::SAT:
+
+			if(verbose) cerr << "Result: sat" << endl;
+
+			if(winningSolver==NULL)
+			{
+
+				winningSolver=solverOfInterest;//Record the solver that won so we can print its output later.
+
+				if(loggingMode) printWinnerToLog(solverOfInterest);
+			}
+
+			if(!loggingMode)
+			{
+				//We don't want to let any other solvers run
+				numberOfUsableSolvers=0;
+				return true;
+			}
+			else
+			{
+				//Log output
+				printSolverAnswerToLog(solverResult,solverOfInterest);
+
+				//Try the other solvers.
+				numberOfUsableSolvers--;
+				return true;
+			}
+
+		case Solver::UNSAT:
+
+			if(verbose) cerr << "Result: unsat" << endl;
+
+			if(winningSolver==NULL)
+			{
+					winningSolver=solverOfInterest;//Record the winning solver so we can output its output later.
+
+					if(loggingMode) printWinnerToLog(solverOfInterest);
+			}
+
+
+			if(!loggingMode)
+			{
+				//We don't want to let any other solvers run
+				numberOfUsableSolvers=0;
+				return true;
+			}
+			else
+			{
+				//Log output
+				printSolverAnswerToLog(solverResult,solverOfInterest);
+
+				//Try the other solvers.
+				numberOfUsableSolvers--;
+				return true;
+			}
+
+
+		case Solver::UNKNOWN:
+			if(verbose) cerr << "Result: unknown" << endl << "Trying another solver..." << endl;
+			raceResult=Solver::UNKNOWN;
+
+			if(loggingMode) printSolverAnswerToLog(solverResult,solverOfInterest);
+			//Try another solver
+			numberOfUsableSolvers--;
+
+			//Don't wait for the delay if a solver has already given up.
+			if(winningSolver == NULL && tiersLaunched < tiers.size() && !launchNextTier(numberOfUsableSolvers))
+				return false;
+			return true;
+
+		case Solver::MEMOUT:
+		case Solver::CPUOUT:
+		case Solver::ERROR:
+			cerr << "Result: Solver (" << solverOfInterest->toString() << ") failed" <<
+					(solverResult == Solver::ERROR? "" : string(" (") + Solver::resultToString(solverResult) + ")") <<
+					"." << endl << "Trying another solver..." << endl;
+
+			if(loggingMode) printSolverAnswerToLog(solverResult,solverOfInterest);
+
+			//Try another solver
+			numberOfUsableSolvers--;
+
+			//Don't wait for the delay if a solver has already failed.
+			if(winningSolver == NULL && tiersLaunched < tiers.size() && !launchNextTier(numberOfUsableSolvers))
+				return false;
+			return true;
+
+		default:
+			return false;
+	}
 }
 
-bool SolverManager::invokeSolvers()
+bool SolverManager::launchNextTier(int& numberOfUsableSolvers)
 {
-	if(getNumberOfSolvers() == 0)
+	unsigned int tier=tiers[tiersLaunched++];
+	clock_gettime(CLOCK_MONOTONIC,&lastTierLaunch);
+	double launchStart= tracer? Trace::now() : 0;
+
+	if(verbose && tiers.size() > 1) cerr << "SolverManager: Starting tier " << tier << endl;
+	if(loggingMode && tiers.size() > 1)
+		logRecord.tierStarts.push_back(make_pair(tier,toDouble(subtract(lastTierLaunch,startTime))));
+
+	/* Solvers started with fork() wait for a byte each from this pipe before they exec()
+	 * (see startSolver()). It belongs to this process alone so any number of NSolv
+	 * processes can start solvers at once and nothing is left behind if we crash.
+	 * clone() doesn't return until the solver has exec()'d so those can't wait for
+	 * the tier. They are started one straight after the other instead.
+	 */
+	if(!fastSpawn && pipe2(startBarrier,O_CLOEXEC) == -1)
 	{
-		cerr << "SolverManager::invokeSolvers : There are no solvers to invoke." << endl;
+		perror("SolverManager::invokeSolvers() : Failed to create the start pipe:");
 		return false;
 	}
 
-	if(loggingMode) {listSolversToLog(); printSolverHeaderToLog();}
-
-	/* Loop over the solvers. For each solver fork the current process and
+	/* Loop over the solvers in this tier. For each solver fork the current process and
 	 * execute the solver's code
 	 */
+	int started=0;
 	for(vector<Solver*>::iterator s = solvers.begin(); s!= solvers.end(); ++s)
 	{
-		fflush(stdout);
-		fflush(stderr);
-		pid_t pid = fork();
+		if((*s)->getTier() != tier)
+			continue;
+
+		pid_t pid = spawnSolver(*s);
 
 		if(pid < 0)
 		{
-			cerr << "SolverManager::invokeSolvers() : Failed to fork!" << endl;
+			perror("SolverManager::invokeSolvers() : Failed to start solver:");
+			closeStartBarrier();
 			return false;
 		}
-		if(pid == 0)
+		else
 		{
-			//In child
-
-			if(verbose) cerr << "SolverManager: Solver \"" << (*s)->toString() << "\" blocking..." << endl;
-
-			/* We will now block (assuming our semaphores is initialised to zero)
-			 * until the NSolv parent process lets us go.
-			 */
-			if(sem_wait(solverSynchronisingSemaphore) !=0)
+			//parent code
+			if(verbose)
 			{
-				perror("Waiting for semaphore failed:");
+				//clone()d solvers don't have a start pipe so they are already running.
+				cerr << "SolverManager: Solver \"" << (*s)->toString() << "\" (PID " << pid << ") " <<
+						(fastSpawn? "started" : "waits for its tier...") << endl;
 			}
-			if(verbose) cerr << "SolverManager: Solver \"" << (*s)->toString() << "\" unblocked..." << endl;
 
-			//Child code
-			(*s)->exec();
-		}
-		else
-		{
-			//parent code
+			//Also done by the child (see Solver::exec()). Whichever runs first wins the race.
+			setpgid(pid,pid);
 
 			//Add the pid and solver to the map
 			if(! pidToSolverMap.insert(std::make_pair(pid,*s)).second )
 			{
 				cerr << "SolverManager::invokeSolvers() : Failed toSolverManager::invokeSolvers() associate solver " << (*s)->toString() <<
 						"with PID:" << pid << endl;
+				closeStartBarrier();
+
+				//Without a start pipe it is already running and nothing else would stop it.
+				if(fastSpawn)
+				{
+					kill(pid,SIGKILL);
+					waitpid(pid,NULL,0);
+				}
 				return false;
 			}
 
 			(*s)->setPID(pid);
+			started++;
+			if(tracer) tracer->solverEvent(*s,Trace::FORKED);
+
+			if((*s)->getLimits().timeout > 0.0)
+				solverDeadlines[*s]=add(lastTierLaunch,fromDouble((*s)->getLimits().timeout));
+
+			//Pipe EOF tells us a solver is done. Its pidfd lets us reap it as soon as it exits.
+			if(!events.watchReadable((*s)->getReadFileDescriptor(),*s))
+			{
+				closeStartBarrier();
+				return false;
+			}
+			events.watchProcess(pid,*s);
 		}
 	}
 
-	/* (Parent). All the solvers have now been created. They should all be blocked on our semaphore.
-	 * We'll now release the semaphores in the hope that all the solvers will get a fair (depends on
-	 * your OS's scheduler) start.
+	/* (Parent). All the solvers of the tier have now been created. Unless they were clone()'d they should all be
+	 * blocked on the start pipe. We'll now release them together with a single write in the hope that all the
+	 * solvers will get a fair (depends on your OS's scheduler) start.
 	 */
-	for(int numberOfSolvers=0; numberOfSolvers < solvers.size(); numberOfSolvers++)
-		sem_post(solverSynchronisingSemaphore);
-
-	//record the start time
-	if(clock_gettime(CLOCK_MONOTONIC,&startTime) == -1)
-		cerr << "WARNING: Failed to record start time!" << endl;
+	if(tracer)
+	{
+		stringstream name;
+		name << "fork tier " << tier;
+		tracer->phase(name.str(),launchStart);
+	}
 
+	if(startBarrier[1] != -1)
+	{
+		TracedPhase p(tracer,"release");
+		vector<char> release(started,'g');
+		size_t written=0;
+		while(written < release.size())
+		{
+			ssize_t w=write(startBarrier[1],&release[written],release.size() - written);
+			if(w == -1 && errno == EINTR)
+				continue;
 
+			if(w == -1)
+			{
+				//The solvers we couldn't release see end of file and exit without running.
+				perror("SolverManager::invokeSolvers() : Failed to release solvers:");
+				break;
+			}
 
-	Solver* solverOfInterest=NULL;
-	int numberOfReadySolvers=0;
-	int numberOfUsableSolvers=solvers.size();
-	int status=0;
+			written+=w;
+		}
+		closeStartBarrier();
+	}
 
-	Solver* winningSolver=NULL;
-	Solver::Result solverResult=Solver::ERROR;
+	numberOfUsableSolvers+=started;
+	return true;
+}
 
-	while(numberOfUsableSolvers!=0)
+void SolverManager::closeStartBarrier()
+{
+	for(int end=0; end < 2; end++)
 	{
-		setupFileDescriptorSet();
+		if(startBarrier[end] != -1)
+			close(startBarrier[end]);
+		startBarrier[end]=-1;
+	}
+}
 
-		//Now wait for a solver to return.
-		if(timeoutEnabled())
-		{
-			numberOfReadySolvers = pselect(largestFileDescriptor +1,&lookingToRead,NULL,NULL,&timeout,NULL);
-		}
-		else
-		{
-			numberOfReadySolvers = pselect(largestFileDescriptor +1,&lookingToRead,NULL,NULL,NULL,NULL);
-		}
+pid_t SolverManager::spawnSolver(Solver* s)
+{
+	/* Block signals until the new process has reset its handlers (see startSolver()).
+	 * Ours must never run in a process that shares our memory.
+	 */
+	sigset_t all, mask;
+	sigfillset(&all);
+	sigprocmask(SIG_SETMASK,&all,&mask);
 
-		if(numberOfReadySolvers==0)
-		{
-			//Timeout expired!
-			cerr << "Timeout expired!" << endl;
-			if(loggingMode) printUnfinishedSolversToLog();
-			return false;
-		}
+	//Looked up here because the new process can only make async-signal-safe calls.
+	int firstRealtimeSignal=SIGRTMIN;
 
-		if(numberOfReadySolvers == -1)
+	pid_t pid=-1;
+	if(fastSpawn)
+	{
+		if(spawnStack == NULL)
 		{
-			switch(errno)
-			{
-				case EBADF:
-					cerr << "Bad file descriptor in set given to pselect()" << endl;
-					return false;
-				case EINTR:
-					//Unexpected signal
-					cerr << "Received unexpected signal while waiting in pselect()" << endl;
-					return false;
-
-				case EINVAL:
-					//Invalid parameters
-					cerr << "Invalid parameters given to pselect()" << endl;
-					return false;
-
-				default:
-					cerr << "Something went wrong waiting for solver via pselect()" << endl;
-					return false;
-			}
+			void* stack=mmap(NULL,SPAWN_STACK_SIZE,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,-1,0);
+			if(stack != MAP_FAILED)
+				spawnStack=stack;
 		}
 
-		solverOfInterest = getSolverFromFileDescriptorSet();
-		if(solverOfInterest==NULL)
+		if(spawnStack != NULL)
 		{
-			cerr << "Error: Couldn't find solver from its file descriptor." << endl;
-			return false;
+			SpawnArguments* arguments=static_cast<SpawnArguments*>(spawnStack);
+			arguments->manager=this;
+			arguments->solver=s;
+			arguments->mask=mask;
+			arguments->firstRealtimeSignal=firstRealtimeSignal;
+
+			/* Share our memory rather than copy it (and our page tables) like fork() does.
+			 * The process has its own file descriptors and signal handlers and only
+			 * reads what it is given until it exec()s. CLONE_VFORK suspends us until
+			 * then, like posix_spawn(), because the process also runs on this thread's
+			 * thread-local storage. It has to be left alone (errno included) while it
+			 * is in use.
+			 */
+			int error=errno;
+			pid=clone(cloneEntry,static_cast<char*>(spawnStack) + SPAWN_STACK_SIZE,CLONE_VM | CLONE_VFORK | SIGCHLD,arguments);
+			if(pid != -1)
+				errno=error; //The process may have left its own there (e.g. if exec() failed).
 		}
+	}
+	else
+	{
+		fflush(stdout);
+		fflush(stderr);
+		pid=fork();
 
+		if(pid == 0)
+			startSolver(s,mask,firstRealtimeSignal,startBarrier);
+	}
 
-		if(verbose) cerr << "Solver:" << solverOfInterest->toString() << " returned. Checking result..." << endl;
+	int error=errno;
+	sigprocmask(SIG_SETMASK,&mask,NULL);
+	errno=error;
+	return pid;
+}
 
-		//remove that solver from the file descriptor map.
-		removeSolverFromFileDescriptorSet(solverOfInterest);
+int SolverManager::cloneEntry(void* arg)
+{
+	SpawnArguments* arguments=static_cast<SpawnArguments*>(arg);
+	const int noBarrier[2]={-1,-1};
+	arguments->manager->startSolver(arguments->solver,arguments->mask,arguments->firstRealtimeSignal,noBarrier);
+	return 1;
+}
 
-		solverResult=solverOfInterest->getResult();
-		switch(solverResult)
-		{
-			case Solver::SAT:
+void SolverManager::startSolver(Solver* s, const sigset_t& mask, int firstRealtimeSignal, const int barrier[2])
+{
+	/* If there is a start pipe we will now block until the NSolv parent process
+	 * lets us go by writing a byte for us. Signals are blocked so there are no
+	 * interruptions. Our copy of the write end must go or we'd never see end of
+	 * file, which means NSolv gave up on the tier (or died) and the solver
+	 * mustn't run.
+	 */
+	if(barrier[0] != -1)
+	{
+		close(barrier[1]);
+		char go;
+		ssize_t r;
+		do
+			r=read(barrier[0],&go,1);
+		while(r == -1 && errno == EINTR);
+
+		if(r != 1)
+			_exit(1);
+	}
+	double released= tracer? Trace::now() : 0;
 
-				if(verbose) cerr << "Result: sat" << endl;
+	/* The solver gets the default signal handlers and the signal mask we had. Signals
+	 * ignored by whoever started us stay ignored (as they would across exec()) but
+	 * not those we ignore ourselves. The signals glibc keeps for itself (between the
+	 * standard ones and SIGRTMIN) are left alone, as are SIGKILL and SIGSTOP.
+	 */
+	for(int signal=1; signal < NSIG; signal++)
+	{
+		if(signal == SIGKILL || signal == SIGSTOP || (signal > 31 && signal < firstRealtimeSignal))
+			continue;
 
-				if(winningSolver==NULL)
-				{
+		struct sigaction action;
+		if(sigaction(signal,NULL,&action) == -1 || action.sa_handler == SIG_DFL)
+			continue;
 
-					winningSolver=solverOfInterest;//Record the solver that won so we can print its output later.
+		if(action.sa_handler == SIG_IGN)
+		{
+			bool ours=false;
+			for(size_t i=0; i < sizeof(IGNORED_BY_NSOLV) / sizeof(IGNORED_BY_NSOLV[0]); i++)
+				ours|= IGNORED_BY_NSOLV[i] == signal;
 
-					if(loggingMode)
-						loggingFile << "#First solver to finish " << solverOfInterest->toString() << endl;
-				}
+			if(!ours)
+				continue;
+		}
 
-				if(!loggingMode)
-				{
-					//We don't want to let any other solvers run
-					numberOfUsableSolvers=0;
-					continue;
-				}
-				else
-				{
-					//Log output
-					printSolverAnswerToLog(solverResult,solverOfInterest->toString());
+		action.sa_handler=SIG_DFL;
+		action.sa_flags=0;
+		if(sigaction(signal,&action,NULL) == -1)
+		{
+			//Our handler must never run in the solver (let alone in memory it shares with us).
+			const char message[]="SolverManager::startSolver() : Failed to reset a signal handler\n";
+			ssize_t ignored=write(STDERR_FILENO,message,sizeof(message) - 1);
+			(void) ignored;
+			_exit(1);
+		}
+	}
+	sigprocmask(SIG_SETMASK,&mask,NULL);
 
-					//Try the other solvers.
-					adjustRemainingTime();
-					numberOfUsableSolvers--;
-					continue;
-				}
+	//The solver finds the input through /proc/self/fd so it must inherit it.
+	sharedInput.shareWithChild();
 
-			case Solver::UNSAT:
+	if(tracer) tracer->childStarting(released);
 
-				if(verbose) cerr << "Result: unsat" << endl;
+	//Child code
+	s->exec();
+}
 
-				if(winningSolver==NULL)
-				{
-						winningSolver=solverOfInterest;//Record the winning solver so we can output its output later.
+const std::string& SolverManager::getInputFile() const
+{
+	return inputFile;
+}
 
-						if(loggingMode)
-							loggingFile << "#First solver to finish " << solverOfInterest->toString() << endl;
-				}
+size_t SolverManager::getNumberOfSolvers()
+{
+	return solvers.size();
+}
 
+void SolverManager::setTierDelay(double delay)
+{
+	tierDelay=fromDouble(delay);
+}
 
-				if(!loggingMode)
-				{
-					//We don't want to let any other solvers run
-					numberOfUsableSolvers=0;
-					continue;
-				}
-				else
-				{
-					//Log output
-					printSolverAnswerToLog(solverResult,solverOfInterest->toString());
+void SolverManager::setKillGrace(double grace)
+{
+	killGrace=fromDouble(grace);
+}
 
-					//Try the other solvers.
-					adjustRemainingTime();
-					numberOfUsableSolvers--;
-					continue;
-				}
+void SolverManager::stopSolvers()
+{
+	if(phase == FINISHED)
+		return;
+	TracedPhase stopping(tracer,"stop solvers");
 
+	while(phase != FINISHED)
+		stepStop(true);
+}
 
-			case Solver::UNKNOWN:
-				if(verbose) cerr << "Result: unknown" << endl << "Trying another solver..." << endl;
+void SolverManager::beginStop()
+{
+	phase=STOPPING;
+	stopStarted=true;
+	stopExpired=false;
+
+	//The pipes (and a cancellation) don't matter anymore and would keep waking us up.
+	for(map<int,Solver*>::const_iterator i=fdToSolverMap.begin(); i != fdToSolverMap.end(); ++i)
+		events.unwatchReadable(i->first);
+	if(cancelFd != -1)
+		events.unwatchReadable(cancelFd);
+	if(winningSolver != NULL)
+		events.unwatchReadable(winningSolver->getReadFileDescriptor());
+
+	/* Solvers that already exited (e.g. a wrapper script that failed) may have left
+	 * children behind in their process group so every group is signalled.
+	 */
+	for(vector<Solver*>::iterator s=solvers.begin(); s != solvers.end(); ++s)
+	{
+		if((*s)->isStarted())
+		{
+			(*s)->kill(SIGTERM);
+			if(tracer && !reaped.count((*s)->getPID())) tracer->solverEvent(*s,Trace::KILLED);
+			stopping.push_back(*s);
+		}
+	}
 
-				if(loggingMode) printSolverAnswerToLog(solverResult,solverOfInterest->toString());
-				//Try another solver
-				adjustRemainingTime();
-				numberOfUsableSolvers--;
-				continue;
+	clock_gettime(CLOCK_MONOTONIC,&stopDeadline);
+	stopDeadline=add(stopDeadline,killGrace);
+	events.setDeadline(stopDeadline);
+}
 
-			case Solver::ERROR:
-				cerr << "Result: Solver (" << solverOfInterest->toString() <<
-						") failed." << endl << "Trying another solver..." << endl;
+bool SolverManager::stepStop(bool block)
+{
+	//Solvers that are still racing are sent SIGTERM first.
+	if(!stopStarted)
+	{
+		beginStop();
+		return true;
+	}
 
-				if(loggingMode) printSolverAnswerToLog(solverResult,solverOfInterest->toString());
+	//Reap solvers as they exit until they all have or the grace period is over.
+	size_t left=0;
+	for(vector<Solver*>::iterator s=stopping.begin(); s != stopping.end(); ++s)
+	{
+		reapSolver(*s);
+		if(!(*s)->hasExited())
+			left++;
+	}
 
-				//Try another solver
-				adjustRemainingTime();
-				numberOfUsableSolvers--;
-				continue;
+	if(left == 0 || stopExpired)
+	{
+		finishStop();
+		return true;
+	}
 
-			default:
-				return false;
+	if(exitsWatched)
+	{
+		ready.clear();
+		int n=events.wait(ready,block? -1 : 0);
+		if(n == -1)
+		{
+			if(errno != EINTR)
+				stopExpired=true;
+			return true;
 		}
 
+		for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+		{
+			if(e->type == EventEngine::TIMER)
+				stopExpired=true;
+		}
+		return n > 0;
 	}
 
-	if(winningSolver==NULL)
+	//No pidfds so poll for exits instead.
+	timespec current;
+	if(block)
 	{
-		cerr << "SolverManager::invokeSolvers() : Ran out of usable solvers!" << endl;
-		return false;
+		timespec pause={0,10000000};
+		nanosleep(&pause,NULL);
+		clock_gettime(CLOCK_MONOTONIC,&current);
+		stopExpired= current >= stopDeadline;
+		return true;
 	}
-	else
+
+	//The timer wakes up whoever is waiting for getFileDescriptor() to poll again.
+	ready.clear();
+	events.wait(ready,0);
+	clock_gettime(CLOCK_MONOTONIC,&current);
+	if(current >= stopDeadline)
 	{
-		/* kill all other solvers if possible.
-		 * For some reason if we don't do this calling dumpResult() on the winning solver
-		 * blocks. I don't know why, it shouldn't happen because the file descriptor of each solver
-		 * should be separate from each other.
-		 */
+		stopExpired=true;
+		return true;
+	}
+
+	timespec poll=add(current,fromDouble(0.01));
+	events.setDeadline(stopDeadline > poll? poll : stopDeadline);
+	return false;
+}
+
+void SolverManager::finishStop()
+{
+	events.clearDeadline();
+
+	/* Stragglers and anything the solvers started (even if the solver itself has
+	 * exited) get SIGKILL which can't be ignored.
+	 */
+	for(vector<Solver*>::iterator s=stopping.begin(); s != stopping.end(); ++s)
+	{
+		(*s)->kill(SIGKILL);
 
-		for(vector<Solver*>::iterator i=solvers.begin(); i!= solvers.end(); ++i)
+		if(!(*s)->hasExited())
 		{
-			if(*i != winningSolver)
-				(*i)->kill();
+			int status=0;
+			struct rusage usage;
+			if(wait4((*s)->getPID(),&status,0,&usage) == (*s)->getPID())
+			{
+				reaped.insert((*s)->getPID());
+				(*s)->setExitStatus(status,usage);
+				if(tracer) tracer->solverEvent(*s,Trace::REAPED);
+			}
 		}
-
-		//print the output of the winning solver
-		winningSolver->dumpResult();
-		return true;
 	}
 
+	phase=FINISHED;
 }
 
-size_t SolverManager::getNumberOfSolvers()
+bool SolverManager::hasTimedOut() const
 {
-	return solvers.size();
+	return timedOut;
 }
 
-bool SolverManager::timeoutEnabled() {
-	return (originalTimeout.tv_sec != 0);
+void SolverManager::setCancelFd(int fd)
+{
+	cancelFd=fd;
 }
 
-
-void SolverManager::adjustRemainingTime()
+bool SolverManager::wasCancelled() const
 {
-	timespec current;
-	if(clock_gettime(CLOCK_MONOTONIC,&current) == -1)
-	{
-		cerr << "Failed to determine current time." << endl;
-		return;
-	}
+	return cancelled;
+}
 
-	//calculate elapsed time since start
-	timespec elapsedTime= subtract(current,startTime);
+Solver::Result SolverManager::getResult() const
+{
+	return raceResult;
+}
 
-	if(elapsedTime >= originalTimeout)
-		timeout.tv_sec= timeout.tv_nsec =0;
-	else
-		timeout= subtract(originalTimeout,elapsedTime);
+const std::string& SolverManager::getWinner() const
+{
+	return winnerName;
+}
 
-	if(verbose && timeoutEnabled()) cerr << "Remaining time:" << toDouble(timeout) << " second(s)." << endl;
+bool SolverManager::timeoutEnabled() {
+	return (originalTimeout.tv_sec != 0 || originalTimeout.tv_nsec != 0);
 }
 
-void SolverManager::setupFileDescriptorSet()
+
+void SolverManager::reapSolver(Solver* s)
 {
-	//set no file descriptors
-	FD_ZERO(&lookingToRead);
-	largestFileDescriptor=0;
+	pid_t pid=s->getPID();
+	if(pid == 0 || reaped.count(pid))
+		return;
 
-	//Add the file descriptors currently in the map.
-	for(map<int,Solver*>::const_iterator i= fdToSolverMap.begin(); i!= fdToSolverMap.end(); ++i)
-	{
-		//Try to record the largest file descriptor
-		if(i->first > largestFileDescriptor) largestFileDescriptor=i->first;
+	int status=0;
+	struct rusage usage;
+	if(wait4(pid,&status,WNOHANG,&usage) != pid)
+		return;
+
+	//Still running solvers must stay watched so that we hear when they exit.
+	events.unwatchProcess(pid);
+	reaped.insert(pid);
+	s->setExitStatus(status,usage);
+	if(tracer) tracer->solverEvent(s,Trace::REAPED);
 
-		FD_SET(i->first,&lookingToRead);
+	if(verbose)
+	{
+		if(WIFEXITED(status))
+			cerr << "SolverManager: Solver " << s->toString() << " exited with status " << WEXITSTATUS(status) << endl;
+		else if(WIFSIGNALED(status))
+			cerr << "SolverManager: Solver " << s->toString() << " was killed by signal " << WTERMSIG(status) << endl;
 	}
 }
 
-Solver* SolverManager::getSolverFromFileDescriptorSet()
+int SolverManager::expireSolvers(const timespec& current)
 {
-	//Loop through known solvers using the first found solver
-	for(vector<Solver*>::const_iterator i=solvers.begin(); i!= solvers.end(); ++i)
+	vector<Solver*> expired;
+	for(map<Solver*,timespec>::const_iterator d=solverDeadlines.begin(); d != solverDeadlines.end(); ++d)
+	{
+		if(current >= d->second)
+			expired.push_back(d->first);
+	}
+
+	for(vector<Solver*>::const_iterator s=expired.begin(); s != expired.end(); ++s)
 	{
-		if(FD_ISSET((*i)->getReadFileDescriptor(),&lookingToRead))
-			return *i;
+		if(verbose) cerr << "SolverManager: Solver " << (*s)->toString() << " ran out of time (" <<
+				(*s)->getLimits().timeout << " s)" << endl;
+
+		if(loggingMode)
+			addRunToLog(*s,"timeout",toDouble(subtract(current,startTime)));
+
+		//It has lost so it doesn't get a grace period (see stopSolvers()).
+		(*s)->kill(SIGKILL);
+		if(tracer) tracer->solverEvent(*s,Trace::KILLED);
+		events.unwatchReadable((*s)->getReadFileDescriptor());
+		removeSolverFromFileDescriptorSet(*s);
 	}
 
-	//We didn't find anything.
-	return NULL;
+	return expired.size();
 }
 
 void SolverManager::removeSolverFromFileDescriptorSet(Solver* s)
@@ -484,40 +1339,57 @@ void SolverManager::removeSolverFromFileDescriptorSet(Solver* s)
 		{
 			//remove this solver
 			fdToSolverMap.erase(i);
+			solverDeadlines.erase(s);
 			return;
 		}
 	}
 }
 
+void SolverManager::setLogFormat(RaceLog::Format format)
+{
+	raceLog.setFormat(format);
+}
+
+void SolverManager::setFastSpawn(bool fast)
+{
+	fastSpawn=fast;
+}
+
 void SolverManager::listSolversToLog()
 {
-	if(!loggingFile.good())
-		return;
+	timespec now;
+	clock_gettime(CLOCK_REALTIME,&now);
 
-	loggingFile << "# " << solvers.size() << " solvers: ";
+	raceLogged=true;
+	logRecord.query=queryName;
+	logRecord.startTime=toDouble(now);
 
 	for(vector<Solver*>::const_iterator i=solvers.begin(); i!= solvers.end(); ++i)
-	{
-		loggingFile << (*i)->toString() << "," ;
-	}
-
-	loggingFile << endl;
+		logRecord.solvers.push_back((*i)->toString());
 }
 
-void SolverManager::printSolverHeaderToLog()
+void SolverManager::printFingerprintToLog()
 {
-	if(!loggingFile.good())
-		return;
+	Fingerprinter f;
+	string fingerprint;
+	if(f.computeFile(inputFile,fingerprint))
+		logRecord.fingerprint=fingerprint;
+}
 
-	loggingFile << "# [Solver name ] [ time (seconds)] [answer]" << endl;
+void SolverManager::printFeaturesToLog(const QueryFeatures& features)
+{
+	logRecord.features=features.toString();
 }
 
-void SolverManager::printSolverAnswerToLog(Solver::Result result,
-		const std::string& name)
+void SolverManager::printWinnerToLog(Solver* winner)
 {
-	if(!loggingFile.good())
-		return;
+	logRecord.winner=winner->toString();
+	logRecord.winningTier=winner->getTier();
+	logRecord.result=Solver::resultToString(winner->getResult());
+}
 
+void SolverManager::printSolverAnswerToLog(Solver::Result result, Solver* s)
+{
 	timespec current;
 	if(clock_gettime(CLOCK_MONOTONIC,&current) == -1)
 	{
@@ -528,16 +1400,20 @@ void SolverManager::printSolverAnswerToLog(Solver::Result result,
 	//calculate elapsed time since start
 	timespec elapsedTime = subtract(current,startTime);
 
-	loggingFile << name << " " << toDouble(elapsedTime) << " " << Solver::resultToString(result) << endl;
-
-
+	addRunToLog(s,Solver::resultToString(result),toDouble(elapsedTime));
 }
 
-void SolverManager::printUnfinishedSolversToLog()
+void SolverManager::printSkippedSolversToLog()
 {
-	if(!loggingFile.good())
-		return;
+	for(vector<Solver*>::const_iterator i=solvers.begin(); i!= solvers.end(); ++i)
+	{
+		if(!(*i)->isStarted())
+			addRunToLog(*i,"skipped",0.0);
+	}
+}
 
+void SolverManager::printUnfinishedSolversToLog(const std::string& answer)
+{
 	timespec current;
 	if(clock_gettime(CLOCK_MONOTONIC,&current) == -1)
 	{
@@ -550,8 +1426,63 @@ void SolverManager::printUnfinishedSolversToLog()
 
 	for(map<int,Solver*>::const_iterator i= fdToSolverMap.begin() ; i!= fdToSolverMap.end(); ++i)
 	{
-		loggingFile << i->second->toString() << " " << toDouble(elapsedTime) << " timeout" << endl;
+		//Solvers of later tiers that never started are logged by printSkippedSolversToLog()
+		if(i->second->isStarted())
+			addRunToLog(i->second,answer,toDouble(elapsedTime));
+	}
+}
+
+void SolverManager::addRunToLog(Solver* s, const std::string& answer, double elapsed)
+{
+	SolverRun run;
+	run.solver=s->toString();
+	run.tier=s->getTier();
+	run.cpus=CpuTopology::toString(s->getCpus());
+	run.answer=answer;
+	run.time=elapsed;
+
+	//The same solver can be in the portfolio more than once (with other options) so its name isn't enough.
+	run.solverIndex=find(solvers.begin(),solvers.end(),s) - solvers.begin();
+	logRecord.runs.push_back(run);
+}
+
+void SolverManager::writeLog()
+{
+	for(vector<SolverRun>::iterator run=logRecord.runs.begin(); run != logRecord.runs.end(); ++run)
+	{
+		Solver* s=solvers[run->solverIndex];
+		if(s->hasExited())
+		{
+			int status=s->getExitStatus();
+			if(WIFEXITED(status))
+				run->exitCode=WEXITSTATUS(status);
+			else if(WIFSIGNALED(status))
+				run->signal=WTERMSIG(status);
+
+			const struct rusage& usage=s->getUsage();
+			run->userTime=toDouble(usage.ru_utime);
+			run->systemTime=toDouble(usage.ru_stime);
+			run->maxRss=usage.ru_maxrss;
+			run->voluntarySwitches=usage.ru_nvcsw;
+			run->involuntarySwitches=usage.ru_nivcsw;
+		}
+
+		//The race was decided by the winner or else by the last solver to give up.
+		if(logRecord.winner.empty() ? run->time > logRecord.time : s == winningSolver)
+			logRecord.time=run->time;
+
+		if(logRecord.winner.empty() && run->answer == "unknown")
+			logRecord.result=run->answer;
 	}
+
+	if(logRecord.winner.empty() && timedOut)
+		logRecord.result="timeout";
+	else if(logRecord.winner.empty() && cancelled)
+		logRecord.result="cancelled";
+	else if(logRecord.result.empty())
+		logRecord.result="error";
+
+	raceLog.append(logRecord);
 }
 
 struct timespec subtract(struct timespec a, struct timespec b)
@@ -568,7 +1499,7 @@ struct timespec subtract(struct timespec a, struct timespec b)
 		((a.tv_sec == b.tv_sec) && (a.tv_nsec < b.tv_nsec) )
 	  )
 	{
-		result.tv_sec = result.tv_sec =0;
+		result.tv_sec = result.tv_nsec =0;
 		return result;
 	}
 
@@ -587,6 +1518,22 @@ struct timespec subtract(struct timespec a, struct timespec b)
 	return result;
 }
 
+struct timespec add(struct timespec a, struct timespec b)
+{
+	struct timespec result;
+	result.tv_sec = a.tv_sec + b.tv_sec;
+	result.tv_nsec = a.tv_nsec + b.tv_nsec;
+
+	//carry into the seconds.
+	if(result.tv_nsec >= 1000000000L)
+	{
+		result.tv_sec +=1;
+		result.tv_nsec -= 1000000000L;
+	}
+
+	return result;
+}
+
 double toDouble(struct timespec t)
 {
 	double value = t.tv_sec;
@@ -594,6 +1541,22 @@ double toDouble(struct timespec t)
 	return value;
 }
 
+double toDouble(struct timeval t)
+{
+	return t.tv_sec + t.tv_usec / 1E6;
+}
+
+struct timespec fromDouble(double seconds)
+{
+	double intPart;
+	double fraction=modf(seconds,&intPart);
+
+	struct timespec result;
+	result.tv_sec=static_cast<time_t>(intPart);
+	result.tv_nsec=static_cast<long>(fraction * 1E9);
+	return result;
+}
+
 bool operator==(struct timespec a, struct timespec b)
 {
 	if(a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec)
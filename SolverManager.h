@@ -27,71 +27,320 @@
 #include <unistd.h>
 #include <time.h>
 #include <queue>
-#include <sys/select.h>
-#include <semaphore.h>
+#include <set>
+#include <signal.h>
+#include "EventEngine.h"
+#include "SharedInput.h"
+#include "RaceLog.h"
+
+class ResultCache;
+class QueryFeatures;
+class Trace;
 
 class SolverManager
 {
 	public:
-		SolverManager(const std::string& _inputFile, double _timeOut, bool _loggingMode);
+		/* If "shareInput" is true the input is copied into memory once (see SharedInput)
+		 * and the solvers read that copy instead of the file. An "_inputFile" of "-"
+		 * means stdin which is always copied.
+		 *
+		 * Logging mode is used if "_loggingPath" isn't empty (see RaceLog). "_verbose"
+		 * reports what is happening on stderr and the race is recorded in "_tracer" if
+		 * it isn't NULL. Check isValid() afterwards.
+		 */
+		SolverManager(const std::string& _inputFile, double _timeOut, const std::string& _loggingPath, bool shareInput,
+				bool _verbose=false, Trace* _tracer=NULL);
+
+		//As above but the query is the "length" bytes at "query", which are copied. "name" is for messages and the log.
+		SolverManager(const char* query, size_t length, const std::string& name, double _timeOut, const std::string& _loggingPath,
+				bool _verbose=false, Trace* _tracer=NULL);
 		~SolverManager();
-		void addSolver(const std::string& name, const std::string& cmdLineArgs, bool inputOnStdin);
-		void addSolver(const std::string& name, bool inputOnStdin);
+
+		//False if the input or the log couldn't be set up. Nothing else will work.
+		bool isValid() const;
+
+		//Returns false if the solver couldn't be added.
+		bool addSolver(const std::string& name, const std::string& cmdLineArgs, bool inputOnStdin);
+
+		//As above but the solver is pinned to "cpus" (see Solver::setCpus()), started with "tier" and limited by "limits".
+		bool addSolver(const std::string& name, const std::string& cmdLineArgs, bool inputOnStdin,
+				const std::vector<int>& cpus, unsigned int tier, const ResourceLimits& limits);
+		bool addSolver(const std::string& name, bool inputOnStdin);
 		bool invokeSolvers();
 
+		//Same as invokeSolvers() but the winning solver's output is appended to "output" instead of stdout.
+		bool invokeSolvers(std::string& output);
+
 		size_t getNumberOfSolvers();
 
+		//Where solvers read the input from. The path of the in-memory copy if there is one.
+		const std::string& getInputFile() const;
+
+		/* Solvers of tier 0 start at once. Each following tier starts "delay" seconds after
+		 * the one before unless a solver has already answered sat or unsat. A solver that
+		 * answers unknown or fails starts the next tier straight away.
+		 */
+		void setTierDelay(double delay);
+
+		/* Solvers still running once the race is over get SIGTERM and then, if they
+		 * (or anything they started) haven't exited "grace" seconds later, SIGKILL.
+		 */
+		void setKillGrace(double grace);
+
+		//How logging mode writes the log (TEXT by default).
+		void setLogFormat(RaceLog::Format format);
+
+		/* Start solvers with clone(CLONE_VM | CLONE_VFORK) (the default) so that our memory
+		 * isn't copied for each of them, or with fork() if "fast" is false (e.g. for valgrind
+		 * which doesn't support CLONE_VM).
+		 */
+		void setFastSpawn(bool fast);
+
+		//True if the last invokeSolvers() failed because the timeout expired.
+		bool hasTimedOut() const;
+
+		/* End the race (with invokeSolvers() returning false) as soon as "fd" is readable.
+		 * Nothing is read from it. -1 (the default) means the race can't be cancelled.
+		 */
+		void setCancelFd(int fd);
+
+		//True if the last invokeSolvers() failed because it was cancelled (see setCancelFd()).
+		bool wasCancelled() const;
+
+		/* What the last invokeSolvers() answered (SAT or UNSAT) if it succeeded. Otherwise
+		 * UNKNOWN if a solver answered unknown (and none answered sat or unsat), or ERROR.
+		 */
+		Solver::Result getResult() const;
+
+		//The solver that won the last invokeSolvers(). Empty if there was no winner or the answer was cached.
+		const std::string& getWinner() const;
+
+		/* Answer repeated queries from "cache" (may be NULL). In logging mode the
+		 * solvers are always run so the cache is only written to.
+		 */
+		void setResultCache(ResultCache* cache);
+
+		/* The race of invokeSolvers(output) in steps that never block, so that one thread
+		 * can run many races (see AsyncNSolv). startRace() starts the solvers. After that
+		 * call continueRace() whenever getFileDescriptor() is readable. The timeout and
+		 * tier delay make it readable too.
+		 *
+		 * Once isDecided() the race is over and hasWinner(), the getters above and
+		 * "output" won't change. The losers are still being stopped (see setKillGrace())
+		 * until isFinished(). Every solver has been reaped by then.
+		 */
+		void startRace(std::string& output);
+		void continueRace();
+		bool isDecided() const;
+		bool isFinished() const;
+		int getFileDescriptor() const;
+
+		//True if the race was won (what invokeSolvers() returns).
+		bool hasWinner() const;
+
+		//End a race that hasn't been decided with hasWinner() and wasCancelled() true.
+		void cancelRace();
+
 	private:
 		std::vector<Solver*> solvers;
 		std::map<pid_t,Solver*> pidToSolverMap;
-		std::string inputFile;
+		std::string inputFile; //The path of "sharedInput" if it is in use.
+		std::string queryName; //The input as given to us
+		SharedInput sharedInput;
 		const std::string empty;
 
-		timespec timeout;
 		timespec startTime;
 		timespec originalTimeout;
 
+		//Solvers we are still waiting for, by the read end of their pipe.
 		std::map<int,Solver*> fdToSolverMap;
 
-		fd_set lookingToRead;
-		int largestFileDescriptor;
+		//When solvers with a timeout of their own (see ResourceLimits) are given up on.
+		std::map<Solver*,timespec> solverDeadlines;
+
+		//Waits for solver pipes, solver exits and the deadline.
+		EventEngine events;
+
+		//Solvers that have already been reaped (by PID).
+		std::set<pid_t> reaped;
+
+		//Failed solvers whose result waits for their exit status (see Solver::getResult()).
+		std::set<Solver*> awaitingExit;
+
+		//True if the event engine reports solver exits.
+		bool exitsWatched;
 
 		bool loggingMode;
-		std::ofstream loggingFile;
+		bool timedOut;
+
+		//Logging mode builds up a record of the race which is written when we are done.
+		RaceLog raceLog;
+		RaceRecord logRecord;
+		bool raceLogged; //False until a race has started
+
+		//Solvers of the tier being launched with fork() wait on this pipe (see launchNextTier()). -1 otherwise.
+		int startBarrier[2];
 
-		sem_t* solverSynchronisingSemaphore;
-		std::string solverSyncName;
+		bool valid;
+		bool verbose;
+		Trace* tracer;
+
+		int cancelFd;
+		bool cancelled;
+
+		Solver::Result raceResult;
+		std::string winnerName;
+
+		ResultCache* resultCache;
+
+		//Distinct tiers of the solvers in the order they are started.
+		std::vector<unsigned int> tiers;
+		size_t tiersLaunched;
+		timespec lastTierLaunch;
+		timespec tierDelay;
+
+		timespec killGrace;
+
+		/* Where the race is up to. RACING waits for an answer, DUMPING (for startRace()
+		 * only) copies the winner's output and STOPPING waits for the solvers to exit.
+		 */
+		enum Phase
+		{
+			READY,
+			RACING,
+			DUMPING,
+			STOPPING,
+			FINISHED
+		};
+		Phase phase;
+
+		//What race() keeps between steps
+		bool won;
+		Solver* winningSolver;
+		int numberOfUsableSolvers;
+		std::string cacheKey;
+		std::string* raceOutput; //NULL for stdout
+		size_t outputStart; //Where the winner's output starts in "raceOutput"
+		double dumpStart;
+		std::vector<EventEngine::Event> ready;
+
+		//Solvers whose process groups were sent SIGTERM by beginStop() (whether they had exited or not) and get SIGKILL.
+		std::vector<Solver*> stopping;
+		timespec stopDeadline;
+		bool stopStarted;
+		bool stopExpired;
+
+		bool fastSpawn;
+
+		/* Stack of the processes started with clone(). We are suspended until each one
+		 * has exec()'d (or exited) so they can all use the same one. NULL until needed.
+		 */
+		void* spawnStack;
 
 		bool timeoutEnabled();
 
+		//What both constructors do apart from loading the input. Returns false if we aren't valid.
+		bool initialise(double timeout, const std::string& loggingPath);
+
+		//Kill every started solver (see setKillGrace()) and reap them. Only does anything once.
+		void stopSolvers();
+
+		//stopSolvers() in steps. beginStop() sends SIGTERM and stepStop() reaps.
+		void beginStop();
+		bool stepStop(bool block);
+		void finishStop();
+
+		//Start the solvers of the next tier and add them to "numberOfUsableSolvers".
+		bool launchNextTier(int& numberOfUsableSolvers);
+
+		//Close both ends of the start pipe. Solvers still waiting on it exit without running.
+		void closeStartBarrier();
+
+		/* Start a process for "s" which exec()s the solver. With fork() it waits on the
+		 * start pipe first. With clone() we wait until it has exec()'d instead so its
+		 * solver starts straight away. Returns its PID or -1 on failure.
+		 */
+		pid_t spawnSolver(Solver* s);
+
+		/* Run in the new process until the solver is exec()'d. The process may share our
+		 * memory so only async-signal-safe calls are allowed. "mask" is the signal mask
+		 * to restore, "firstRealtimeSignal" SIGRTMIN and "barrier" the start pipe of
+		 * the tier (-1s if there isn't one).
+		 */
+		void startSolver(Solver* s, const sigset_t& mask, int firstRealtimeSignal, const int barrier[2]);
+
+		static int cloneEntry(void* arg);
+
+		//Run the race. If "output" is NULL the winning solver's output goes to stdout.
+		bool race(std::string* output);
 
-		/*Adjust timeout so that is OriginalTimeout - (currentTime - startTime)
-		 * This is needed because if a solver finishes and it has a useless answer we should
-		 * wait for the next available solver but only for the remaining time left from what the
-		 * user originally asked for.
+		/* The steps of race(). beginRace() starts the solvers. stepRace() handles the
+		 * events of one wait, which only blocks if "block" is true. The step functions
+		 * return false if nothing happened.
 		 */
-		void adjustRemainingTime();
+		void beginRace(std::string* output);
+		bool stepRace(bool block);
+		bool stepDump();
 
-		//Configures "lookingToRead" to be set up for the solvers in "fdToSolverMap"
-		void setupFileDescriptorSet();
+		//We have a winner. Its output is copied straight away if "block" is true.
+		void finishRace(bool block);
 
-		Solver* getSolverFromFileDescriptorSet();
+		//The race is decided. The solvers are stopped next.
+		void endRace(bool _won);
+
+		//Try to answer the query from the cache. "key" is set if the query could be hashed.
+		bool answerFromCache(std::string& key, std::string* output);
+
+
+		/* Handle the answer of a solver whose pipe is readable. Sets "winningSolver" if it
+		 * won and updates "numberOfUsableSolvers". Returns false if the race must stop.
+		 */
+		bool checkResult(Solver* solverOfInterest, Solver*& winningSolver, int& numberOfUsableSolvers);
+
+		//Reap a solver that has exited (see EventEngine::EXITED).
+		void reapSolver(Solver* s);
 
 		void removeSolverFromFileDescriptorSet(Solver* s);
 
+		/* Kill the solvers whose own timeout has expired by "current" so that their CPUs
+		 * are free for the others. Returns the number of solvers killed.
+		 */
+		int expireSolvers(const timespec& current);
+
 		void listSolversToLog();
 
-		void printSolverHeaderToLog();
+		//Record the canonical fingerprint (see Fingerprinter) of the query so duplicate queries can be found.
+		void printFingerprintToLog();
+
+		//Record the features of the query (see QueryFeatures) so PortfolioSelector can learn from the log.
+		void printFeaturesToLog(const QueryFeatures& features);
+
+		//Record the solver that won the race.
+		void printWinnerToLog(Solver* winner);
+
+		void printSolverAnswerToLog(Solver::Result result, Solver* s);
+
+		//Log the solvers that are still running as having given "answer" (e.g. "timeout").
+		void printUnfinishedSolversToLog(const std::string& answer);
+
+		//Record the solvers of tiers that were never started.
+		void printSkippedSolversToLog();
 
-		void printSolverAnswerToLog(Solver::Result result, const std::string& name);
+		//Add a run of "s" that ended with "answer" "elapsed" seconds into the race.
+		void addRunToLog(Solver* s, const std::string& answer, double elapsed);
 
-		void printUnfinishedSolversToLog();
+		//Fill in how the solvers exited and append the record to the log. Only once they have all been reaped.
+		void writeLog();
 
 };
 
 //helper function a -b
 struct timespec subtract(struct timespec a, struct timespec b);
+//helper function a +b
+struct timespec add(struct timespec a, struct timespec b);
 double toDouble(struct timespec t);
+double toDouble(struct timeval t);
+struct timespec fromDouble(double seconds);
 
 bool operator==(struct timespec a, struct timespec b);
 bool operator>(struct timespec a, struct timespec b);
@@ -0,0 +1,348 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "SolverPool.h"
+#include "SolverManager.h"
+#include "SmtLib.h"
+#include "global.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <cstdio>
+#include <errno.h>
+#include <signal.h>
+
+using namespace std;
+
+SolverPool::SolverPool(const Portfolio& portfolio) :
+members(), querySequence(0), resultCache(portfolio.getResultCache()), events()
+{
+	originalTimeout=fromDouble(portfolio.getTimeout());
+
+	//A solver that dies while we write to it must not kill us.
+	signal(SIGPIPE,SIG_IGN);
+
+	const vector<SolverDescription>& solvers=portfolio.getSolvers();
+	for(vector<SolverDescription>::const_iterator s=solvers.begin(); s != solvers.end(); ++s)
+	{
+		Member m;
+		m.solver=new InteractiveSolver(s->name,s->cmdOptions);
+		m.busy=false;
+		members.push_back(m);
+
+		//Start the solvers now so that they are warm for the first query.
+		m.solver->start();
+	}
+
+	if(verbose) cerr << "SolverPool: Started pool of " << members.size() << " solver(s)" << endl;
+}
+
+SolverPool::~SolverPool()
+{
+	for(vector<Member>::iterator m=members.begin(); m != members.end(); ++m)
+	{
+		delete m->solver;
+		m->solver=NULL;
+	}
+}
+
+size_t SolverPool::getNumberOfSolvers()
+{
+	return members.size();
+}
+
+bool SolverPool::timeoutEnabled()
+{
+	return originalTimeout.tv_sec != 0 || originalTimeout.tv_nsec != 0;
+}
+
+bool SolverPool::invokeSolvers(const std::string& inputFile, std::string& output)
+{
+	if(resultCache == NULL)
+	{
+		Solver::Result result=Solver::ERROR;
+		return race(inputFile,output,result);
+	}
+
+	//Repeated queries don't need any solvers
+	string key;
+	bool haveKey=resultCache->computeKey(inputFile,key);
+	Solver::Result result=Solver::ERROR;
+	string answer;
+
+	if(haveKey && resultCache->lookup(key,result,answer))
+	{
+		output.append(answer);
+		return true;
+	}
+
+	if(!race(inputFile,answer,result))
+		return false;
+
+	if(haveKey)
+		resultCache->store(key,result,answer);
+
+	output.append(answer);
+	return true;
+}
+
+bool SolverPool::race(const std::string& inputFile, std::string& output, Solver::Result& winningResult)
+{
+	querySequence++;
+	stringstream s;
+	s << "nsolv-pool-" << getpid() << "-" << querySequence;
+	string marker=s.str();
+
+	string payload;
+	if(!buildPayload(inputFile,marker,payload))
+		return false;
+
+	//The members taking part in the race
+	vector<Member*> racing;
+
+	for(vector<Member>::iterator m=members.begin(); m != members.end(); ++m)
+	{
+		if(!reclaim(*m))
+			continue;
+
+		m->solver->send(payload);
+		m->busy=true;
+		m->marker=marker;
+		racing.push_back(&(*m));
+	}
+
+	if(racing.empty())
+	{
+		cerr << "SolverPool::invokeSolvers() : There are no solvers to invoke." << endl;
+		return false;
+	}
+
+	if(clock_gettime(CLOCK_MONOTONIC,&startTime) == -1)
+		cerr << "WARNING: Failed to record start time!" << endl;
+
+	Member* winner=NULL;
+
+	while(!racing.empty())
+	{
+		//Unlike select() epoll copes with descriptors of any value.
+		vector<int> readFds;
+		vector<int> writeFds;
+
+		for(vector<Member*>::const_iterator m=racing.begin(); m != racing.end(); ++m)
+		{
+			int fd=(*m)->solver->getReadFileDescriptor();
+			if(events.watchReadable(fd,NULL))
+				readFds.push_back(fd);
+
+			if((*m)->solver->hasPendingInput())
+			{
+				fd=(*m)->solver->getWriteFileDescriptor();
+				if(events.watchWritable(fd,NULL))
+					writeFds.push_back(fd);
+			}
+		}
+
+		if(timeoutEnabled())
+			events.setDeadline(add(startTime,originalTimeout));
+
+		vector<EventEngine::Event> ready;
+		int numberOfEvents=events.wait(ready);
+		int error=errno;
+
+		for(vector<int>::const_iterator fd=readFds.begin(); fd != readFds.end(); ++fd)
+			events.unwatchReadable(*fd);
+		for(vector<int>::const_iterator fd=writeFds.begin(); fd != writeFds.end(); ++fd)
+			events.unwatchWritable(*fd);
+		events.clearDeadline();
+
+		if(numberOfEvents == -1)
+		{
+			errno=error;
+			perror("SolverPool: Something went wrong waiting for solvers via epoll");
+			return false;
+		}
+
+		set<int> readable;
+		set<int> writable;
+		bool expired=false;
+		for(vector<EventEngine::Event>::const_iterator e=ready.begin(); e != ready.end(); ++e)
+		{
+			if(e->type == EventEngine::READABLE)
+				readable.insert(e->fd);
+			else if(e->type == EventEngine::WRITABLE)
+				writable.insert(e->fd);
+			else if(e->type == EventEngine::TIMER)
+				expired=true;
+		}
+
+		if(expired && readable.empty() && writable.empty())
+		{
+			cerr << "Timeout expired!" << endl;
+
+			//These are stuck on the query so get fresh ones for the next query.
+			for(vector<Member*>::iterator m=racing.begin(); m != racing.end(); ++m)
+				(*m)->solver->stop();
+
+			return false;
+		}
+
+		vector<Member*> stillRacing;
+		for(vector<Member*>::iterator i=racing.begin(); i != racing.end(); ++i)
+		{
+			Member* m=*i;
+			bool alive=true;
+
+			if(writable.count(m->solver->getWriteFileDescriptor()))
+				alive=m->solver->flushInput();
+
+			if(alive && readable.count(m->solver->getReadFileDescriptor()))
+				alive=m->solver->readOutput();
+
+			string& out=m->solver->getOutput();
+			size_t markerPosition=m->solver->findMarker(m->marker);
+
+			if(m == winner)
+			{
+				//Wait for the whole answer of the winner.
+				if(markerPosition != string::npos || !alive)
+				{
+					output.append(out,0,markerPosition == string::npos? out.size() : markerPosition);
+					m->solver->clearOutput();
+					m->busy=false;
+
+					if(!alive)
+					{
+						cerr << "SolverPool: Solver " << m->solver->toString() << " exited before finishing its answer." << endl;
+						m->solver->stop();
+					}
+
+					return true;
+				}
+
+				stillRacing.push_back(m);
+				continue;
+			}
+
+			Solver::Result result=Solver::ERROR;
+			if(!SmtLib::parseCheckSatResponse(out.substr(0,markerPosition),markerPosition != string::npos || !alive,result))
+			{
+				stillRacing.push_back(m);
+				continue;
+			}
+
+			if(verbose) cerr << "Solver:" << m->solver->toString() << " returned " << Solver::resultToString(result) << endl;
+
+			if(!alive)
+			{
+				cerr << "Result: Solver (" << m->solver->toString() << ") failed." << endl;
+				m->solver->stop();
+				continue;
+			}
+
+			if((result == Solver::SAT || result == Solver::UNSAT) && winner == NULL)
+			{
+				/* We have a winner. The others are left to finish
+				 * in the background. reclaim() will sort them out.
+				 */
+				winner=m;
+				winningResult=result;
+				stillRacing.clear();
+				stillRacing.push_back(m);
+
+				//The winner may have already sent everything.
+				if(markerPosition != string::npos)
+				{
+					output.append(out,0,markerPosition);
+					m->solver->clearOutput();
+					m->busy=false;
+					return true;
+				}
+				break;
+			}
+
+			if(result == Solver::ERROR)
+				cerr << "Result: Solver (" << m->solver->toString() << ") failed." << endl << "Trying another solver..." << endl;
+		}
+
+		racing=stillRacing;
+	}
+
+	cerr << "SolverPool::invokeSolvers() : Ran out of usable solvers!" << endl;
+	return false;
+}
+
+bool SolverPool::reclaim(Member& m)
+{
+	if(m.solver->isRunning() && m.busy)
+	{
+		//See if it finished the last query while we weren't looking.
+		bool alive=m.solver->flushInput() && m.solver->readOutput();
+
+		if(alive && !m.solver->hasPendingInput() && m.solver->findMarker(m.marker) != string::npos)
+			m.busy=false;
+		else
+		{
+			if(verbose) cerr << "SolverPool: Solver " << m.solver->toString() << " is unresponsive. Restarting it." << endl;
+			m.solver->stop();
+		}
+	}
+
+	if(!m.solver->isRunning())
+	{
+		if(!m.solver->start())
+		{
+			cerr << "SolverPool: Failed to start solver " << m.solver->toString() << endl;
+			return false;
+		}
+		m.busy=false;
+	}
+
+	m.solver->clearOutput();
+	return true;
+}
+
+bool SolverPool::buildPayload(const std::string& inputFile, const std::string& marker, std::string& payload)
+{
+	ifstream f(inputFile.c_str(), ios_base::in | ios_base::binary);
+	if(!f.good())
+	{
+		cerr << "SolverPool: Couldn't open input file " << inputFile << endl;
+		return false;
+	}
+
+	stringstream script;
+	script << f.rdbuf();
+
+	vector<string> commands;
+	if(!SmtLib::splitCommands(script.str(),commands))
+		cerr << "SolverPool: Warning " << inputFile << " ends with an incomplete command." << endl;
+
+	for(vector<string>::const_iterator c=commands.begin(); c != commands.end(); ++c)
+	{
+		//(exit) would kill the solver and we want to keep it.
+		if(SmtLib::commandName(*c) == "exit")
+			continue;
+
+		payload+=*c;
+		payload+='\n';
+	}
+
+	payload+="(echo \"" + marker + "\")\n(reset)\n";
+	return true;
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SOLVERPOOL_H_
+#define SOLVERPOOL_H_
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include "InteractiveSolver.h"
+#include "Portfolio.h"
+#include "Solver.h"
+#include "ResultCache.h"
+#include "EventEngine.h"
+
+/* A warm pool of solvers (one InteractiveSolver per solver in the portfolio)
+ * that are reused across queries so that solver start up is only paid once.
+ *
+ * Each query is written to every solver's standard input followed by
+ *
+ * (echo "<marker>")
+ * (reset)
+ *
+ * The marker tells us where the answer to the query ends and (reset) makes
+ * the solver ready for the next query. Losing solvers are not killed; they
+ * finish the query in the background and are reused if they have reached
+ * the marker by the time the next query arrives. Solvers that have
+ * crashed or are still busy are restarted.
+ *
+ * Only performance mode is supported.
+ */
+class SolverPool
+{
+	public:
+		SolverPool(const Portfolio& portfolio);
+		~SolverPool();
+
+		//Race the solvers on "inputFile". The winning solver's output is appended to "output".
+		bool invokeSolvers(const std::string& inputFile, std::string& output);
+
+		size_t getNumberOfSolvers();
+
+	private:
+		struct Member
+		{
+			InteractiveSolver* solver;
+
+			//True if the solver hasn't reached the marker of its last query.
+			bool busy;
+			std::string marker;
+		};
+
+		std::vector<Member> members;
+
+		timespec originalTimeout;
+		timespec startTime;
+
+		unsigned long querySequence;
+
+		//May be NULL
+		ResultCache* resultCache;
+
+		//Only watches the racing solvers while race() waits for them.
+		EventEngine events;
+
+		bool timeoutEnabled();
+
+		//Run the race on "inputFile". "result" is set to the answer of the winner.
+		bool race(const std::string& inputFile, std::string& output, Solver::Result& result);
+
+		//Make a member ready for a new query (restarting it if necessary). Returns false if it can't be used.
+		bool reclaim(Member& m);
+
+		//Build what is written to each solver for the query in "inputFile". Returns false on failure.
+		bool buildPayload(const std::string& inputFile, const std::string& marker, std::string& payload);
+};
+
+#endif /* SOLVERPOOL_H_ */
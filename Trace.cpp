@@ -0,0 +1,316 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Trace.h"
+#include "Solver.h"
+#include <iostream>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+using namespace std;
+
+//How many solvers can record childStarting()
+static const unsigned int CHILD_SLOTS=4096;
+
+//Chrome trace events are in microseconds
+static void appendTime(string& out, double seconds)
+{
+	char number[64];
+	snprintf(number,sizeof(number),"%.3f",seconds * 1E6);
+	out+=number;
+}
+
+static void appendString(string& out, const string& s)
+{
+	out+='"';
+	for(string::const_iterator c=s.begin(); c != s.end(); ++c)
+	{
+		if(*c == '"' || *c == '\\')
+			out+='\\';
+
+		if(static_cast<unsigned char>(*c) < 0x20)
+			out+=' ';
+		else
+			out+=*c;
+	}
+	out+='"';
+}
+
+static void appendEvent(string& out, const string& name, const char* category, char phase, pid_t process, pid_t thread, double start)
+{
+	char ids[64];
+	snprintf(ids,sizeof(ids),"\"pid\":%d,\"tid\":%d",(int) process,(int) thread);
+
+	out+= out.empty()? "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" : ",\n";
+	out+="{\"name\":";
+	appendString(out,name);
+	out+=",\"cat\":\"";
+	out+=category;
+	out+="\",\"ph\":\"";
+	out+=phase;
+	out+="\",";
+	out+=ids;
+	out+=",\"ts\":";
+	appendTime(out,start);
+}
+
+//A phase that lasted from "start" to "end"
+static void appendComplete(string& out, const string& name, const char* category, pid_t process, pid_t thread, double start, double end)
+{
+	appendEvent(out,name,category,'X',process,thread,start);
+	out+=",\"dur\":";
+	appendTime(out,end - start);
+	out+="}";
+}
+
+static void appendInstant(string& out, const string& name, const char* category, pid_t process, pid_t thread, double time)
+{
+	appendEvent(out,name,category,'i',process,thread,time);
+	out+=",\"s\":\"t\"}";
+}
+
+//Names a process or thread (track) in the viewer
+static void appendName(string& out, const char* what, const string& name, pid_t process, pid_t thread)
+{
+	appendEvent(out,what,"__metadata",'M',process,thread,0);
+	out+=",\"args\":{\"name\":";
+	appendString(out,name);
+	out+="}}";
+}
+
+Trace::Trace() :
+fd(-1), owner(0), phases(), tracks(), shared(NULL), capacity(0)
+{
+
+}
+
+Trace::~Trace()
+{
+	if(fd != -1)
+		close(fd);
+
+	if(shared != NULL)
+		munmap(shared,sizeof(SharedSlots) + capacity * sizeof(ChildSlot));
+}
+
+bool Trace::open(const std::string& path)
+{
+	fd=::open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+	if(fd == -1)
+	{
+		cerr << "Trace: Couldn't open " << path << " for writing" << endl;
+		return false;
+	}
+
+	owner=getpid();
+
+	//Solvers record when they start in here before exec() replaces them.
+	void* memory=mmap(NULL,sizeof(SharedSlots) + CHILD_SLOTS * sizeof(ChildSlot),PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS,-1,0);
+	if(memory == MAP_FAILED)
+		perror("Trace: mmap: Solvers won't record when they started:");
+	else
+	{
+		shared=static_cast<SharedSlots*>(memory);
+		capacity=CHILD_SLOTS;
+	}
+
+	return true;
+}
+
+double Trace::now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+void Trace::phase(const std::string& name, double start)
+{
+	Phase p;
+	p.name=name;
+	p.start=start;
+	p.end=now();
+	phases.push_back(p);
+}
+
+void Trace::solverEvent(Solver* s, SolverEvent event)
+{
+	double time=now();
+	pid_t pid=s->getPID();
+
+	map<pid_t,SolverTrack>::iterator t=tracks.find(pid);
+	if(t == tracks.end())
+	{
+		SolverTrack track;
+		track.name=s->toString();
+		for(int e=0; e < NUMBER_OF_EVENTS; e++)
+			track.times[e]=-1;
+
+		t=tracks.insert(make_pair(pid,track)).first;
+	}
+
+	if(t->second.times[event] < 0)
+		t->second.times[event]=time;
+}
+
+void Trace::childStarting(double released)
+{
+	if(shared == NULL)
+		return;
+
+	unsigned int slot=__sync_fetch_and_add(&(shared->used),1);
+	if(slot >= capacity)
+		return;
+
+	shared->slots[slot].released=released;
+	shared->slots[slot].executing=now();
+	shared->slots[slot].pid=getpid();
+}
+
+const char* Trace::eventName(SolverEvent event)
+{
+	switch(event)
+	{
+		case FORKED: return "forked";
+		case RELEASED: return "released";
+		case EXECUTING: return "exec";
+		case FIRST_BYTE: return "first byte";
+		case DECIDED: return "decided";
+		case KILLED: return "killed";
+		case REAPED: return "reaped";
+		case FLUSHED: return "output flushed";
+		default: return "unknown";
+	}
+}
+
+bool Trace::write()
+{
+	if(fd == -1 || getpid() != owner)
+		return false;
+
+	//Add what the solvers recorded themselves
+	unsigned int used= shared != NULL? shared->used : 0;
+	for(unsigned int i=0; i < used && i < capacity; i++)
+	{
+		map<pid_t,SolverTrack>::iterator t=tracks.find(shared->slots[i].pid);
+		if(t == tracks.end())
+			continue;
+
+		t->second.times[RELEASED]=shared->slots[i].released;
+		t->second.times[EXECUTING]=shared->slots[i].executing;
+	}
+
+	string out;
+	appendName(out,"process_name","nsolv",owner,owner);
+	appendName(out,"thread_name","nsolv",owner,owner);
+
+	for(vector<Phase>::const_iterator p=phases.begin(); p != phases.end(); ++p)
+		appendComplete(out,p->name,"nsolv",owner,owner,p->start,p->end);
+
+	for(map<pid_t,SolverTrack>::const_iterator t=tracks.begin(); t != tracks.end(); ++t)
+	{
+		const double* times=t->second.times;
+
+		char label[32];
+		snprintf(label,sizeof(label)," (%d)",(int) t->first);
+		appendName(out,"thread_name",t->second.name + label,owner,t->first);
+
+		//The solver's whole life and the stages it went through before it stopped running.
+		double first=-1, last=-1;
+		for(int e=0; e < NUMBER_OF_EVENTS; e++)
+		{
+			if(times[e] < 0)
+				continue;
+
+			if(first < 0 || times[e] < first)
+				first=times[e];
+			if(times[e] > last)
+				last=times[e];
+		}
+
+		if(first < 0)
+			continue;
+
+		appendComplete(out,t->second.name,"solver",owner,t->first,first,last);
+
+		double stopped=-1;
+		const SolverEvent stops[]={DECIDED, KILLED, REAPED};
+		for(size_t s=0; s < sizeof(stops) / sizeof(stops[0]); s++)
+		{
+			if(times[stops[s]] >= 0 && (stopped < 0 || times[stops[s]] < stopped))
+				stopped=times[stops[s]];
+		}
+
+		if(times[FORKED] >= 0 && times[RELEASED] >= times[FORKED])
+			appendComplete(out,"blocked","solver",owner,t->first,times[FORKED],times[RELEASED]);
+		if(times[RELEASED] >= 0 && times[EXECUTING] >= times[RELEASED])
+			appendComplete(out,"setup","solver",owner,t->first,times[RELEASED],times[EXECUTING]);
+		if(times[EXECUTING] >= 0 && stopped >= times[EXECUTING])
+			appendComplete(out,"running","solver",owner,t->first,times[EXECUTING],stopped);
+
+		for(int e=0; e < NUMBER_OF_EVENTS; e++)
+		{
+			if(times[e] >= 0)
+				appendInstant(out,eventName(static_cast<SolverEvent>(e)),"solver",owner,t->first,times[e]);
+		}
+	}
+
+	out+= out.empty()? "{\"traceEvents\":[]}\n" : "\n]}\n";
+
+	if(lseek(fd,0,SEEK_SET) == -1 || ftruncate(fd,0) == -1)
+	{
+		perror("Trace: Couldn't rewind the trace file:");
+		return false;
+	}
+
+	const char* data=out.data();
+	size_t length=out.length();
+	while(length > 0)
+	{
+		ssize_t written=::write(fd,data,length);
+		if(written == -1 && errno == EINTR)
+			continue;
+
+		if(written == -1)
+		{
+			perror("Trace: Couldn't write the trace:");
+			return false;
+		}
+
+		data+=written;
+		length-=written;
+	}
+
+	return true;
+}
+
+TracedPhase::TracedPhase(Trace* _trace, const char* _name) :
+trace(_trace), name(_name), start(_trace != NULL? Trace::now() : 0)
+{
+
+}
+
+TracedPhase::~TracedPhase()
+{
+	if(trace != NULL)
+		trace->phase(name,start);
+}
@@ -0,0 +1,144 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unistd.h>
+
+class Solver;
+
+/* A timeline of where the time of a race went (see --trace), written as
+ * Chrome trace events so that it can be opened in chrome://tracing or
+ * https://ui.perfetto.dev
+ *
+ * NSolv's own phases (parsing options, sharing the input, launching a tier,
+ * copying the winner's output...) are on one track and every solver has a
+ * track of its own with the events of solverEvent().
+ *
+ * Code that records something is given a Trace (NSolv's is the global
+ * "tracer", see global.h) and checks it first. Tracing is off and nothing
+ * else is done when it is NULL.
+ *
+ * Times are CLOCK_MONOTONIC so solvers can record events in their own
+ * process before exec() (see childStarting()) on the same clock.
+ */
+class Trace
+{
+	public:
+		enum SolverEvent
+		{
+			FORKED, //The solver's process was created in NSolv
+			RELEASED, //The solver's process got past the start pipe (or started if it has none)
+			EXECUTING, //The solver's process is about to exec() the solver
+			FIRST_BYTE, //NSolv read the solver's first output
+			DECIDED, //NSolv decided the solver's result
+			KILLED, //NSolv first signalled the solver
+			REAPED, //NSolv reaped the solver
+			FLUSHED, //NSolv finished copying the winner's output
+			NUMBER_OF_EVENTS
+		};
+
+		Trace();
+		~Trace();
+
+		//Create "path" straight away so that a bad path is reported before any race. Returns false on failure.
+		bool open(const std::string& path);
+
+		//Seconds of CLOCK_MONOTONIC
+		static double now();
+
+		//A phase of NSolv that began at "start" and has just ended.
+		void phase(const std::string& name, double start);
+
+		//"event" just happened to "s" (which must have been started). Only the first of each event is kept.
+		void solverEvent(Solver* s, SolverEvent event);
+
+		/* Call in a solver's process just before exec(). "released" is when it got past
+		 * the start pipe (if any). Safe after fork() or clone() because it only writes to shared memory.
+		 */
+		void childStarting(double released);
+
+		//Write out everything recorded. Only the process that called open() writes anything.
+		bool write();
+
+	private:
+		struct Phase
+		{
+			std::string name;
+			double start;
+			double end;
+		};
+
+		struct SolverTrack
+		{
+			std::string name;
+			double times[NUMBER_OF_EVENTS]; //-1 if the event didn't happen
+		};
+
+		//What a solver's process recorded before exec(). Lives in memory shared with the solvers.
+		struct ChildSlot
+		{
+			pid_t pid;
+			double released;
+			double executing;
+		};
+
+		struct SharedSlots
+		{
+			unsigned int used;
+			ChildSlot slots[1];
+		};
+
+		int fd;
+		pid_t owner;
+		std::vector<Phase> phases;
+		std::map<pid_t,SolverTrack> tracks;
+		SharedSlots* shared;
+		unsigned int capacity;
+
+		static const char* eventName(SolverEvent event);
+
+		//Not copyable because we own the file descriptor and the shared memory
+		Trace(const Trace&);
+		Trace& operator=(const Trace&);
+};
+
+/* Records the enclosing scope as a phase of NSolv in "_trace" (if not NULL).
+ *
+ *	{
+ *		TracedPhase p(tracer,"dump output");
+ *		...
+ *	}
+ */
+class TracedPhase
+{
+	public:
+		TracedPhase(Trace* _trace, const char* _name);
+		~TracedPhase();
+
+	private:
+		Trace* trace;
+		const char* name;
+		double start;
+};
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,320 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Stress test for AsyncNSolv.
+ *
+ * Hundreds of queries are submitted at once and raced by portfolios of
+ * mock-solver (see mock_solver.cpp) on AsyncNSolv's single thread. One
+ * solver answers sat (or unsat) and the other never answers so it has to be
+ * killed. While they run we count our child processes, which must never be
+ * more than setMaxProcesses(). This is done with clone() and then with fork()
+ * (see AsyncNSolv::setFastSpawn()).
+ *
+ * Then cancel(), per-query timeouts (while running and while queued),
+ * setMaxPending() and callbacks are checked. No child may be left at the
+ * end.
+ *
+ * Usage: async-stress [--queries=N] [--max-processes=N] [--mock=path]
+ */
+#include "AsyncNSolv.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifndef MOCK_SOLVER_BINARY
+#define MOCK_SOLVER_BINARY "mock-solver"
+#endif
+
+using namespace std;
+
+static const char* QUERY="(set-logic QF_BV)\n(declare-fun x () (_ BitVec 8))\n(assert (= x #x01))\n(check-sat)\n";
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+static void sleepFor(double seconds)
+{
+	timespec t;
+	t.tv_sec=static_cast<time_t>(seconds);
+	t.tv_nsec=static_cast<long>((seconds - t.tv_sec) * 1E9);
+	nanosleep(&t,NULL);
+}
+
+static const char* value(const char* argument, const char* option)
+{
+	size_t length=strlen(option);
+	if(strncmp(argument,option,length) == 0 && argument[length] == '=')
+		return argument + length + 1;
+
+	return NULL;
+}
+
+//How many processes have us as their parent (zombies included)
+static unsigned int countChildren()
+{
+	DIR* d=opendir("/proc");
+	if(d == NULL)
+		return 0;
+
+	unsigned int children=0;
+	struct dirent* entry;
+	while((entry=readdir(d)) != NULL)
+	{
+		if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+			continue;
+
+		ifstream stat((string("/proc/") + entry->d_name + "/stat").c_str());
+		string line;
+		getline(stat,line);
+
+		//The parent is the second field after the command, which is in brackets.
+		size_t end=line.rfind(')');
+		if(end == string::npos)
+			continue;
+
+		istringstream fields(line.substr(end + 1));
+		string state;
+		pid_t parent=0;
+		if(fields >> state >> parent && parent == getpid())
+			children++;
+	}
+	closedir(d);
+	return children;
+}
+
+//Counts the queries it is told about
+class Counter : public NSolvCallback
+{
+	public:
+		Counter() : count(0)
+		{
+			pthread_mutex_init(&lock,NULL);
+		}
+
+		~Counter()
+		{
+			pthread_mutex_destroy(&lock);
+		}
+
+		void finished(NSolvFuture* future)
+		{
+			pthread_mutex_lock(&lock);
+			if(future->isFinished())
+				count++;
+			pthread_mutex_unlock(&lock);
+		}
+
+		unsigned int get()
+		{
+			pthread_mutex_lock(&lock);
+			unsigned int c=count;
+			pthread_mutex_unlock(&lock);
+			return c;
+		}
+
+	private:
+		pthread_mutex_t lock;
+		unsigned int count;
+};
+
+static bool check(bool ok, const string& what)
+{
+	cout << (ok? "  ok      " : "  FAILED  ") << what << endl;
+	return ok;
+}
+
+//Race "queries" queries at once, starting the solvers with clone() if "fast" and fork() otherwise.
+static bool raceMany(const string& mock, unsigned int queries, unsigned int maxProcesses, bool fast)
+{
+	cout << "Racing " << queries << " queries with at most " << maxProcesses << " solver processes started with " <<
+			(fast? "clone()" : "fork()") << endl;
+	AsyncNSolv portfolio;
+	portfolio.addSolver(mock,"--answer=none --delay=60000");
+	portfolio.addSolver(mock,"--answer=sat --delay=20");
+	portfolio.setMaxProcesses(maxProcesses);
+	portfolio.setFastSpawn(fast);
+	Counter counter;
+	bool success=true;
+
+	double start=now();
+	vector<NSolvFuture*> futures;
+	for(unsigned int q=0; q < queries; q++)
+		futures.push_back(portfolio.submit(QUERY,strlen(QUERY),0,&counter));
+	double submitted=now();
+
+	//Watch the processes while the races run
+	unsigned int mostChildren=0;
+	while(!futures.back()->isFinished())
+	{
+		mostChildren=max(mostChildren,countChildren());
+		sleepFor(0.005);
+	}
+
+	unsigned int answered=0;
+	for(vector<NSolvFuture*>::iterator f=futures.begin(); f != futures.end(); ++f)
+	{
+		if((*f)->getResult() == NSolv::SAT && (*f)->getOutput() == "sat\n" && !(*f)->getWinner().empty())
+			answered++;
+		(*f)->release();
+	}
+	double end=now();
+
+	//A race at a time would take at least 20 ms each
+	cout << "  Submitted in " << (submitted - start) << "s, answered in " << (end - start) << "s (" <<
+			(end - start) / queries * 1000 << " ms per query, at most " << mostChildren << " children)" << endl;
+
+	stringstream what;
+	what << answered << " of " << queries << " answered sat";
+	success&=check(answered == queries,what.str());
+	success&=check(mostChildren <= maxProcesses,"never more than --max-processes solvers");
+	success&=check(counter.get() == queries,"the callback was told about every query");
+
+	return success;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int queries=500;
+	unsigned int maxProcesses=2 * sysconf(_SC_NPROCESSORS_ONLN);
+	string mock(MOCK_SOLVER_BINARY);
+
+	for(int i=1; i < argc; i++)
+	{
+		const char* v;
+		if((v=value(argv[i],"--queries")) != NULL)
+			queries=atoi(v);
+		else if((v=value(argv[i],"--max-processes")) != NULL)
+			maxProcesses=atoi(v);
+		else if((v=value(argv[i],"--mock")) != NULL)
+			mock=v;
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--queries=N] [--max-processes=N] [--mock=path]" << endl;
+			return 1;
+		}
+	}
+
+	if(queries == 0 || maxProcesses < 2 || access(mock.c_str(),X_OK) != 0)
+	{
+		cerr << "Need at least one query, two processes and " << mock << " (build it with \"make bench\")" << endl;
+		return 1;
+	}
+
+	bool success=true;
+
+	success&=raceMany(mock,queries,maxProcesses,true);
+	success&=raceMany(mock,queries,maxProcesses,false);
+
+	{
+		AsyncNSolv portfolio;
+		portfolio.addSolver(mock,"--answer=none --delay=60000");
+		portfolio.addSolver(mock,"--answer=none --delay=60000");
+		portfolio.setMaxProcesses(2);
+		portfolio.setKillGrace(0.2);
+
+		//Runs until cancelled
+		NSolvFuture* cancelled=portfolio.submit(QUERY);
+		//Queued behind it until it runs out of time
+		NSolvFuture* queued=portfolio.submit(QUERY,0.2);
+
+		double start=now();
+		sleepFor(0.4);
+		bool queuedTimedOut= queued->isFinished() && queued->getResult() == NSolv::TIMEOUT;
+		success&=check(queuedTimedOut,"a queued query times out without starting");
+
+		start=now();
+		cancelled->cancel();
+		NSolv::Result r=cancelled->getResult();
+		double cancelTime=now() - start;
+		stringstream what;
+		what << "cancel() finishes a running race (in " << cancelTime * 1000 << " ms)";
+		success&=check(r == NSolv::CANCELLED && cancelTime < 0.1,what.str());
+
+		//Its solvers have to go before the next race starts
+		start=now();
+		NSolvFuture* timed=portfolio.submit(QUERY,0.3);
+		r=timed->getResult();
+		double timeoutTime=now() - start;
+		what.str("");
+		what << "a running query times out (after " << timeoutTime << " s)";
+		success&=check(r == NSolv::TIMEOUT && timeoutTime >= 0.3 && timeoutTime < 1.0,what.str());
+
+		cancelled->release();
+		queued->release();
+		timed->release();
+	}
+
+	{
+		AsyncNSolv portfolio;
+		portfolio.addSolver(mock,"--answer=unsat --delay=50");
+		portfolio.setMaxProcesses(1);
+		portfolio.setMaxPending(2);
+
+		//One race at a time and two waiting so submit() has to wait for races to finish.
+		double start=now();
+		vector<NSolvFuture*> futures;
+		for(unsigned int q=0; q < 8; q++)
+			futures.push_back(portfolio.submit(QUERY));
+		double submitTime=now() - start;
+
+		unsigned int answered=0;
+		for(vector<NSolvFuture*>::iterator f=futures.begin(); f != futures.end(); ++f)
+		{
+			if((*f)->getResult() == NSolv::UNSAT)
+				answered++;
+			(*f)->release();
+		}
+
+		stringstream what;
+		what << "submit() waits while setMaxPending() are queued (" << submitTime << " s for 8)";
+		success&=check(answered == 8 && submitTime >= 0.2,what.str());
+	}
+
+	{
+		//The destructor cancels what is left.
+		NSolvFuture* f=NULL;
+		{
+			AsyncNSolv portfolio;
+			portfolio.addSolver(mock,"--answer=none --delay=60000");
+			portfolio.setKillGrace(0.2);
+			f=portfolio.submit(QUERY);
+			sleepFor(0.1);
+		}
+		success&=check(f->isFinished() && f->getResult() == NSolv::CANCELLED,"destroying AsyncNSolv cancels its queries");
+		f->release();
+	}
+
+	success&=check(countChildren() == 0,"every solver was reaped");
+
+	cout << (success? "PASSED" : "FAILED") << endl;
+	return success? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Throughput benchmark for forwarding the winning solver's output.
+ *
+ * A forked child plays the winning solver and writes a model of the
+ * requested size into a pipe. The output is forwarded to stdout with the
+ * old fgetc()/putchar() loop and with Solver::forward(), with stdout
+ * pointing at /dev/null, a pipe (drained by another child) and a file.
+ *
+ * Usage: dump-bench [size in MiB]
+ */
+#include "Solver.h"
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+//Start a child that writes "size" bytes of model to a pipe. Returns the read end.
+static int startSolver(size_t size, pid_t& pid)
+{
+	int fd[2];
+	if(pipe(fd) == -1)
+	{
+		perror("pipe");
+		exit(1);
+	}
+
+	pid=fork();
+	if(pid == 0)
+	{
+		close(fd[0]);
+
+		string line="  (define-fun arr1 () (Array (_ BitVec 32) (_ BitVec 8)) ((as const (Array (_ BitVec 32) (_ BitVec 8))) #x00))\n";
+		string chunk;
+		while(chunk.size() < 65536)
+			chunk+=line;
+
+		while(size > 0)
+		{
+			size_t length= size < chunk.size()? size : chunk.size();
+			if(write(fd[1],chunk.data(),length) != static_cast<ssize_t>(length))
+				_exit(1);
+			size-=length;
+		}
+
+		_exit(0);
+	}
+
+	close(fd[1]);
+	return fd[0];
+}
+
+//The loop used by Solver::dumpResult() before splice().
+static void oldDump(int from)
+{
+	FILE* f=fdopen(from,"r");
+	int c=fgetc(f);
+	while(c != EOF)
+	{
+		putchar(c);
+		c=fgetc(f);
+	}
+	fflush(stdout);
+	fclose(f);
+}
+
+static void newDump(int from)
+{
+	Solver::forward(from,fileno(stdout));
+	close(from);
+}
+
+//Point stdout at "target" and time forwarding "size" bytes with "dump".
+static double run(void (*dump)(int), int target, size_t size)
+{
+	fflush(stdout);
+	int saved=dup(fileno(stdout));
+	dup2(target,fileno(stdout));
+
+	pid_t pid;
+	double start=now();
+	int from=startSolver(size,pid);
+	dump(from);
+	double elapsed=now() - start;
+
+	waitpid(pid,NULL,0);
+	dup2(saved,fileno(stdout));
+	close(saved);
+	return elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t mib= argc > 1? atoi(argv[1]) : 64;
+	size_t size=mib << 20;
+
+	//A reader at the end of a pipe, like a user piping nsolv into another program.
+	int drain[2];
+	if(pipe(drain) == -1)
+	{
+		perror("pipe");
+		return 1;
+	}
+
+	pid_t reader=fork();
+	if(reader == 0)
+	{
+		close(drain[1]);
+		char chunk[65536];
+		while(read(drain[0],chunk,sizeof(chunk)) > 0);
+		_exit(0);
+	}
+	close(drain[0]);
+
+	string file="/tmp/dump-bench.out";
+	int devNull=open("/dev/null",O_WRONLY);
+	int regular=open(file.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if(devNull == -1 || regular == -1)
+	{
+		perror("open");
+		return 1;
+	}
+
+	struct
+	{
+		const char* name;
+		int fd;
+	} targets[] = { {"/dev/null",devNull}, {"pipe",drain[1]}, {"file",regular} };
+
+	cerr << "Forwarding " << mib << " MiB of solver output" << endl;
+	for(size_t t=0; t < sizeof(targets) / sizeof(targets[0]); ++t)
+	{
+		ftruncate(regular,0);
+		lseek(regular,0,SEEK_SET);
+		double oldTime=run(oldDump,targets[t].fd,size);
+
+		ftruncate(regular,0);
+		lseek(regular,0,SEEK_SET);
+		double newTime=run(newDump,targets[t].fd,size);
+
+		cerr << targets[t].name << ": fgetc " << oldTime << " s (" << mib / oldTime << " MiB/s), forward " <<
+				newTime << " s (" << mib / newTime << " MiB/s), " << oldTime / newTime << "x" << endl;
+	}
+
+	close(drain[1]);
+	waitpid(reader,NULL,0);
+	close(devNull);
+	close(regular);
+	unlink(file.c_str());
+	return 0;
+}
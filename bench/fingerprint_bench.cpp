@@ -0,0 +1,182 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Micro-benchmark for SmtLexer and Fingerprinter.
+ *
+ * A KLEE style query of the requested size is generated in memory and then
+ * lexed and fingerprinted with and without SSE2. memchr() over the same
+ * buffer is timed too as an estimate of the memory bandwidth we can hope
+ * to reach.
+ *
+ * Usage: fingerprint-bench [size in MiB] [repetitions]
+ */
+#include "Fingerprint.h"
+#include "SmtLexer.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+/* Generate a query with "arrays" declared arrays. If "assertions" is zero
+ * assertions are added until the query is about "size" bytes and
+ * "assertions" is set to the number added.
+ *
+ * "offset" is added to the array names and if "reverse" is true the
+ * declarations are in the opposite order so that two queries generated
+ * with the same number of assertions are the same up to renaming.
+ */
+static void generateQuery(string& query, size_t size, size_t& assertions, unsigned int arrays, unsigned int offset, bool reverse)
+{
+	query.clear();
+	query.reserve(size + 4096);
+	query+="; Generated by fingerprint-bench\n(set-logic QF_AUFBV )\n";
+
+	for(unsigned int i=0; i < arrays; ++i)
+	{
+		unsigned int a= reverse? arrays - i - 1 : i;
+		stringstream s;
+		s << "(declare-fun arr" << (a + offset) << " () (Array (_ BitVec 32) (_ BitVec 8) ) )\n";
+		query+=s.str();
+	}
+
+	//Deterministic so every run sees the same query.
+	unsigned int seed=12345;
+	size_t added=0;
+	while(assertions == 0? query.size() < size : added < assertions)
+	{
+		++added;
+		seed=seed * 1103515245 + 12345;
+		unsigned int a=(seed >> 8) % arrays;
+		unsigned int index=(seed >> 4) % 64;
+		unsigned int constant=(seed >> 12) % 100000;
+
+		stringstream s;
+		s << "(assert (=  false (bvult  (concat  (select  arr" << (a + offset) << " (_ bv" << (index +1) <<
+			" 32) ) (select  arr" << (a + offset) << " (_ bv" << index << " 32) ) ) (_ bv" << constant << " 16) ) ) )\n";
+		query+=s.str();
+	}
+
+	query+="(check-sat)\n(exit)\n";
+	assertions=added;
+}
+
+static double megabytes(size_t bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+static void report(const char* name, size_t bytes, double seconds)
+{
+	cout << "  " << name << ": " << megabytes(bytes) / seconds << " MiB/s (" << seconds << " s)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t sizeMiB= argc > 1? strtoul(argv[1],NULL,10) : 64;
+	int repetitions= argc > 2? atoi(argv[2]) : 3;
+	if(sizeMiB == 0 || repetitions <= 0)
+	{
+		cerr << "Usage: " << argv[0] << " [size in MiB] [repetitions]" << endl;
+		return 1;
+	}
+
+	string query;
+	size_t assertions=0;
+	generateQuery(query,sizeMiB * 1024 * 1024,assertions,1000,1,false);
+	size_t bytes=query.size();
+	cout << "Query: " << megabytes(bytes) << " MiB, " << repetitions << " repetition(s)" << endl;
+
+	//Best of "repetitions" for each
+	double best[5] = {1E9, 1E9, 1E9, 1E9, 1E9};
+	size_t tokens[2] = {0, 0};
+	string fingerprints[2];
+
+	for(int r=0; r < repetitions; ++r)
+	{
+		double start=now();
+		size_t lines=0;
+		const char* p=query.data();
+		const char* end=p + bytes;
+		while((p=static_cast<const char*>(memchr(p,'\n',end - p))) != NULL)
+		{
+			++p;
+			++lines;
+		}
+		best[0]=min(best[0],now() - start);
+		if(lines == 0) cerr << "No lines?" << endl;
+
+		for(int v=0; v < 2; ++v)
+		{
+			start=now();
+			SmtLexer lexer(query.data(),bytes,v == 1);
+			SmtLexer::Token t;
+			size_t count=0;
+			while(lexer.next(t))
+				++count;
+			best[1 + v]=min(best[1 + v],now() - start);
+			tokens[v]=count;
+
+			Fingerprinter f(v == 1);
+			start=now();
+			fingerprints[v]=f.compute(query.data(),bytes);
+			best[3 + v]=min(best[3 + v],now() - start);
+		}
+	}
+
+	report("memchr (bandwidth estimate)",bytes,best[0]);
+	report("lexer, scalar",bytes,best[1]);
+	report("lexer, SSE2",bytes,best[2]);
+	report("fingerprint, scalar",bytes,best[3]);
+	report("fingerprint, SSE2",bytes,best[4]);
+
+	SmtLexer probe("",0);
+	if(!probe.isVectorised())
+		cout << "Warning: SSE2 is not available so both lexers are scalar." << endl;
+
+	//Sanity checks
+	bool ok=true;
+	if(tokens[0] != tokens[1] || fingerprints[0] != fingerprints[1])
+	{
+		cout << "ERROR: scalar and SSE2 results differ!" << endl;
+		ok=false;
+	}
+
+	string renamed;
+	generateQuery(renamed,0,assertions,1000,17,true);
+	Fingerprinter f;
+	if(f.compute(renamed.data(),renamed.size()) != fingerprints[1])
+	{
+		cout << "ERROR: renaming the arrays changed the fingerprint!" << endl;
+		ok=false;
+	}
+
+	cout << "Tokens: " << tokens[1] << ", fingerprint: " << fingerprints[1] << endl;
+	return ok? 0 : 1;
+}
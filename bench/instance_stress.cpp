@@ -0,0 +1,279 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Stress test for many NSolv processes starting at once.
+ *
+ * Hundreds of nsolv processes are started as fast as we can (so that many
+ * start in the same second) and each races a portfolio of mock-solver (see
+ * mock_solver.cpp). One solver answers sat and the others never answer so
+ * they have to be killed.
+ *
+ * Every nsolv must exit successfully, print sat and print nothing to
+ * stderr, and nothing of NSolv's may be left in /dev/shm afterwards.
+ *
+ * Usage: instance-stress [--instances=N] [--solvers=N] [--nsolv=path] [--mock=path]
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef NSOLV_BINARY
+#define NSOLV_BINARY "nsolv"
+#endif
+
+#ifndef MOCK_SOLVER_BINARY
+#define MOCK_SOLVER_BINARY "mock-solver"
+#endif
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+static const char* value(const char* argument, const char* option)
+{
+	size_t length=strlen(option);
+	if(strncmp(argument,option,length) == 0 && argument[length] == '=')
+		return argument + length + 1;
+
+	return NULL;
+}
+
+static void writeFile(const string& path, const string& contents)
+{
+	ofstream f(path.c_str());
+	f << contents;
+}
+
+static string readFile(const string& path)
+{
+	ifstream f(path.c_str());
+	stringstream s;
+	s << f.rdbuf();
+	return s.str();
+}
+
+//Anything in /dev/shm that could be NSolv's
+static set<string> sharedObjects()
+{
+	set<string> found;
+	DIR* d=opendir("/dev/shm");
+	if(d == NULL)
+		return found;
+
+	struct dirent* entry;
+	while((entry=readdir(d)) != NULL)
+	{
+		if(strstr(entry->d_name,"nsolv") != NULL)
+			found.insert(entry->d_name);
+	}
+	closedir(d);
+	return found;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int instances=500;
+	unsigned int numberOfSolvers=4;
+	string nsolv(NSOLV_BINARY);
+	string mock(MOCK_SOLVER_BINARY);
+
+	for(int i=1; i < argc; i++)
+	{
+		const char* v;
+		if((v=value(argv[i],"--instances")) != NULL)
+			instances=atoi(v);
+		else if((v=value(argv[i],"--solvers")) != NULL)
+			numberOfSolvers=atoi(v);
+		else if((v=value(argv[i],"--nsolv")) != NULL)
+			nsolv=v;
+		else if((v=value(argv[i],"--mock")) != NULL)
+			mock=v;
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--instances=N] [--solvers=N] [--nsolv=path] [--mock=path]" << endl;
+			return 1;
+		}
+	}
+
+	if(instances == 0 || numberOfSolvers == 0)
+	{
+		cerr << "Need at least one instance and one solver" << endl;
+		return 1;
+	}
+
+	if(access(nsolv.c_str(),X_OK) != 0 || access(mock.c_str(),X_OK) != 0)
+	{
+		cerr << "Can't execute " << nsolv << " or " << mock << " (see --nsolv and --mock)" << endl;
+		return 1;
+	}
+
+	//Symbolic links must point to an absolute path to work from bin/
+	char resolved[PATH_MAX];
+	if(realpath(mock.c_str(),resolved) != NULL)
+		mock=resolved;
+
+	char directoryTemplate[]="/tmp/nsolv-instances-XXXXXX";
+	if(mkdtemp(directoryTemplate) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	string directory(directoryTemplate);
+	string bin=directory + "/bin";
+	mkdir(bin.c_str(),0755);
+
+	//Everything we create so that it can be removed again
+	vector<string> created;
+
+	stringstream config;
+	for(unsigned int s=0; s < numberOfSolvers; s++)
+	{
+		stringstream name;
+		name << (s == 0? "winner" : "loser") << s;
+		config << "solver = " << name.str() << "\n";
+		config << name.str() << ".opts = " << (s == 0? "--answer=sat --delay=200" : "--answer=none --delay=60000") << "\n";
+
+		string link=bin + "/" + name.str();
+		if(symlink(mock.c_str(),link.c_str()) == -1)
+			perror("symlink");
+		created.push_back(link);
+	}
+	string configPath=directory + "/nsolv.cfg";
+	string query=directory + "/query.smt2";
+	writeFile(configPath,config.str());
+	writeFile(query,"(set-logic QF_BV)\n(declare-fun x () (_ BitVec 8))\n(assert (= x #x01))\n(check-sat)\n");
+	created.push_back(configPath);
+	created.push_back(query);
+
+	string path=bin + ":" + (getenv("PATH") != NULL? getenv("PATH") : "/usr/bin:/bin");
+	setenv("PATH",path.c_str(),1);
+
+	set<string> before=sharedObjects();
+
+	cout << "Starting " << instances << " instances of " << nsolv << " with " << numberOfSolvers << " solvers each" << endl;
+
+	//Start them all before waiting for any
+	double start=now();
+	vector<pid_t> pids(instances,-1);
+	vector<string> outputs, errors;
+	for(unsigned int i=0; i < instances; i++)
+	{
+		stringstream prefix;
+		prefix << directory << "/" << i;
+		string out=prefix.str() + ".out";
+		string err=prefix.str() + ".err";
+		outputs.push_back(out);
+		errors.push_back(err);
+		created.push_back(out);
+		created.push_back(err);
+
+		pid_t pid=fork();
+		if(pid == -1)
+		{
+			perror("fork");
+			break;
+		}
+
+		if(pid == 0)
+		{
+			int o=open(out.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+			int e=open(err.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+			if(o == -1 || e == -1 || dup2(o,1) == -1 || dup2(e,2) == -1)
+				_exit(126);
+			close(o);
+			close(e);
+
+			execl(nsolv.c_str(),nsolv.c_str(),"--config",configPath.c_str(),query.c_str(),(char*) NULL);
+			perror("exec nsolv");
+			_exit(127);
+		}
+
+		pids[i]=pid;
+	}
+	double started=now();
+
+	unsigned int failures=0;
+	for(unsigned int i=0; i < instances; i++)
+	{
+		if(pids[i] == -1)
+		{
+			failures++;
+			continue;
+		}
+
+		int status=0;
+		while(waitpid(pids[i],&status,0) == -1 && errno == EINTR);
+
+		string out=readFile(outputs[i]);
+		string err=readFile(errors[i]);
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || out.compare(0,4,"sat\n") != 0 || !err.empty())
+		{
+			//Only the first few so that a systematic failure doesn't flood the terminal
+			if(failures < 5)
+			{
+				cerr << "Instance " << i << " failed (status " << status << "), printed \"" << out.substr(0,out.find('\n')) <<
+						"\" and \"" << err.substr(0,err.find('\n')) << "\" on stderr" << endl;
+			}
+			failures++;
+		}
+	}
+	double end=now();
+
+	set<string> after=sharedObjects();
+	unsigned int leftovers=0;
+	for(set<string>::const_iterator o=after.begin(); o != after.end(); ++o)
+	{
+		if(before.count(*o) == 0)
+		{
+			cerr << "Left behind /dev/shm/" << *o << endl;
+			leftovers++;
+		}
+	}
+
+	for(vector<string>::const_iterator f=created.begin(); f != created.end(); ++f)
+		unlink(f->c_str());
+	rmdir(bin.c_str());
+	rmdir(directory.c_str());
+
+	cout << instances - failures << " of " << instances << " answered sat. Started in " << (started - start) <<
+			"s, all done in " << (end - start) << "s" << endl;
+
+	bool success= failures == 0 && leftovers == 0;
+	cout << (success? "PASSED" : "FAILED") << endl;
+	return success? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* A fake solver for measuring NSolv's own overhead (see overhead_bench.cpp).
+ *
+ * It reads the whole query (from the file given as its last argument, or
+ * stdin if there isn't one) like a real solver would and then behaves as
+ * its options say:
+ *
+ * --answer=<sat|unsat|unknown|none> What to answer (sat by default). none
+ *                                   exits without answering.
+ * --delay=<ms>                      Wait this long before answering.
+ * --model=<MiB>                     Print this much model after the answer.
+ * --chunk=<KiB>                     Size of each write of the model (64 by default).
+ * --stream=<ms>                     Wait this long between writes of the model.
+ * --ignore-term                     Ignore SIGTERM.
+ * --crash                           abort() instead of answering.
+ *
+ * If MOCK_SOLVER_STAMPS is set to a path, "<name> start <time>" is appended
+ * to it when the solver starts and "<name> answer <time>" just before it
+ * writes its answer. Times are seconds of CLOCK_MONOTONIC which is the
+ * same clock in every process. <name> is the name we were run as so that
+ * one binary can play every solver of a portfolio through symbolic links.
+ */
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+static void sleepFor(unsigned int milliseconds)
+{
+	timespec t;
+	t.tv_sec= milliseconds / 1000;
+	t.tv_nsec= (milliseconds % 1000) * 1000000L;
+
+	while(nanosleep(&t,&t) == -1 && errno == EINTR);
+}
+
+static bool writeAll(int fd, const char* data, size_t length)
+{
+	while(length > 0)
+	{
+		ssize_t written=write(fd,data,length);
+		if(written == -1 && errno == EINTR)
+			continue;
+
+		if(written == -1)
+			return false;
+
+		data+=written;
+		length-=written;
+	}
+
+	return true;
+}
+
+//Append one line to the stamp file in a single write so concurrent solvers don't interleave.
+static void stamp(const string& name, const char* event)
+{
+	const char* path=getenv("MOCK_SOLVER_STAMPS");
+	if(path == NULL || *path == '\0')
+		return;
+
+	char line[256];
+	int length=snprintf(line,sizeof(line),"%s %s %.9f\n",name.c_str(),event,now());
+
+	int fd=open(path,O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,0644);
+	if(fd == -1)
+		return;
+
+	if(length > 0 && (size_t) length < sizeof(line))
+		writeAll(fd,line,length);
+
+	close(fd);
+}
+
+//The value of "--option=value" if "arg" is "--option", otherwise NULL.
+static const char* value(const char* arg, const char* option)
+{
+	size_t length=strlen(option);
+	if(strncmp(arg,option,length) == 0 && arg[length] == '=')
+		return arg + length + 1;
+
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	string name(argv[0]);
+	if(name.rfind('/') != string::npos)
+		name=name.substr(name.rfind('/') + 1);
+
+	stamp(name,"start");
+
+	string answer("sat");
+	unsigned int delay=0;
+	unsigned long long modelSize=0;
+	size_t chunkSize=64 * 1024;
+	unsigned int streamDelay=0;
+	bool crash=false;
+	const char* input=NULL;
+
+	for(int i=1; i < argc; i++)
+	{
+		const char* v=NULL;
+		if((v=value(argv[i],"--answer")) != NULL)
+			answer=v;
+		else if((v=value(argv[i],"--delay")) != NULL)
+			delay=atoi(v);
+		else if((v=value(argv[i],"--model")) != NULL)
+			modelSize=strtoull(v,NULL,10) * 1024 * 1024;
+		else if((v=value(argv[i],"--chunk")) != NULL)
+			chunkSize=atoi(v) * 1024;
+		else if((v=value(argv[i],"--stream")) != NULL)
+			streamDelay=atoi(v);
+		else if(strcmp(argv[i],"--ignore-term") == 0)
+			signal(SIGTERM,SIG_IGN);
+		else if(strcmp(argv[i],"--crash") == 0)
+			crash=true;
+		else if(strncmp(argv[i],"--",2) == 0)
+		{
+			fprintf(stderr,"%s: Unknown option %s\n",name.c_str(),argv[i]);
+			return 1;
+		}
+		else
+			input=argv[i];
+	}
+
+	if(chunkSize == 0)
+		chunkSize=64 * 1024;
+
+	//Read the query like a real solver would.
+	int fd= input != NULL? open(input,O_RDONLY | O_CLOEXEC) : 0;
+	if(fd == -1)
+	{
+		perror("mock-solver: Couldn't open input");
+		return 1;
+	}
+
+	char buffer[65536];
+	ssize_t r;
+	while((r=read(fd,buffer,sizeof(buffer))) != 0)
+	{
+		if(r == -1 && errno != EINTR)
+		{
+			perror("mock-solver: read");
+			return 1;
+		}
+	}
+
+	if(input != NULL)
+		close(fd);
+
+	sleepFor(delay);
+
+	if(crash)
+		abort();
+
+	if(answer == "none")
+		return 0;
+
+	stamp(name,"answer");
+	answer+='\n';
+	if(!writeAll(1,answer.data(),answer.length()))
+		return 1;
+
+	if(modelSize == 0)
+		return 0;
+
+	//Something that looks like a model, repeated to fill a chunk.
+	string chunk;
+	chunk.reserve(chunkSize);
+	for(unsigned int n=0; chunk.length() < chunkSize; n++)
+	{
+		stringstream s;
+		s << "  (define-fun x" << n << " () (_ BitVec 32) #x" << hex << n << ")\n";
+		chunk+=s.str();
+	}
+	chunk.resize(chunkSize);
+
+	for(unsigned long long written=0; written < modelSize; written+=chunk.length())
+	{
+		size_t length= modelSize - written < chunk.length()? modelSize - written : chunk.length();
+		if(!writeAll(1,chunk.data(),length))
+			return 1;
+
+		if(streamDelay > 0)
+			sleepFor(streamDelay);
+	}
+
+	return 0;
+}
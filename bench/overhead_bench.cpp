@@ -0,0 +1,551 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Measures what NSolv itself adds to a race.
+ *
+ * The nsolv binary is run over and over against portfolios of mock-solver
+ * (see mock_solver.cpp) so no real SMT solver is needed. Each scenario is a
+ * portfolio and a query. For every run we record
+ *
+ * - startup:  nsolv being started until the first solver is running
+ *             (option parsing, sharing the input, fork() and exec()).
+ * - fanout:   the first solver running until the last one is (the
+ *             start pipe release and fork()/exec() of the whole portfolio).
+ * - forward:  the winner writing its answer until it reaches our end of
+ *             nsolv's stdout.
+ * - dump:     the rate the rest of the winner's output is copied at.
+ * - teardown: the winner's output being complete until nsolv has exited
+ *             (killing and reaping the other solvers).
+ * - total:    nsolv being started until it has exited.
+ *
+ * and then print percentiles of each. A run fails if nsolv doesn't exit
+ * successfully with the expected answer.
+ *
+ * Usage: overhead-bench [--runs=N] [--solvers=N] [--nsolv=path] [--mock=path] [scenario...]
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef NSOLV_BINARY
+#define NSOLV_BINARY "nsolv"
+#endif
+
+#ifndef MOCK_SOLVER_BINARY
+#define MOCK_SOLVER_BINARY "mock-solver"
+#endif
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+struct MockSolver
+{
+	string name;
+	string options; //See mock_solver.cpp
+
+	MockSolver(const string& _name, const string& _options) :
+	name(_name), options(_options) { }
+};
+
+struct Scenario
+{
+	string name;
+	string description;
+	vector<MockSolver> solvers;
+	string extraConfig; //Appended to the configuration file
+	unsigned int querySize; //MiB. 0 is a tiny query.
+	unsigned int modelSize; //MiB printed by the winner
+	string answer; //What nsolv should print first
+};
+
+//What was measured in one run. Times are seconds, -1 if not applicable.
+struct Measurement
+{
+	double startup;
+	double fanout;
+	double forward;
+	double dumpRate; //MiB/s
+	double teardown;
+	double total;
+};
+
+/* The scenarios. "solvers" is the size of the larger portfolios. Losers sleep
+ * for a minute so they are always killed.
+ */
+static void makeScenarios(vector<Scenario>& scenarios, unsigned int solvers)
+{
+	Scenario s;
+	s.querySize=0;
+	s.modelSize=0;
+	s.answer="sat";
+
+	s.name="single";
+	s.description="One solver that answers straight away";
+	s.solvers.push_back(MockSolver("winner","--answer=sat"));
+	scenarios.push_back(s);
+
+	s.name="fanout";
+	s.description="Winner after 200ms, the rest are killed";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=sat --delay=200"));
+	for(unsigned int i=1; i < solvers; i++)
+	{
+		stringstream n;
+		n << "loser" << i;
+		s.solvers.push_back(MockSolver(n.str(),"--answer=none --delay=60000"));
+	}
+	scenarios.push_back(s);
+
+	s.name="stubborn";
+	s.description="Winner after 100ms, 4 losers ignore SIGTERM (kill-grace 0.1)";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=unsat --delay=100"));
+	for(unsigned int i=1; i <= 4; i++)
+	{
+		stringstream n;
+		n << "stubborn" << i;
+		s.solvers.push_back(MockSolver(n.str(),"--answer=none --delay=60000 --ignore-term"));
+	}
+	s.extraConfig="kill-grace = 0.1\n";
+	s.answer="unsat";
+	scenarios.push_back(s);
+
+	s.name="crash";
+	s.description="Winner after 100ms, the rest crash straight away";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=sat --delay=100"));
+	for(unsigned int i=1; i < solvers; i++)
+	{
+		stringstream n;
+		n << "crasher" << i;
+		s.solvers.push_back(MockSolver(n.str(),"--crash"));
+	}
+	s.extraConfig="core-dumps = off\n";
+	s.answer="sat";
+	scenarios.push_back(s);
+
+	s.name="model";
+	s.description="One solver that prints a 64MiB model";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=sat --model=64"));
+	s.extraConfig="";
+	s.modelSize=64;
+	scenarios.push_back(s);
+
+	s.name="stream";
+	s.description="A 4MiB model written 16KiB every 2ms";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=sat --model=4 --chunk=16 --stream=2"));
+	s.modelSize=4;
+	scenarios.push_back(s);
+
+	s.name="bigquery";
+	s.description="A 64MiB query read by every solver";
+	s.solvers.clear();
+	s.solvers.push_back(MockSolver("winner","--answer=sat"));
+	for(unsigned int i=1; i < solvers; i++)
+	{
+		stringstream n;
+		n << "reader" << i;
+		s.solvers.push_back(MockSolver(n.str(),"--answer=none --delay=60000"));
+	}
+	s.querySize=64;
+	s.modelSize=0;
+	scenarios.push_back(s);
+}
+
+static bool writeFile(const string& path, const string& contents)
+{
+	ofstream f(path.c_str());
+	f << contents;
+	f.close();
+	return f.good();
+}
+
+static void writeQuery(const string& path, unsigned int size)
+{
+	string query("(set-logic QF_AUFBV )\n(declare-fun a () (Array (_ BitVec 32) (_ BitVec 8) ) )\n");
+	while(query.length() < (size_t) size * 1024 * 1024)
+		query+="(assert (= (select a (_ bv0 32) ) (_ bv0 8) ) )\n";
+	query+="(check-sat)\n(exit)\n";
+
+	writeFile(path,query);
+}
+
+//The nearest rank "percentile" of "values" which must be sorted.
+static double percentile(const vector<double>& values, double percentile)
+{
+	size_t rank=(size_t) ceil(percentile / 100.0 * values.size());
+	if(rank == 0)
+		rank=1;
+
+	return values[rank -1];
+}
+
+/* Run nsolv once. "directory" has the configuration, query and bin/ with a
+ * link to mock-solver for each solver. Returns false if the run failed.
+ */
+static bool run(const string& nsolv, const string& directory, const Scenario& scenario, Measurement& m)
+{
+	string stamps=directory + "/stamps";
+	string errors=directory + "/nsolv.err";
+	string config=directory + "/" + scenario.name + ".cfg";
+	string query=directory + "/" + scenario.name + ".smt2";
+	unlink(stamps.c_str());
+	m.startup=m.fanout=m.forward=m.dumpRate=m.teardown=m.total=-1;
+
+	int output[2];
+	if(pipe(output) == -1)
+	{
+		perror("pipe");
+		return false;
+	}
+
+	double start=now();
+	pid_t pid=fork();
+	if(pid == -1)
+	{
+		perror("fork");
+		return false;
+	}
+
+	if(pid == 0)
+	{
+		close(output[0]);
+		dup2(output[1],1);
+		close(output[1]);
+
+		//Messages about crashing solvers etc. would drown the report. They are shown if the run fails.
+		int err=open(errors.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+		if(err != -1)
+		{
+			dup2(err,2);
+			close(err);
+		}
+
+		string path=directory + "/bin:" + (getenv("PATH") != NULL? getenv("PATH") : "/usr/bin:/bin");
+		setenv("PATH",path.c_str(),1);
+		setenv("MOCK_SOLVER_STAMPS",stamps.c_str(),1);
+
+		execl(nsolv.c_str(),nsolv.c_str(),"--config",config.c_str(),query.c_str(),(char*) NULL);
+		perror("exec nsolv");
+		_exit(127);
+	}
+
+	close(output[1]);
+
+	//Read everything nsolv prints, noting when the first and last bytes arrive.
+	string head;
+	unsigned long long bytes=0;
+	double firstByte=-1;
+	double lastByte=-1;
+	char buffer[65536];
+	while(true)
+	{
+		ssize_t r=read(output[0],buffer,sizeof(buffer));
+		if(r == -1 && errno == EINTR)
+			continue;
+
+		if(r <= 0)
+			break;
+
+		lastByte=now();
+		if(firstByte < 0)
+			firstByte=lastByte;
+
+		if(head.length() < 16)
+			head.append(buffer,min((size_t) r,16 - head.length()));
+
+		bytes+=r;
+	}
+	close(output[0]);
+
+	int status=0;
+	while(waitpid(pid,&status,0) == -1 && errno == EINTR);
+	double end=now();
+
+	bool ok=true;
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		cerr << scenario.name << ": nsolv failed (status " << status << ")" << endl;
+		ok=false;
+	}
+
+	if(head.compare(0,scenario.answer.length() + 1,scenario.answer + "\n") != 0)
+	{
+		cerr << scenario.name << ": Expected " << scenario.answer << " but nsolv printed \"" << head << "\"" << endl;
+		ok=false;
+	}
+
+	//When the solvers started and the winner answered
+	double firstStart=-1;
+	double lastStart=-1;
+	double answered=-1;
+	unsigned int started=0;
+	ifstream f(stamps.c_str());
+	string name, event;
+	double time;
+	while(f >> name >> event >> time)
+	{
+		if(event == "start")
+		{
+			started++;
+			if(firstStart < 0 || time < firstStart)
+				firstStart=time;
+			if(time > lastStart)
+				lastStart=time;
+		}
+		else if(event == "answer" && (answered < 0 || time < answered))
+			answered=time;
+	}
+
+	if(started != scenario.solvers.size())
+	{
+		cerr << scenario.name << ": Only " << started << " of " << scenario.solvers.size() << " solvers started" << endl;
+		ok=false;
+	}
+
+	if(!ok)
+	{
+		ifstream e(errors.c_str());
+		cerr << e.rdbuf();
+	}
+
+	m.startup= firstStart >= 0? firstStart - start : -1;
+	m.fanout= scenario.solvers.size() > 1 && firstStart >= 0? lastStart - firstStart : -1;
+	m.forward= answered >= 0 && firstByte >= 0? firstByte - answered : -1;
+	m.dumpRate= scenario.modelSize > 0 && lastByte > firstByte? bytes / (lastByte - firstByte) / (1024 * 1024) : -1;
+	m.teardown= lastByte >= 0? end - lastByte : -1;
+	m.total=end - start;
+
+	return ok;
+}
+
+static bool notApplicable(double value)
+{
+	return value < 0;
+}
+
+//Print the percentiles of a metric. Values < 0 don't apply and are left out.
+static void report(const string& metric, vector<double> values, double scale, const string& unit)
+{
+	values.erase(remove_if(values.begin(),values.end(),notApplicable),values.end());
+	if(values.empty())
+		return;
+
+	sort(values.begin(),values.end());
+	cout << "  " << left << setw(10) << metric << right << fixed << setprecision(3) <<
+			setw(11) << percentile(values,50) * scale <<
+			setw(11) << percentile(values,90) * scale <<
+			setw(11) << percentile(values,99) * scale <<
+			setw(11) << values.back() * scale << " " << unit << endl;
+}
+
+//The value of "--option=value" if "arg" is "--option", otherwise NULL.
+static const char* value(const char* arg, const char* option)
+{
+	size_t length=strlen(option);
+	if(strncmp(arg,option,length) == 0 && arg[length] == '=')
+		return arg + length + 1;
+
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int runs=20;
+	unsigned int numberOfSolvers=16;
+	string nsolv(NSOLV_BINARY);
+	string mock(MOCK_SOLVER_BINARY);
+	vector<string> selected;
+
+	for(int i=1; i < argc; i++)
+	{
+		const char* v=NULL;
+		if((v=value(argv[i],"--runs")) != NULL)
+			runs=atoi(v);
+		else if((v=value(argv[i],"--solvers")) != NULL)
+			numberOfSolvers=atoi(v);
+		else if((v=value(argv[i],"--nsolv")) != NULL)
+			nsolv=v;
+		else if((v=value(argv[i],"--mock")) != NULL)
+			mock=v;
+		else if(strncmp(argv[i],"--",2) == 0)
+		{
+			cerr << "Usage: " << argv[0] << " [--runs=N] [--solvers=N] [--nsolv=path] [--mock=path] [scenario...]" << endl;
+			return 1;
+		}
+		else
+			selected.push_back(argv[i]);
+	}
+
+	if(runs == 0 || numberOfSolvers < 2)
+	{
+		cerr << "Need at least 1 run and 2 solvers" << endl;
+		return 1;
+	}
+
+	if(access(nsolv.c_str(),X_OK) != 0 || access(mock.c_str(),X_OK) != 0)
+	{
+		cerr << "Can't execute " << nsolv << " or " << mock << " (see --nsolv and --mock)" << endl;
+		return 1;
+	}
+
+	//Symbolic links must point to an absolute path to work from bin/
+	char resolved[PATH_MAX];
+	if(realpath(mock.c_str(),resolved) != NULL)
+		mock=resolved;
+
+	vector<Scenario> scenarios;
+	makeScenarios(scenarios,numberOfSolvers);
+
+	for(vector<string>::const_iterator n=selected.begin(); n != selected.end(); ++n)
+	{
+		bool known=false;
+		for(vector<Scenario>::const_iterator s=scenarios.begin(); s != scenarios.end(); ++s)
+			known= known || s->name == *n;
+
+		if(!known)
+		{
+			cerr << "Unknown scenario " << *n << ". Scenarios are:";
+			for(vector<Scenario>::const_iterator s=scenarios.begin(); s != scenarios.end(); ++s)
+				cerr << " " << s->name;
+			cerr << endl;
+			return 1;
+		}
+	}
+
+	char directoryTemplate[]="/tmp/nsolv-overhead-XXXXXX";
+	if(mkdtemp(directoryTemplate) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	string directory(directoryTemplate);
+	string bin=directory + "/bin";
+	mkdir(bin.c_str(),0755);
+
+	//Everything we create so that it can be removed again
+	vector<string> created;
+	created.push_back(directory + "/stamps");
+	created.push_back(directory + "/nsolv.err");
+
+	unsigned int failures=0;
+	cout << nsolv << ", " << runs << " runs per scenario. Times are ms." << endl;
+
+	for(vector<Scenario>::const_iterator s=scenarios.begin(); s != scenarios.end(); ++s)
+	{
+		if(!selected.empty() && find(selected.begin(),selected.end(),s->name) == selected.end())
+			continue;
+
+		//Write the portfolio and query
+		stringstream config;
+		for(vector<MockSolver>::const_iterator m=s->solvers.begin(); m != s->solvers.end(); ++m)
+		{
+			config << "solver = " << m->name << "\n";
+			config << m->name << ".opts = " << m->options << "\n";
+
+			string link=bin + "/" + m->name;
+			if(find(created.begin(),created.end(),link) == created.end())
+			{
+				unlink(link.c_str());
+				if(symlink(mock.c_str(),link.c_str()) == -1)
+					perror("symlink");
+				created.push_back(link);
+			}
+		}
+		config << s->extraConfig;
+
+		string configPath=directory + "/" + s->name + ".cfg";
+		string queryPath=directory + "/" + s->name + ".smt2";
+		writeFile(configPath,config.str());
+		writeQuery(queryPath,s->querySize);
+		created.push_back(configPath);
+		created.push_back(queryPath);
+
+		vector<double> startup, fanout, forward, dumpRate, teardown, total;
+		unsigned int failed=0;
+		double start=now();
+		for(unsigned int r=0; r < runs; r++)
+		{
+			Measurement m;
+			if(!run(nsolv,directory,*s,m))
+				failed++;
+
+			startup.push_back(m.startup);
+			fanout.push_back(m.fanout);
+			forward.push_back(m.forward);
+			dumpRate.push_back(m.dumpRate);
+			teardown.push_back(m.teardown);
+			total.push_back(m.total);
+		}
+		double elapsed=now() - start;
+
+		cout << endl << s->name << ": " << s->description << " (" << s->solvers.size() << " solvers, " <<
+				fixed << setprecision(2) << runs / elapsed << " races/s";
+		if(failed > 0)
+			cout << ", " << failed << " FAILED";
+		cout << ")" << endl;
+
+		cout << "  " << left << setw(10) << "" << right << setw(11) << "p50" << setw(11) << "p90" <<
+				setw(11) << "p99" << setw(11) << "max" << endl;
+		report("startup",startup,1000,"ms");
+		report("fanout",fanout,1000,"ms");
+		report("forward",forward,1000,"ms");
+		report("dump",dumpRate,1,"MiB/s");
+		report("teardown",teardown,1000,"ms");
+		report("total",total,1000,"ms");
+
+		failures+=failed;
+	}
+
+	for(vector<string>::const_iterator c=created.begin(); c != created.end(); ++c)
+		unlink(c->c_str());
+	rmdir(bin.c_str());
+	rmdir(directory.c_str());
+
+	if(failures > 0)
+	{
+		cout << endl << failures << " runs FAILED" << endl;
+		return 1;
+	}
+
+	return 0;
+}
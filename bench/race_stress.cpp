@@ -0,0 +1,151 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Stress test for the race loop in SolverManager.
+ *
+ * Races are run between hundreds of fake solvers (a shell script written to
+ * /tmp). All of them answer unknown except one which answers sat after the
+ * others have given up, so every solver has to be waited for and reaped.
+ * Descriptor numbers go well past FD_SETSIZE because the descriptors below
+ * it are used up first.
+ *
+ * After each race we check the answer and that no solver was left as a
+ * zombie.
+ *
+ * Usage: race-stress [solvers] [races]
+ */
+#include "SolverManager.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+using namespace std;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+static bool writeFile(const string& path, const string& contents, mode_t mode)
+{
+	ofstream f(path.c_str());
+	f << contents;
+	f.close();
+	return f.good() && chmod(path.c_str(),mode) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int numberOfSolvers= argc > 1? atoi(argv[1]) : 500;
+	unsigned int races= argc > 2? atoi(argv[2]) : 5;
+
+	if(numberOfSolvers < 2)
+	{
+		cerr << "Need at least 2 solvers" << endl;
+		return 1;
+	}
+
+	//Each solver needs a pipe and a pidfd plus whatever we use up below.
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE,&limit);
+	rlim_t needed=2 * numberOfSolvers + FD_SETSIZE + 64;
+	if(limit.rlim_cur < needed)
+	{
+		limit.rlim_cur= limit.rlim_max < needed? limit.rlim_max : needed;
+		if(setrlimit(RLIMIT_NOFILE,&limit) == -1 || limit.rlim_cur < needed)
+		{
+			cerr << "Couldn't raise RLIMIT_NOFILE to " << needed << " (try fewer solvers)" << endl;
+			return 1;
+		}
+	}
+
+	//Use up the descriptors select() could handle so the solvers' ones are beyond FD_SETSIZE.
+	vector<int> filler;
+	while(true)
+	{
+		int fd=open("/dev/null",O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+			break;
+
+		filler.push_back(fd);
+		if(fd >= FD_SETSIZE)
+			break;
+	}
+
+	stringstream pid;
+	pid << getpid();
+	string solver="/tmp/nsolv-race-stress-" + pid.str() + ".sh";
+	string query="/tmp/nsolv-race-stress-" + pid.str() + ".smt2";
+
+	if(!writeFile(solver,"#!/bin/sh\n[ \"$1\" = winner ] && sleep 0.5 && echo sat && exit 0\necho unknown\n",0755) ||
+			!writeFile(query,"(set-logic QF_BV)\n(check-sat)\n",0644))
+	{
+		cerr << "Couldn't write the fake solver to /tmp" << endl;
+		return 1;
+	}
+
+	cout << "Racing " << numberOfSolvers << " solvers " << races << " times" << endl;
+
+	bool success=true;
+	double total=0.0;
+	for(unsigned int race=0; race < races; ++race)
+	{
+		SolverManager* sm=new SolverManager(query,30.0,"",true);
+		for(unsigned int s=0; s < numberOfSolvers; ++s)
+			sm->addSolver(solver, s == numberOfSolvers / 2? "winner" : "loser", false);
+
+		double start=now();
+		string output;
+		bool answered=sm->invokeSolvers(output);
+		double elapsed=now() - start;
+		delete sm;
+		total+=elapsed;
+
+		bool zombies= waitpid(-1,NULL,WNOHANG) != -1 || errno != ECHILD;
+
+		cout << "Race " << race << ": " << elapsed << " s, answer \"" << output.substr(0,output.find('\n')) << "\"" <<
+				(zombies? ", children left over!" : "") << endl;
+
+		if(!answered || output != "sat\n" || zombies)
+			success=false;
+	}
+
+	cout << "Average: " << total / races << " s per race (the winner sleeps 0.5 s)" << endl;
+
+	unlink(solver.c_str());
+	unlink(query.c_str());
+	for(vector<int>::const_iterator fd=filler.begin(); fd != filler.end(); ++fd)
+		close(*fd);
+
+	cout << (success? "PASSED" : "FAILED") << endl;
+	return success? 0 : 1;
+}
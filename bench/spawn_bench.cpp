@@ -0,0 +1,174 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Compares starting solvers with fork() and with clone(CLONE_VM) (see
+ * SolverManager::setFastSpawn()).
+ *
+ * We hold on to some memory (like a long running NSolv with a big cache
+ * would) and then race 2, 8 and 32 copies of mock-solver. The time from
+ * invokeSolvers() being called until the last solver is running (from the
+ * stamps mock-solver writes) is measured for both.
+ *
+ * Usage: spawn-bench [MiB of memory to hold] [races]
+ */
+#include "SolverManager.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <time.h>
+
+#ifndef MOCK_SOLVER_BINARY
+#define MOCK_SOLVER_BINARY "mock-solver"
+#endif
+
+using namespace std;
+
+//What we hold on to. Global so that it can't be optimised away.
+char* memory=NULL;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1E9;
+}
+
+/* Race "solvers" mock solvers and return the seconds until the last one was
+ * running, or -1 if the race went wrong. The winner waits long enough for
+ * all of them to have started before it answers.
+ */
+static double race(const string& query, const string& stamps, unsigned int solvers, bool fast)
+{
+	unlink(stamps.c_str());
+
+	SolverManager* sm=new SolverManager(query,30.0,"",true);
+	sm->setFastSpawn(fast);
+	for(unsigned int s=0; s < solvers; ++s)
+		sm->addSolver(MOCK_SOLVER_BINARY, s == 0? "--answer=sat --delay=250" : "--answer=none --delay=60000", false);
+
+	double start=now();
+	string output;
+	bool answered=sm->invokeSolvers(output);
+	delete sm;
+
+	double last=-1;
+	unsigned int started=0;
+	ifstream f(stamps.c_str());
+	string name, event;
+	double time;
+	while(f >> name >> event >> time)
+	{
+		if(event != "start")
+			continue;
+
+		started++;
+		last=max(last,time);
+	}
+
+	if(!answered || output != "sat\n" || started != solvers)
+	{
+		cerr << "Race of " << solvers << " solvers with " << (fast? "clone()" : "fork()") << " went wrong (" << started <<
+				" started, answer \"" << output.substr(0,output.find('\n')) << "\")" << endl;
+		return -1;
+	}
+
+	return last - start;
+}
+
+static bool failed(double time)
+{
+	return time < 0;
+}
+
+static double median(vector<double> values)
+{
+	sort(values.begin(),values.end());
+	return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int held= argc > 1? atoi(argv[1]) : 1024;
+	unsigned int races= argc > 2? atoi(argv[2]) : 10;
+
+	if(races == 0 || access(MOCK_SOLVER_BINARY,X_OK) != 0)
+	{
+		cerr << "Need at least one race and " << MOCK_SOLVER_BINARY << " (build it with \"make bench\")" << endl;
+		return 1;
+	}
+
+	//Touch every page so that fork() has to copy page tables for all of it.
+	size_t heldBytes=(size_t) held * 1024 * 1024;
+	memory=static_cast<char*>(malloc(heldBytes > 0? heldBytes : 1));
+	if(memory == NULL)
+	{
+		cerr << "Couldn't allocate " << held << " MiB" << endl;
+		return 1;
+	}
+	memset(memory,1,heldBytes);
+
+	stringstream pid;
+	pid << getpid();
+	string query="/tmp/nsolv-spawn-bench-" + pid.str() + ".smt2";
+	string stamps="/tmp/nsolv-spawn-bench-" + pid.str() + ".stamps";
+	ofstream q(query.c_str());
+	q << "(set-logic QF_BV)\n(check-sat)\n";
+	q.close();
+	setenv("MOCK_SOLVER_STAMPS",stamps.c_str(),1);
+
+	cout << "Holding " << held << " MiB, median of " << races << " races. Time until every solver is running:" << endl;
+	cout << setw(8) << "solvers" << setw(12) << "fork" << setw(12) << "clone" << setw(10) << "speedup" << endl;
+
+	bool success=true;
+	const unsigned int sizes[]={2, 8, 32};
+	for(size_t i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		vector<double> forked, cloned;
+		for(unsigned int r=0; r < races; r++)
+		{
+			//Alternate so that both see the same conditions
+			forked.push_back(race(query,stamps,sizes[i],false));
+			cloned.push_back(race(query,stamps,sizes[i],true));
+		}
+
+		if(find_if(forked.begin(),forked.end(),failed) != forked.end() ||
+		   find_if(cloned.begin(),cloned.end(),failed) != cloned.end())
+			success=false;
+
+		double f=median(forked);
+		double c=median(cloned);
+		cout << setw(8) << sizes[i] << fixed << setprecision(3) << setw(10) << f * 1000 << "ms" <<
+				setw(10) << c * 1000 << "ms" << setprecision(2) << setw(9) << f / c << "x" << endl;
+	}
+
+	free(memory);
+	unlink(query.c_str());
+	unlink(stamps.c_str());
+
+	cout << (success? "PASSED" : "FAILED") << endl;
+	return success? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+    Copyright (c) Dan Liew 2012
+
+    This file is part of NSolv.
+
+    NSolv is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    NSolv is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with NSolv.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* A tiny client for a NSolv daemon (nsolv --daemon <socket>).
+ * It behaves like "nsolv <input>" (the winning solver's output is printed
+ * to standard output) so it can be used as a drop in replacement by
+ * existing callers.
+ */
+#include "Protocol.h"
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <config.h>
+
+using namespace std;
+
+const char NSOLV_CLIENT[] = "nsolv-client";
+
+//Environment variable used to find the socket if --socket isn't used.
+const char SOCKET_ENV_VARIABLE[] = "NSOLV_SOCKET";
+
+void printHelp()
+{
+	cout << NSOLV_CLIENT << " [--socket <path>] <input>" << endl <<
+			"<input> is a valid (.smt2) SMTLIBv2 file." << endl << endl <<
+			"Send <input> to a NSolv daemon (started with \"nsolv --daemon <path>\") and print the output of the " << endl <<
+			"winning solver to standard output. If --socket is not used the socket path is taken from the " << endl <<
+			SOCKET_ENV_VARIABLE << " environment variable." << endl << endl;
+	cout << "NSolv version " << NSOLV_VERSION << " built on "  __DATE__  << endl;
+	exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+	string socketPath;
+	string inputFile;
+
+	if(getenv(SOCKET_ENV_VARIABLE) != NULL)
+		socketPath=getenv(SOCKET_ENV_VARIABLE);
+
+	for(int index=1; index < argc; index++)
+	{
+		string arg(argv[index]);
+
+		if(arg == "--help" || arg == "-h")
+			printHelp();
+		else if((arg == "--socket" || arg == "-S") && index + 1 < argc)
+			socketPath=argv[++index];
+		else if(inputFile.empty())
+			inputFile=arg;
+		else
+		{
+			cerr << "Error: Unexpected argument " << arg << ". For help use --help" << endl;
+			return 1;
+		}
+	}
+
+	if(inputFile.empty())
+	{
+		cerr << "Error: Input SMTLIBv2 file must be specified. For help use --help" << endl;
+		return 1;
+	}
+
+	if(socketPath.empty())
+	{
+		cerr << "Error: No socket specified. Use --socket or set " << SOCKET_ENV_VARIABLE << endl;
+		return 1;
+	}
+
+	//The daemon may be running in a different directory so send an absolute path.
+	char resolved[PATH_MAX];
+	if(realpath(inputFile.c_str(),resolved) == NULL)
+	{
+		cerr << "Error: Input SMTLIBv2 file (" << inputFile << ") does not exist or is not a regular file." << endl;
+		return 1;
+	}
+
+	struct sockaddr_un address;
+	memset(&address,0,sizeof(address));
+	address.sun_family=AF_UNIX;
+
+	if(socketPath.length() >= sizeof(address.sun_path))
+	{
+		cerr << "Error: Socket path " << socketPath << " is too long." << endl;
+		return 1;
+	}
+	strncpy(address.sun_path,socketPath.c_str(),sizeof(address.sun_path) -1);
+
+	int fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd == -1 || connect(fd,reinterpret_cast<struct sockaddr*>(&address),sizeof(address)) != 0)
+	{
+		cerr << "Error: Could not connect to NSolv daemon at " << socketPath << endl;
+		perror("connect:");
+		return 1;
+	}
+
+	uint32_t status=0;
+	string output;
+
+	if(!Protocol::writeFrame(fd,Protocol::REQUEST_SOLVE,resolved) ||
+	   !Protocol::readFrame(fd,status,output))
+	{
+		cerr << "Error: Lost connection to NSolv daemon." << endl;
+		close(fd);
+		return 1;
+	}
+
+	close(fd);
+
+	if(status == Protocol::RESPONSE_ANSWER)
+	{
+		fwrite(output.data(),1,output.size(),stdout);
+		fflush(stdout);
+	}
+	else
+		cerr << "NSolv daemon did not find an answer." << endl;
+
+	return 0;
+}
@@ -20,6 +20,10 @@
 #define GLOBAL_H_
 
 #include <string>
+#include <unistd.h>
+
+class SolverManager;
+class Trace;
 
 //True if the user wants verbose output
 extern bool verbose;
@@ -27,4 +31,13 @@ extern bool verbose;
 //Path to logging file
 extern std::string loggingPath;
 
+//The SolverManager of the race in progress (if any). Used by the signal handlers to clean up.
+extern SolverManager* sm;
+
+//PID of the process that owns "sm"
+extern pid_t nsolvProcess;
+
+//The timeline being recorded (see --trace). NULL unless tracing is on.
+extern Trace* tracer;
+
 #endif /* GLOBAL_H_ */
@@ -26,6 +26,15 @@ namespace po = boost::program_options;
 #include <string>
 #include <fstream>
 #include "SolverManager.h"
+#include "Portfolio.h"
+#include "Daemon.h"
+#include "Session.h"
+#include "Fingerprint.h"
+#include "Batch.h"
+#include "CpuTopology.h"
+#include "RaceLog.h"
+#include "Trace.h"
+#include "global.h"
 #include <signal.h>
 #include <config.h>
 using namespace std;
@@ -42,6 +51,8 @@ const char NSOLV[] = "nsolv";
 const char DEFAULT_CONFIG_PATH[] = "./nsolv.cfg";
 
 SolverManager* sm=NULL;
+Portfolio* portfolio=NULL;
+Trace* tracer=NULL;
 struct sigaction act;
 
 //Parses command line options and config file.
@@ -50,12 +61,22 @@ void parseOptions(int argc, char* argv[]);
 //Prints help message
 void printHelp(po::options_description& o);
 
+//Prints the canonical fingerprint of a query and exits
+void printFingerprint(const string& inputFile);
+
+//Prints a log from logging mode (in any format) as JSON Lines and exits
+void printLog(const string& path);
+
+//Writes the trace (see --trace) if there is one
+void writeTrace();
+
 //Signal handler that attempts to cleanly exit.
 void handleExit(int signum);
 
 int main(int ac, char* av[])
 {
 	nsolvProcess=getpid();
+	double started=Trace::now();
 
 	/* We want to prevent SIGINT, SIGTERM & SIGQUIT
 	 * from interrupting the instantiation ( parseOptions() )
@@ -74,6 +95,7 @@ int main(int ac, char* av[])
 	if(result == -1) cerr << "Couldn't block SIGINT" << endl;
 
 	parseOptions(ac,av);
+	if(tracer) tracer->phase("parse options",started);
 
 	/* Now that the SolverManager is instantiated it is safe
 	 * to allow the user to force an early exit.
@@ -87,9 +109,43 @@ int main(int ac, char* av[])
 	if(result == -1) cerr << "Couldn't setup handler for SIGQUIT" << endl;
 
 
+	if(vm.count("session"))
+	{
+		if(portfolio->isLoggingMode())
+			cerr << "Warning: logging mode is not supported in a session." << endl;
+
+		Session session(*portfolio,vm["session-resync-limit"].as<unsigned int>());
+		bool success=session.run(fileno(stdin));
+		delete portfolio;
+		return success?0:1;
+	}
+
+	if(vm.count("batch"))
+	{
+		unsigned int jobs=vm["batch-jobs"].as<unsigned int>();
+		if(jobs == 0)
+			jobs=Batch::defaultJobs(*portfolio);
+
+		Batch b(*portfolio,jobs,vm["batch-ordered"].as<bool>());
+		bool success=b.run(vm["batch"].as<string>());
+		delete portfolio;
+		return success?0:1;
+	}
+
+	if(vm.count("daemon"))
+	{
+		Daemon d(vm["daemon"].as<string>(),*portfolio);
+		bool success=d.run();
+		delete portfolio;
+		return success?0:1;
+	}
+
 	sm->invokeSolvers();
 
 	delete sm;
+	sm=NULL;
+	delete portfolio;
+	writeTrace();
     return 0;
 }
 
@@ -106,6 +162,18 @@ void parseOptions(int argc, char* argv[])
 		generalOpts.add_options()
 				("help,h", "produce help message")
 				("config,c", po::value<std::string>()->default_value(DEFAULT_CONFIG_PATH), "Path to configuration file.")
+				("daemon", po::value<std::string>(), "Run as a daemon serving queries on the Unix domain socket at this path "
+						"(see nsolv-client). <input> is not used.")
+				("session", "Run an incremental session. SMTLIBv2 commands are read from standard input and only "
+						"(check-sat) is raced. <input> is not used.")
+				("batch", po::value<std::string>(), "Solve every .smt2 file under this directory, or every file listed "
+						"(one per line) in this manifest, with several races at once. <input> is not used.")
+				("fingerprint", "Print the canonical fingerprint of <input> and exit. Queries that only differ by the "
+						"names and order of their declarations, whitespace and comments have the same fingerprint.")
+				("print-log", po::value<std::string>(), "Print the log at this path (from logging mode, in any --log-format) "
+						"as JSON Lines and exit. <input> is not used.")
+				("trace", po::value<std::string>(), "Record when each phase of the race happened (for NSolv and every "
+						"solver) and write it to this file as Chrome trace events. Only for a single <input>.")
 
 				;
 
@@ -115,15 +183,58 @@ void parseOptions(int argc, char* argv[])
 				("solver,s", po::value< std::vector<string> >(&solverList)->composing(),
 						"Specify a solver to use. This option can be set multiple times so that each "
 						"solver is invoked in a different process.")
-				("timeout,t", po::value<double>()->default_value(0.0), "Set timeout in seconds.")
+				("timeout,t", po::value<double>()->default_value(0.0), "Set timeout in seconds (e.g. 0.25). <solver>.timeout "
+						"gives up on a single solver sooner.")
 				("verbose", po::value<bool>(&verbose)->default_value(false), "Print running information to standard error.")
 				("logging-path", po::value<string>(&loggingPath)->default_value(""), "Enable logging mode (off by default) and set the path to the log file.")
+				("log-format", po::value<string>()->default_value("text"), "Format of the records appended to the log in "
+						"logging mode: text, jsonl (JSON Lines) or binary.")
+				("pool", po::value<bool>()->default_value(false), "Daemon only. Keep solvers alive between queries instead of starting them "
+						"for every query. Every solver must read SMTLIBv2 from standard input.")
+				("pool-workers", po::value<unsigned int>()->default_value(0), "Daemon only. Number of processes (each with their own "
+						"pool of solvers) serving clients in pool mode. 0 picks one based on the number of CPUs.")
+				("session-resync-limit", po::value<unsigned int>()->default_value(3), "Session only. Drop a solver after it falls "
+						"behind this many (check-sat) races in a row.")
+				("cache-dir", po::value<string>()->default_value(""), "Remember answers in this directory and answer repeated "
+						"queries from it without running any solvers. Empty (the default) disables the cache.")
+				("cache-size", po::value<unsigned int>()->default_value(1024), "Maximum size of the cache in MiB.")
+				("batch-jobs", po::value<unsigned int>()->default_value(0), "Batch only. Number of races at once. 0 picks one "
+						"so that the number of running solvers is close to the number of CPUs.")
+				("batch-ordered", po::value<bool>()->default_value(false), "Batch only. Print results in the order of the "
+						"corpus instead of as they finish.")
+				("tier-delay", po::value<double>()->default_value(1.0), "Seconds to wait before starting the next tier of "
+						"solvers (see <solver>.tier) if nothing has answered yet.")
+				("select-top", po::value<unsigned int>()->default_value(0), "Only run the solvers predicted to do best on each "
+						"query, this many of them. 0 (the default) runs every solver.")
+				("select-history", po::value<string>()->default_value(""), "Log file (from logging mode) to learn the "
+						"predictions from. Defaults to the --logging-path.")
+				("select-explore", po::value<double>()->default_value(0.1), "Probability of swapping one of the selected "
+						"solvers for a random other one so that every solver keeps being tried.")
+				("adaptive-timeout", po::value<double>()->default_value(0.0), "Give up on each solver once it has taken "
+						"longer than it did on this percentage (e.g. 95) of the similar queries it solved according to "
+						"--select-history. 0 (the default) disables it. Ignored in logging mode.")
+				("adaptive-timeout-slack", po::value<double>()->default_value(1.5), "Multiply the times learnt by "
+						"--adaptive-timeout by this so that a solver isn't killed just before it would have answered.")
+				("kill-grace", po::value<double>()->default_value(1.0), "Seconds solvers (and anything they started) get "
+						"to exit after SIGTERM once a race is over before they are sent SIGKILL.")
+				("share-input", po::value<bool>()->default_value(true), "Read the input once and give solvers a copy of it in "
+						"memory (as /proc/self/fd/<n>) instead of the file. Turn this off for solvers that need the real file "
+						"name, e.g. to guess the input language from its extension.")
+				("fast-spawn", po::value<bool>()->default_value(true), "Start solvers with clone(CLONE_VM | CLONE_VFORK) so that NSolv's "
+						"memory isn't copied for each of them. Turn this off to use fork() instead, e.g. under valgrind.")
+				("max-memory", po::value<unsigned int>()->default_value(0), "Limit every solver to this many MiB of address "
+						"space (0 for no limit). <solver>.max-memory overrides it for a solver.")
+				("max-cpu", po::value<unsigned int>()->default_value(0), "Limit every solver to this many seconds of CPU "
+						"time (0 for no limit). <solver>.max-cpu overrides it for a solver.")
+				("core-dumps", po::value<bool>()->default_value(true), "Allow solvers to dump core when they crash.")
+				("pin-solvers", po::value<bool>()->default_value(false), "Pin each solver to its own physical core (spread "
+						"over caches and sockets). <solver>.cpus in the configuration file overrides the choice for a solver.")
 				;
 
 
 		//This is used as a positional argument
 		po::options_description input("Input");
-		input.add_options()("input", po::value<std::string>()->required(),"Specifies SMTLIBv2 input file.");
+		input.add_options()("input", po::value<std::string>(),"Specifies SMTLIBv2 input file (- for stdin).");
 		po::positional_options_description p;
 		p.add("input",1);
 
@@ -147,15 +258,33 @@ void parseOptions(int argc, char* argv[])
 
 		po::notify(vm);//trigger exceptions if there are any
 
-		//check input file exists
-		boost::filesystem::path inputFile(vm["input"].as<string>());
-		if(! boost::filesystem::is_regular_file(inputFile))
+		if(vm.count("print-log"))
+			printLog(vm["print-log"].as<string>());
+
+		/* The input is required unless we are a daemon (the clients provide it), a session (stdin provides it)
+		 * or a batch (the corpus provides it).
+		 */
+		bool daemonMode= vm.count("daemon") > 0 || vm.count("session") > 0 || vm.count("batch") > 0;
+		if(!daemonMode && !vm.count("input"))
 		{
-			cerr << "Error: Input SMTLIBv2 file (" << vm["input"].as<string>() <<
-					") does not exist or is not a regular file." << endl;
+			cerr << "Error: Input SMTLIBv2 file must be specified. For help use --help" << endl;
 			exit(1);
 		}
 
+		//check input file exists ("-" is stdin)
+		if(!daemonMode && vm["input"].as<string>() != "-")
+		{
+			boost::filesystem::path inputFile(vm["input"].as<string>());
+			if(! boost::filesystem::is_regular_file(inputFile))
+			{
+				cerr << "Error: Input SMTLIBv2 file (" << vm["input"].as<string>() <<
+						") does not exist or is not a regular file." << endl;
+				exit(1);
+			}
+		}
+
+		if(vm.count("fingerprint"))
+			printFingerprint(vm["input"].as<string>() == "-"? "/dev/stdin" : vm["input"].as<string>());
 
 		//if the configuration file exists then load it
 		boost::filesystem::path configFile(vm["config"].as<string>());
@@ -197,6 +326,11 @@ void parseOptions(int argc, char* argv[])
 			/*loop over solvers and create
 			 * <solvername>.opts options
 			 * <solvername>.input-on-stdin options
+			 * <solvername>.cpus options
+			 * <solvername>.tier options
+			 * <solvername>.max-memory options
+			 * <solvername>.max-cpu options
+			 * <solvername>.timeout options
 			 */
 			for(vector<string>::const_iterator s= solverList.begin(); s != solverList.end(); ++s)
 			{
@@ -213,6 +347,36 @@ void parseOptions(int argc, char* argv[])
 				indivSolvOpt.add_options() (optionName.c_str(),po::value<bool>()->default_value(false),"");
 				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
 
+				//Do <solvername>.cpus
+				optionName=*s;
+				optionName+=".cpus";
+				indivSolvOpt.add_options() (optionName.c_str(),po::value<string>(),"");
+				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
+
+				//Do <solvername>.tier
+				optionName=*s;
+				optionName+=".tier";
+				indivSolvOpt.add_options() (optionName.c_str(),po::value<unsigned int>()->default_value(0),"");
+				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
+
+				//Do <solvername>.max-memory
+				optionName=*s;
+				optionName+=".max-memory";
+				indivSolvOpt.add_options() (optionName.c_str(),po::value<unsigned int>(),"");
+				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
+
+				//Do <solvername>.max-cpu
+				optionName=*s;
+				optionName+=".max-cpu";
+				indivSolvOpt.add_options() (optionName.c_str(),po::value<unsigned int>(),"");
+				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
+
+				//Do <solvername>.timeout
+				optionName=*s;
+				optionName+=".timeout";
+				indivSolvOpt.add_options() (optionName.c_str(),po::value<double>(),"");
+				if(verbose) cerr << "Looking for \"" << optionName << "\" in " << configFile << endl;
+
 			}
 
 			//Do second pass for per solver options
@@ -232,10 +396,10 @@ void parseOptions(int argc, char* argv[])
 		}
 
 
-		try {sm = new SolverManager(vm["input"].as<string>(),vm["timeout"].as<double>(),lMode);}
+		try {portfolio = new Portfolio(vm["timeout"].as<double>(),lMode);}
 		catch(std::bad_alloc& e)
 		{
-			cerr << "Failed to allocate memory of SolverManager:" << e.what() << endl;
+			cerr << "Failed to allocate memory of Portfolio:" << e.what() << endl;
 			exit(1);
 		}
 
@@ -252,15 +416,176 @@ void parseOptions(int argc, char* argv[])
 			if(configFileExists && vm.count(stdinOpt.c_str()) && vm[stdinOpt.c_str()].as<bool>() )
 				inputOnStdin=true;
 
+			string cmdOptions("");
 			if(configFileExists && vm.count(solvOpt.c_str()))
+				cmdOptions=vm[solvOpt.c_str()].as<string>();
+
+			SolverDescription d(*s,cmdOptions,inputOnStdin);
+
+			string cpusOpt(*s);
+			cpusOpt+=".cpus";
+			if(configFileExists && vm.count(cpusOpt.c_str()) &&
+			   !CpuTopology::parseCpuList(vm[cpusOpt.c_str()].as<string>(),d.cpus))
+			{
+				cerr << "Error: " << cpusOpt << " (" << vm[cpusOpt.c_str()].as<string>() << ") is not a CPU list "
+						"(e.g. 0-3,8)." << endl;
+				exit(1);
+			}
+
+			string tierOpt(*s);
+			tierOpt+=".tier";
+			if(configFileExists && vm.count(tierOpt.c_str()))
+				d.tier=vm[tierOpt.c_str()].as<unsigned int>();
+
+			d.limits.maxMemory=vm["max-memory"].as<unsigned int>();
+			string memoryOpt(*s);
+			memoryOpt+=".max-memory";
+			if(configFileExists && vm.count(memoryOpt.c_str()))
+				d.limits.maxMemory=vm[memoryOpt.c_str()].as<unsigned int>();
+
+			d.limits.maxCpu=vm["max-cpu"].as<unsigned int>();
+			string cpuOpt(*s);
+			cpuOpt+=".max-cpu";
+			if(configFileExists && vm.count(cpuOpt.c_str()))
+				d.limits.maxCpu=vm[cpuOpt.c_str()].as<unsigned int>();
+
+			d.limits.coreDumps=vm["core-dumps"].as<bool>();
+
+			string timeoutOpt(*s);
+			timeoutOpt+=".timeout";
+			if(configFileExists && vm.count(timeoutOpt.c_str()))
 			{
-				sm->addSolver(*s, vm[solvOpt.c_str()].as<string>(), inputOnStdin);
+				d.limits.timeout=vm[timeoutOpt.c_str()].as<double>();
+				if(d.limits.timeout < 0.0)
+				{
+					cerr << "Error: " << timeoutOpt << " can't be negative." << endl;
+					exit(1);
+				}
 			}
+
+			portfolio->addSolver(d);
+		}
+
+		RaceLog::Format logFormat;
+		if(!RaceLog::parseFormat(vm["log-format"].as<string>(),logFormat))
+		{
+			cerr << "Error: log-format must be text, jsonl or binary." << endl;
+			exit(1);
+		}
+		portfolio->setLogFormat(logFormat);
+
+		if(vm["tier-delay"].as<double>() < 0.0)
+		{
+			cerr << "Error: tier-delay can't be negative." << endl;
+			exit(1);
+		}
+		portfolio->setTierDelay(vm["tier-delay"].as<double>());
+		if(vm["kill-grace"].as<double>() < 0.0)
+		{
+			cerr << "Error: kill-grace can't be negative." << endl;
+			exit(1);
+		}
+		portfolio->setKillGrace(vm["kill-grace"].as<double>());
+
+		portfolio->setShareInput(vm["share-input"].as<bool>());
+		portfolio->setFastSpawn(vm["fast-spawn"].as<bool>());
+		if(!daemonMode && vm["input"].as<string>() == "-" && !vm["share-input"].as<bool>())
+			cerr << "Warning: The input on stdin (-) is always shared, ignoring share-input." << endl;
+
+		if(vm["select-top"].as<unsigned int>() > 0)
+		{
+			double explore=vm["select-explore"].as<double>();
+			if(explore < 0.0 || explore > 1.0)
+			{
+				cerr << "Error: select-explore must be between 0 and 1." << endl;
+				exit(1);
+			}
+
+			string history=vm["select-history"].as<string>();
+			if(history.empty())
+				history=loggingPath;
+
+			portfolio->enableSelection(history,vm["select-top"].as<unsigned int>(),explore);
+		}
+
+		double percentile=vm["adaptive-timeout"].as<double>();
+		if(percentile < 0.0 || percentile > 100.0)
+		{
+			cerr << "Error: adaptive-timeout must be between 0 and 100." << endl;
+			exit(1);
+		}
+
+		double slack=vm["adaptive-timeout-slack"].as<double>();
+		if(slack < 1.0)
+		{
+			cerr << "Error: adaptive-timeout-slack can't be less than 1." << endl;
+			exit(1);
+		}
+
+		if(percentile > 0.0)
+		{
+			string history=vm["select-history"].as<string>();
+			if(history.empty())
+				history=loggingPath;
+
+			if(lMode)
+				cerr << "Warning: adaptive-timeout is ignored in logging mode." << endl;
+			else if(history.empty())
+				cerr << "Warning: adaptive-timeout needs a --select-history to learn from." << endl;
 			else
-				sm->addSolver(*s,inputOnStdin);
+				portfolio->enableAdaptiveTimeouts(history,percentile,slack);
+		}
+
+		if(vm["pin-solvers"].as<bool>())
+		{
+			if(vm.count("daemon"))
+				cerr << "Warning: Concurrent queries in daemon mode are pinned to the same CPUs." << endl;
 
+			portfolio->enablePinning();
 		}
 
+		if(vm["pool"].as<bool>())
+		{
+			if(!daemonMode)
+				cerr << "Warning: pool is only used in daemon mode." << endl;
+
+			if(lMode)
+				cerr << "Warning: pool is not supported in logging mode. Ignoring it." << endl;
+			else
+			{
+				unsigned int workers=vm["pool-workers"].as<unsigned int>();
+
+				//Aim for one solver per CPU
+				if(workers == 0 && solverList.size() > 0)
+					workers= sysconf(_SC_NPROCESSORS_ONLN) / solverList.size();
+
+				portfolio->setPoolMode(true,workers);
+			}
+		}
+
+		//Must be done after all the solvers are added because they are part of the key.
+		if(!vm["cache-dir"].as<string>().empty())
+		{
+			unsigned long long maxBytes=vm["cache-size"].as<unsigned int>();
+			maxBytes*=1024*1024;
+			portfolio->enableResultCache(vm["cache-dir"].as<string>(),maxBytes);
+		}
+
+		if(vm.count("trace"))
+		{
+			if(daemonMode)
+				cerr << "Warning: --trace only traces a single <input>. Ignoring it." << endl;
+			else
+			{
+				tracer=new Trace();
+				if(!tracer->open(vm["trace"].as<string>()))
+					exit(1);
+			}
+		}
+
+		//A daemon creates a SolverManager for every request instead.
+		if(!daemonMode)
+			sm = portfolio->createSolverManager(vm["input"].as<string>());
 
 	}
 	catch(po::required_option& r)
@@ -289,6 +614,9 @@ void parseOptions(int argc, char* argv[])
 void printHelp(po::options_description& o)
 {
 	cout << NSOLV << " [options] <input>" << endl <<
+			NSOLV << " [options] --daemon <socket>" << endl <<
+			NSOLV << " [options] --session" << endl <<
+			NSOLV << " [options] --batch <directory|manifest>" << endl <<
 			"<input> is a valid (.smt2) SMTLIBv2 file." << endl << endl <<
 
 			"NSolv allows several SMTLIBv2 solvers to be invoked simultaneously (each as a separate process)." << endl <<
@@ -302,7 +630,69 @@ void printHelp(po::options_description& o)
 			"mode the answer from the first solver to return (sat|unsat) is used and all other solvers are killed." << endl <<
 			"In logging mode the answer from the first solver to return (sat|unsat) is used but are solvers are allowed to " << endl <<
 			"finish (unless they timeout). The times and answers from the solvers are saved to a log file " << endl <<
-			"(see --logging-path). If the log file already exists the times and answers are appended." << endl << endl <<
+			"(see --logging-path). If the log file already exists the times and answers are appended. The canonical " << endl <<
+			"fingerprint of each query (see --fingerprint) is also logged so that duplicate queries can be counted. " << endl <<
+			"Each race is appended to the log as one record in a single write so that any number of NSolv processes " << endl <<
+			"can share a log. --log-format picks text (the original format read by the scripts), jsonl (one JSON " << endl <<
+			"object per race) or binary. --print-log converts a log in any of them to JSON Lines." << endl << endl <<
+
+			"DAEMON MODE" << endl <<
+			"With --daemon <socket> NSolv reads its configuration once and then serves queries sent to the Unix " << endl <<
+			"domain socket <socket>. Each client connection is served concurrently. Queries can be sent with " << endl <<
+			"\"nsolv-client --socket <socket> <input>\" which behaves like \"nsolv <input>\"." << endl <<
+			"With \"pool = on\" the solvers are kept running between queries. Each query is sent to the solvers on " << endl <<
+			"standard input followed by (reset) so the \"<solver-name>.opts\" must make every solver read from standard " << endl <<
+			"input (e.g. \"z3.opts = -smt2 -in\")." << endl << endl <<
+
+			"SESSION MODE" << endl <<
+			"With --session NSolv reads SMTLIBv2 commands from standard input and keeps every solver running for the " << endl <<
+			"whole session. Declarations, (assert), (push) and (pop) are sent to every solver but only (check-sat) is " << endl <<
+			"raced. Commands like (get-model) are answered by the solver that won the last (check-sat). A solver that " << endl <<
+			"has not finished an earlier (check-sat) is restarted and given the current assertions again (see " << endl <<
+			"--session-resync-limit). As in pool mode every solver must read from standard input." << endl << endl <<
+
+			"BATCH MODE" << endl <<
+			"With --batch <directory|manifest> NSolv solves every .smt2 file under <directory> or every file listed in " << endl <<
+			"<manifest> (one per line, relative to the manifest, lines starting with # are ignored). Several races run " << endl <<
+			"at once (see --batch-jobs) and a line \"<answer> <seconds> <query>\" is printed for each query where <answer> " << endl <<
+			"is sat, unsat, timeout or error. Results are printed as races finish unless --batch-ordered is on." << endl << endl <<
+
+			"RESULT CACHE" << endl <<
+			"With --cache-dir <directory> the answer and output of the winning solver are saved. A query that is " << endl <<
+			"byte for byte identical to an earlier one is answered from the cache without running any solvers. Changing " << endl <<
+			"the solvers or their options invalidates the cache. The cache may be shared by any number of NSolv processes " << endl <<
+			"and the least recently used answers are removed when it grows beyond --cache-size. Session mode does not " << endl <<
+			"use the cache. In logging mode the solvers are always run." << endl << endl <<
+
+			"LAUNCH TIERS" << endl <<
+			"Adding \"<solver-name>.tier = <n>\" to the configuration file puts a solver in tier <n> (0 by default). " << endl <<
+			"Tier 0 starts at once and each following tier starts --tier-delay seconds after the one before, but only if no " << endl <<
+			"solver has answered sat or unsat yet. A solver answering unknown or failing starts the next tier " << endl <<
+			"straight away. In logging mode the tier of the winning solver and the solvers that were never started " << endl <<
+			"are logged. Pool and session modes start every solver at once." << endl << endl <<
+
+			"SOLVER SELECTION" << endl <<
+			"In logging mode the features of every query (logic, size, number of assertions and theories used) are " << endl <<
+			"logged with the times of the solvers. With --select-top <k> NSolv learns from such a log (see " << endl <<
+			"--select-history) which solvers do best on similar queries and only runs the best <k> of them. With " << endl <<
+			"probability --select-explore one of them is swapped for a random other solver. Use logging mode with " << endl <<
+			"selection so that the log keeps growing. Pool and session modes always run every solver." << endl << endl <<
+
+			"SOLVER TIMEOUTS" << endl <<
+			"Adding \"<solver-name>.timeout = <seconds>\" (e.g. \"z3.timeout = 0.25\") to the configuration file kills that " << endl <<
+			"solver once it has run that long so that its CPU is free for the others. In logging mode it is logged as " << endl <<
+			"timeout. With --adaptive-timeout <p> every other solver gets --adaptive-timeout-slack times the time it took " << endl <<
+			"on <p> percent of the similar queries (see SOLVER SELECTION) it solved in the --select-history log, if it " << endl <<
+			"has solved at least 3 of them. Adaptive timeouts are not used in logging mode so that the log keeps the full " << endl <<
+			"times. Pool and session modes only use --timeout." << endl << endl <<
+
+			"CPU PLACEMENT" << endl <<
+			"With --pin-solvers the CPU topology is read from sysfs and each solver is pinned to a CPU of its own before " << endl <<
+			"it starts. Separate physical cores are used first (spread over L2/L3 caches and sockets) and SMT siblings " << endl <<
+			"only when there are more solvers than cores. A solver's memory is allocated on the NUMA node of its CPU. " << endl <<
+			"Adding \"<solver-name>.cpus = <list>\" (e.g. \"z3.cpus = 0-3,8\") to the configuration file pins that solver to " << endl <<
+			"<list> even without --pin-solvers. In batch mode concurrent races get different CPUs. In logging mode the " << endl <<
+			"CPUs of each solver are logged." << endl << endl <<
 
 			"CONFIGURATION FILE FORMAT" << endl <<
 			"Here is an example..." << endl << endl <<
@@ -329,7 +719,8 @@ void printHelp(po::options_description& o)
 			"Quotes (\") are interpreted literally so it is not possible to have a single argument with a space in." << endl <<
 			"Whether or not the <input> is given to a particular solver on standard input can be controlled by adding the line " << endl <<
 			"starting with \"<solver-name>.input-on-stdin =\". The default behaviour is to pass <input> as the last command " << endl <<
-			"line parameter to the solver." << endl << endl <<
+			"line parameter to the solver. The CPUs a solver runs on can be set with \"<solver-name>.cpus =\" (see " << endl <<
+			"CPU PLACEMENT)." << endl << endl <<
 			"The --solver <name> option and \"solver = <name>\" option in the configuration file use <name> as the " << endl <<
 			"solver name but also as the executable name. Therefore <name> should be in your PATH." << endl << endl <<
 
@@ -342,6 +733,46 @@ void printHelp(po::options_description& o)
 	exit(0);
 }
 
+void printFingerprint(const string& inputFile)
+{
+	Fingerprinter f;
+	string fingerprint;
+	if(!f.computeFile(inputFile,fingerprint))
+		exit(1);
+
+	cout << fingerprint << endl;
+	exit(0);
+}
+
+void printLog(const string& path)
+{
+	vector<RaceRecord> records;
+	if(!RaceLog::read(path,records,verbose))
+	{
+		cerr << "Error: Couldn't read the log " << path << endl;
+		exit(1);
+	}
+
+	string line;
+	for(vector<RaceRecord>::const_iterator r=records.begin(); r != records.end(); ++r)
+	{
+		RaceLog::encode(*r,RaceLog::JSON_LINES,line);
+		cout << line;
+	}
+
+	exit(0);
+}
+
+void writeTrace()
+{
+	if(tracer == NULL)
+		return;
+
+	tracer->write();
+	delete tracer;
+	tracer=NULL;
+}
+
 void handleExit(int signum)
 {
 	int result=0;
@@ -358,6 +789,9 @@ void handleExit(int signum)
 		 * There is a possible race condition here if sm was already deleted. FIXME
 		 */
 		delete sm;
+
+		//The trace shows how far the race got.
+		if(tracer) tracer->write();
 	}
 
 	//Remove signal handler for signals.
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+if [ $# -ne 1 ]; then
+	echo "$0 : <input file>"
+	echo "<input file> - A logging file produced by NSolv"
+	echo ""
+	echo "This utility will report how many of the logged queries are duplicates"
+	echo "(have the same canonical fingerprint as an earlier query)"
+	exit
+fi
+
+INPUT="$1"
+
+if [ ! -r "${INPUT}" ]; then
+	echo "Can't open input file ${INPUT}"
+	exit
+fi
+
+grep -E '^#Fingerprint ' "${INPUT}" | awk 'BEGIN { total=0; unique=0; OFS="\t";}
+	{ total++; if(!($2 in seen)) { seen[$2]=1; unique++;} }
+	END {
+		print "#[queries]", "[unique]", "[duplicates]", "[duplicate rate]";
+		rate= total > 0? (total - unique) / total : 0;
+		print total, unique, total - unique, rate;
+	}'